@@ -0,0 +1,235 @@
+#ifndef __MIO_COMPRESS_H__
+#define __MIO_COMPRESS_H__
+
+#include <cstdint>
+#include <cstring>
+
+/*
+Small dependency free byte compressors, meant for image payloads that go over
+the network every frame:
+
+  Lz4Compress()       LZ4 block format (no frame header), fast with a modest
+                      ratio. Worst case output is Lz4CompressBound(size).
+  PackBitsEncode()    run length coding as in TIFF PackBits, for masks and
+                      other images with long runs of one value. Worst case
+                      output is PackBitsBound(size).
+
+The decoders check every length against both buffers, so a corrupt or hostile
+message fails instead of reading or writing out of bounds.
+*/
+
+namespace mio{
+
+namespace lz4{
+
+const size_t kMinMatch = 4;
+const size_t kLastLiteral = 5;   // the block ends with at least this many literals
+const size_t kMatchLimit = 12;   // no match starts in the last kMatchLimit bytes
+const int kHashLog = 12;
+const int kSkipTrigger = 6;      // misses before the search step grows
+
+inline uint32_t Read32(const uint8_t *ptr){
+  uint32_t v;
+  memcpy(&v, ptr, sizeof(v));
+  return v;
+}
+
+inline uint32_t Hash(const uint32_t v){
+  return (v * 2654435761u) >> (32 - kHashLog);
+}
+
+// Lengths of 15 and up continue in extra bytes of 255 each
+inline void PutLength(uint8_t *&dst, size_t len){
+  for(; len >= 255; len -= 255)
+    *dst++ = 255;
+  *dst++ = static_cast<uint8_t>(len);
+}
+
+inline bool GetLength(const uint8_t *&src, const uint8_t *src_end, size_t &len){
+  uint8_t b;
+  do{
+    if(src >= src_end)
+      return false;
+    b = *src++;
+    len += b;
+  } while(b == 255);
+  return true;
+}
+
+} //namespace lz4
+
+
+inline size_t Lz4CompressBound(const size_t src_size){
+  return src_size + src_size/255 + 16;
+}
+
+
+// Returns the compressed size, or 0 if dst_capacity is too small
+inline size_t Lz4Compress(const uint8_t *src, const size_t src_size, uint8_t *dst, const size_t dst_capacity){
+  using namespace lz4;
+  if(dst_capacity < Lz4CompressBound(src_size))
+    return 0;
+  uint32_t hash_table[1 << kHashLog];
+  memset(hash_table, 0, sizeof(hash_table));
+
+  uint8_t *const dst_start = dst;
+  size_t anchor = 0, pos = 1;
+  if(src_size > kMatchLimit){
+    const size_t match_limit = src_size - kMatchLimit;
+    hash_table[Hash(Read32(src))] = 0;
+    size_t num_miss = 0;
+    while(pos < match_limit){
+      const uint32_t seq = Read32(src + pos);
+      const uint32_t h = Hash(seq);
+      const size_t ref = hash_table[h];
+      hash_table[h] = pos;
+      if(pos - ref > 0xffff || Read32(src + ref) != seq){
+        // Step further the longer nothing matches, incompressible data goes fast
+        pos += 1 + (num_miss++ >> kSkipTrigger);
+        continue;
+      }
+      num_miss = 0;
+
+      size_t match_len = kMinMatch;
+      const size_t max_len = src_size - kLastLiteral - pos;
+      while(match_len < max_len && src[ref + match_len] == src[pos + match_len])
+        ++match_len;
+
+      const size_t literal_len = pos - anchor;
+      uint8_t *token = dst++;
+      *token = (literal_len >= 15 ? 15 : literal_len) << 4;
+      if(literal_len >= 15)
+        PutLength(dst, literal_len - 15);
+      memcpy(dst, src + anchor, literal_len);
+      dst += literal_len;
+      const size_t offset = pos - ref;
+      *dst++ = offset & 0xff;
+      *dst++ = offset >> 8;
+      const size_t extra_len = match_len - kMinMatch;
+      *token |= (extra_len >= 15 ? 15 : extra_len);
+      if(extra_len >= 15)
+        PutLength(dst, extra_len - 15);
+
+      pos += match_len;
+      anchor = pos;
+      if(pos - 2 < match_limit)
+        hash_table[Hash(Read32(src + pos - 2))] = pos - 2;
+    }
+  }
+
+  const size_t literal_len = src_size - anchor;
+  *dst++ = (literal_len >= 15 ? 15 : literal_len) << 4;
+  if(literal_len >= 15)
+    PutLength(dst, literal_len - 15);
+  memcpy(dst, src + anchor, literal_len);
+  dst += literal_len;
+  return dst - dst_start;
+}
+
+
+// Returns false unless src decodes to exactly dst_size bytes
+inline bool Lz4Decompress(const uint8_t *src, const size_t src_size, uint8_t *dst, const size_t dst_size){
+  using namespace lz4;
+  const uint8_t *const src_end = src + src_size;
+  size_t pos = 0;
+  while(src < src_end){
+    const uint8_t token = *src++;
+    size_t literal_len = token >> 4;
+    if(literal_len == 15 && !GetLength(src, src_end, literal_len))
+      return false;
+    if(literal_len > static_cast<size_t>(src_end - src) || literal_len > dst_size - pos)
+      return false;
+    memcpy(dst + pos, src, literal_len);
+    src += literal_len;
+    pos += literal_len;
+    if(src == src_end)
+      break; // the last sequence has no match
+
+    if(src_end - src < 2)
+      return false;
+    const size_t offset = src[0] | (src[1] << 8);
+    src += 2;
+    size_t match_len = token & 15;
+    if(match_len == 15 && !GetLength(src, src_end, match_len))
+      return false;
+    match_len += kMinMatch;
+    if(offset == 0 || offset > pos || match_len > dst_size - pos)
+      return false;
+    const uint8_t *match = dst + pos - offset;
+    if(offset >= match_len)
+      memcpy(dst + pos, match, match_len);
+    else // the match overlaps what it is copying, eg. a run
+      for(size_t i = 0; i < match_len; ++i)
+        dst[pos + i] = match[i];
+    pos += match_len;
+  }
+  return pos == dst_size;
+}
+
+
+inline size_t PackBitsBound(const size_t src_size){
+  return src_size + (src_size + 127)/128;
+}
+
+
+// Returns the encoded size, or 0 if dst_capacity is too small
+inline size_t PackBitsEncode(const uint8_t *src, const size_t src_size, uint8_t *dst, const size_t dst_capacity){
+  if(dst_capacity < PackBitsBound(src_size))
+    return 0;
+  uint8_t *const dst_start = dst;
+  size_t pos = 0;
+  while(pos < src_size){
+    size_t run_len = 1;
+    while(pos + run_len < src_size && run_len < 128 && src[pos + run_len] == src[pos])
+      ++run_len;
+    if(run_len >= 3){
+      *dst++ = static_cast<uint8_t>(257 - run_len); // -(run_len - 1)
+      *dst++ = src[pos];
+      pos += run_len;
+      continue;
+    }
+    // Literals until the next run of 3 or more
+    size_t literal_len = 0;
+    while(pos + literal_len < src_size && literal_len < 128){
+      const size_t p = pos + literal_len;
+      if(p + 2 < src_size && src[p] == src[p + 1] && src[p] == src[p + 2])
+        break;
+      ++literal_len;
+    }
+    *dst++ = static_cast<uint8_t>(literal_len - 1);
+    memcpy(dst, src + pos, literal_len);
+    dst += literal_len;
+    pos += literal_len;
+  }
+  return dst - dst_start;
+}
+
+
+// Returns false unless src decodes to exactly dst_size bytes
+inline bool PackBitsDecode(const uint8_t *src, const size_t src_size, uint8_t *dst, const size_t dst_size){
+  const uint8_t *const src_end = src + src_size;
+  size_t pos = 0;
+  while(src < src_end){
+    const uint8_t header = *src++;
+    if(header < 128){
+      const size_t literal_len = header + 1;
+      if(literal_len > static_cast<size_t>(src_end - src) || literal_len > dst_size - pos)
+        return false;
+      memcpy(dst + pos, src, literal_len);
+      src += literal_len;
+      pos += literal_len;
+    }
+    else if(header > 128){
+      const size_t run_len = 257 - header;
+      if(src == src_end || run_len > dst_size - pos)
+        return false;
+      memset(dst + pos, *src++, run_len);
+      pos += run_len;
+    }
+  }
+  return pos == dst_size;
+}
+
+} //namespace mio
+
+#endif //__MIO_COMPRESS_H__
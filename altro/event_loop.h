@@ -0,0 +1,244 @@
+#ifndef __MIO_EVENT_LOOP_H__
+#define __MIO_EVENT_LOOP_H__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "mio/altro/error.h"
+
+/*
+Single thread that waits on one epoll fd for any number of file descriptors
+(lcm_t instances, sockets, serial ports, ...) and timers, and calls the
+callback registered for each one that becomes ready, eg.
+
+  mio::EventLoop event_loop;
+  for (lcm_t *lcm : lcm_vec)
+    mio::AddLcmToEventLoop(event_loop, lcm);  // see mio/lcm/lcm_utils.h
+  event_loop.AddFd(serial_com.GetPortFD(), [&](uint32_t events) { ... });
+  const int timer_id = event_loop.AddTimer([&]() { ... }, std::chrono::milliseconds(500));
+  event_loop.Start();
+  ...
+  event_loop.Stop();
+
+Timers are timerfds, so a timer is one more fd in the same epoll set. Stop()
+wakes the loop through an eventfd, so the thread sleeps in epoll_wait() until
+there is work and never wakes up to poll an exit flag.
+
+Callbacks run on the loop thread, one at a time. Fds and timers can be added
+and removed from any thread, including from inside a callback. Run() can be
+used instead of Start() to run the loop on the calling thread.
+*/
+
+namespace mio{
+
+class EventLoop {
+  public:
+    typedef std::function<void(uint32_t events)> FdCallback;  // events holds the EPOLL* flags
+    typedef std::function<void()> TimerCallback;
+
+  private:
+    static const int kMaxEvent = 64;
+    static const uint64_t kWakeId = 0;  // registration ids start at 1
+
+    // Run() holds a copy of the handler while its callback runs, so a timer fd
+    // is closed when the last copy goes away, never under a running callback
+    struct Handler {
+      FdCallback callback;
+      int owned_fd;  // a timer fd, which the loop owns, or -1
+
+      Handler(const FdCallback &callback, const int owned_fd) : callback(callback), owned_fd(owned_fd) {}
+
+      ~Handler() {
+        if (owned_fd != -1)
+          close(owned_fd);
+      }
+
+      Handler(const Handler&) = delete;
+      Handler &operator=(const Handler&) = delete;
+    };
+
+    int epoll_fd_, wake_fd_;
+    std::mutex mtx_;  // guards the maps and next_id_
+    // Events carry the registration id rather than the fd, so an event that
+    // was already returned for a removed fd is not dispatched to a new handler
+    // that got the same fd number
+    std::unordered_map<int, uint64_t> fd_id_map_;
+    std::unordered_map< uint64_t, std::shared_ptr<Handler> > handler_map_;
+    uint64_t next_id_;
+    std::atomic<bool> exit_flag_;
+    std::thread thread_;
+
+    bool AddHandler(const int fd, const FdCallback &callback, const uint32_t events, const bool is_timer) {
+      EXP_CHK(IsInit(), return false)
+      EXP_CHK(fd >= 0 && callback, return false)
+      std::lock_guard<std::mutex> lock(mtx_);
+      EXP_CHK_M(fd_id_map_.count(fd) == 0, return false, "fd " + std::to_string(fd) + " is already registered")
+      epoll_event event;
+      event.events = events;
+      event.data.u64 = next_id_;
+      EXP_CHK_ERRNO(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, fd, &event) == 0, return false)
+      fd_id_map_[fd] = next_id_;
+      handler_map_[next_id_++] = std::make_shared<Handler>(callback, is_timer ? fd : -1);
+      return true;
+    }
+
+    static itimerspec MakeTimerSpec(const std::chrono::nanoseconds initial, const std::chrono::nanoseconds period) {
+      itimerspec spec;
+      spec.it_value.tv_sec = initial.count() / 1000000000;
+      spec.it_value.tv_nsec = initial.count() % 1000000000;
+      spec.it_interval.tv_sec = period.count() / 1000000000;
+      spec.it_interval.tv_nsec = period.count() % 1000000000;
+      return spec;
+    }
+
+  public:
+    EventLoop() : epoll_fd_(-1), wake_fd_(-1), next_id_(kWakeId + 1), exit_flag_(false) {
+      EXP_CHK_ERRNO((epoll_fd_ = epoll_create1(EPOLL_CLOEXEC)) != -1, return)
+      EXP_CHK_ERRNO((wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) != -1, return)
+      epoll_event event;
+      event.events = EPOLLIN;
+      event.data.u64 = kWakeId;
+      EXP_CHK_ERRNO(epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event) == 0, return)
+    }
+
+    ~EventLoop() {
+      Stop();
+      fd_id_map_.clear();
+      handler_map_.clear();  // closes the timer fds
+      if (wake_fd_ != -1)
+        close(wake_fd_);
+      if (epoll_fd_ != -1)
+        close(epoll_fd_);
+    }
+
+    EventLoop(const EventLoop&) = delete;
+    EventLoop &operator=(const EventLoop&) = delete;
+
+    bool IsInit() const {
+      return epoll_fd_ != -1 && wake_fd_ != -1;
+    }
+
+    // events is a mask of EPOLLIN, EPOLLOUT, EPOLLET, ... The fd stays open
+    // and owned by the caller, remove it before closing it.
+    bool AddFd(const int fd, const FdCallback &callback, const uint32_t events = EPOLLIN) {
+      return AddHandler(fd, callback, events, false);
+    }
+
+    bool ModifyFd(const int fd, const uint32_t events) {
+      EXP_CHK(IsInit(), return false)
+      std::lock_guard<std::mutex> lock(mtx_);
+      auto id_it = fd_id_map_.find(fd);
+      EXP_CHK_M(id_it != fd_id_map_.end(), return false, "fd " + std::to_string(fd) + " is not registered")
+      epoll_event event;
+      event.events = events;
+      event.data.u64 = id_it->second;
+      EXP_CHK_ERRNO(epoll_ctl(epoll_fd_, EPOLL_CTL_MOD, fd, &event) == 0, return false)
+      return true;
+    }
+
+    // From the loop thread (eg. inside a callback), the callback is not called
+    // again once this returns. From any other thread, a callback that the loop
+    // has already picked up can still run once after this returns.
+    bool RemoveFd(const int fd) {
+      EXP_CHK(IsInit(), return false)
+      std::lock_guard<std::mutex> lock(mtx_);
+      auto id_it = fd_id_map_.find(fd);
+      EXP_CHK_M(id_it != fd_id_map_.end(), return false, "fd " + std::to_string(fd) + " is not registered")
+      EXP_CHK_ERRNO(epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, fd, NULL) == 0, return false)
+      handler_map_.erase(id_it->second);  // a timer fd closes with the last copy of its handler
+      fd_id_map_.erase(id_it);
+      return true;
+    }
+
+    // Calls callback after initial and then every period, or only once if
+    // period is zero. Returns the timer id (a timerfd) or -1 on error.
+    int AddTimer(const TimerCallback &callback, const std::chrono::nanoseconds initial,
+                 const std::chrono::nanoseconds period = std::chrono::nanoseconds(0)) {
+      EXP_CHK(IsInit(), return -1)
+      EXP_CHK(callback, return -1)
+      int timer_fd;
+      EXP_CHK_ERRNO((timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) != -1, return -1)
+      const bool added = AddHandler(timer_fd, [timer_fd, callback](uint32_t) {
+        uint64_t num_expiration;
+        if (read(timer_fd, &num_expiration, sizeof(num_expiration)) == sizeof(num_expiration))
+          callback();
+      }, EPOLLIN, true);
+      EXP_CHK(added, close(timer_fd); return -1)
+      EXP_CHK(SetTimer(timer_fd, initial, period), RemoveFd(timer_fd); return -1)
+      return timer_fd;
+    }
+
+    // Re-arms a timer, replacing its previous schedule. An initial of zero
+    // disarms it until the next SetTimer().
+    bool SetTimer(const int timer_id, const std::chrono::nanoseconds initial,
+                  const std::chrono::nanoseconds period = std::chrono::nanoseconds(0)) {
+      const itimerspec spec = MakeTimerSpec(initial, period);
+      EXP_CHK_ERRNO(timerfd_settime(timer_id, 0, &spec, NULL) == 0, return false)
+      return true;
+    }
+
+    bool RemoveTimer(const int timer_id) {
+      return RemoveFd(timer_id);
+    }
+
+    // Dispatches events on the calling thread until Stop()
+    void Run() {
+      EXP_CHK(IsInit(), return)
+      uint64_t num_wake;
+      if (read(wake_fd_, &num_wake, sizeof(num_wake))) {}  // drop the wake up left by an earlier Stop()
+      epoll_event events[kMaxEvent];
+      while (!exit_flag_) {
+        const int num_event = epoll_wait(epoll_fd_, events, kMaxEvent, -1);
+        if (num_event == -1) {
+          EXP_CHK_ERRNO(errno == EINTR, return)
+          continue;
+        }
+        for (int i = 0; i < num_event && !exit_flag_; ++i) {
+          if (events[i].data.u64 == kWakeId) {
+            if (read(wake_fd_, &num_wake, sizeof(num_wake))) {}  // exit_flag_ says why
+            continue;
+          }
+          std::shared_ptr<Handler> handler;
+          {
+            std::lock_guard<std::mutex> lock(mtx_);
+            auto item_it = handler_map_.find(events[i].data.u64);
+            if (item_it == handler_map_.end())
+              continue;  // removed by an earlier callback in this batch, even if its fd was reused
+            handler = item_it->second;
+          }
+          handler->callback(events[i].events);
+        }
+      }
+    }
+
+    void Start() {
+      EXP_CHK(IsInit(), return)
+      EXP_CHK(!thread_.joinable(), return)
+      exit_flag_ = false;
+      thread_ = std::thread(&EventLoop::Run, this);
+    }
+
+    // Safe to call from a callback, the loop then exits once the callback returns
+    void Stop() {
+      if (wake_fd_ == -1)
+        return;
+      exit_flag_ = true;
+      const uint64_t one = 1;
+      EXP_CHK_ERRNO(write(wake_fd_, &one, sizeof(one)) == sizeof(one), return)
+      if (thread_.joinable() && std::this_thread::get_id() != thread_.get_id())
+        thread_.join();
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_EVENT_LOOP_H__
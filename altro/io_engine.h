@@ -0,0 +1,615 @@
+#ifndef __MIO_IO_ENGINE_H__
+#define __MIO_IO_ENGINE_H__
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include "mio/altro/error.h"
+
+/*
+Asynchronous read/write/recv/send on any number of fds (sockets, serial
+ports, pipes, ...) that complete through one io_uring, eg.
+
+  mio::IoEngine io_engine;
+  io_engine.RegisterFile(serial_com.GetPortFD());  // optional, fixed file
+  std::function<void(int)> on_serial = [&](const int result) {
+    if (result > 0)
+      Parse(serial_buf, result);
+    io_engine.Read(serial_com.GetPortFD(), serial_buf, sizeof(serial_buf), on_serial);  // read again
+  };
+  io_engine.Read(serial_com.GetPortFD(), serial_buf, sizeof(serial_buf), on_serial);
+  io_engine.Recv(sock_fd, sock_buf, sizeof(sock_buf), 0, on_sock, 500);  // give up after 500 ms
+  for (;;)
+    io_engine.Run();  // waits for completions and runs their callbacks
+
+An operation is one read(), write(), recv() or send(). Its callback gets what
+that call returns, the number of bytes (which can be short) or -errno, and
+-ETIMEDOUT if timeout_ms passed first. The kernel waits for a blocking fd to
+be ready and then runs the transfer inline, without io_uring's worker threads.
+A non-blocking fd (O_NONBLOCK, eg. a SerialCom port opened with O_NDELAY)
+that is not ready fails with -EAGAIN; the operation is then submitted again
+as a poll for the fd linked to the transfer. Many operations wait in the
+kernel at once and a single io_uring_enter() submits new ones and reaps all
+that are done.
+
+RegisterFile() makes an fd a fixed file, which saves the kernel a file table
+lookup and reference count per operation. RegisterBuffers() pins buffers;
+Read()/Write() into or out of them then use the fixed buffer opcodes, which
+skip mapping the user pages every time.
+
+Without io_uring (Linux < 5.11, kernel.io_uring_disabled, seccomp, or
+use_uring false) the same API runs on poll() and plain system calls, and the
+register functions do nothing. There the transfer is a plain read()/write()
+once poll() reports the fd ready, so keep at most one Read() (or Write())
+pending per blocking fd: two reads on a blocking fd both see it readable, the
+first takes the data and the second blocks the whole engine in read(). Make
+the fd O_NONBLOCK to queue several. The engine is not thread safe, it is meant
+to be driven by one thread, like an EventLoop.
+*/
+
+namespace mio{
+
+class IoEngine {
+  public:
+    typedef std::function<void(int result)> Callback;
+
+  private:
+    enum OpType { kRead, kWrite, kRecv, kSend };
+    // user_data is the operation id shifted left 2, the low bits tell which request of an operation completed
+    enum RequestKind { kTransfer = 0, kPoll = 1, kCancel = 2 };
+
+    struct Op {
+      OpType type;
+      int fd, flags;
+      uint8_t *buf;
+      size_t len;
+      Callback callback;
+      std::chrono::steady_clock::time_point deadline;
+      bool has_deadline, expired;
+      bool poll_first;  // a poll for the fd is linked ahead of the transfer
+      int poll_result;  // error of that poll, if any
+    };
+
+    struct Completion {
+      Callback callback;
+      int result;
+    };
+
+    std::unordered_map<uint64_t, Op> op_map_;
+    std::vector<Completion> completion_vec_;
+    uint64_t next_op_id_;
+    size_t num_deadline_;  // pending operations with a timeout, the others need no clock
+    bool use_uring_;
+
+#ifdef IORING_FEAT_EXT_ARG
+    static const unsigned int kNumFixedFile = 64;
+
+    int ring_fd_;
+    unsigned int num_entry_, num_to_submit_;
+    void *sq_ring_, *cq_ring_;
+    size_t sq_ring_size_, cq_ring_size_, sqes_size_;
+    unsigned int *sq_head_, *sq_tail_, *sq_mask_, *sq_array_;
+    unsigned int *cq_head_, *cq_tail_, *cq_mask_;
+    struct io_uring_sqe *sqes_;
+    struct io_uring_cqe *cqes_;
+    std::unordered_map<int, int> fixed_file_map_;  // fd to fixed file slot
+    std::vector<int> fixed_file_vec_;  // slot to fd, -1 if free
+    std::vector<struct iovec> fixed_buf_vec_;
+
+    static int Setup(const unsigned int num_entry, struct io_uring_params *params) {
+      return static_cast<int>(syscall(__NR_io_uring_setup, num_entry, params));
+    }
+
+    int Enter(const unsigned int to_submit, const unsigned int min_complete, const unsigned int flags,
+              void *arg, const size_t arg_size) {
+      return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd_, to_submit, min_complete, flags, arg, arg_size));
+    }
+
+    int Register(const unsigned int opcode, const void *arg, const unsigned int num_arg) {
+      return static_cast<int>(syscall(__NR_io_uring_register, ring_fd_, opcode, arg, num_arg));
+    }
+
+    bool InitUring(const unsigned int num_entry) {
+      struct io_uring_params params;
+      memset(&params, 0, sizeof(params));
+      ring_fd_ = Setup(num_entry, &params);
+      if (ring_fd_ == -1) {
+        printf("%s - io_uring is not available (%s), using poll()\n", CURRENT_FUNC, std::strerror(errno));
+        return false;
+      }
+      if (!(params.features & IORING_FEAT_EXT_ARG) || !(params.features & IORING_FEAT_NODROP)) {
+        printf("%s - io_uring is too old (Linux 5.11 needed), using poll()\n", CURRENT_FUNC);
+        close(ring_fd_);
+        ring_fd_ = -1;
+        return false;
+      }
+      num_entry_ = params.sq_entries;
+      sq_ring_size_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+      cq_ring_size_ = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+      const bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+      if (single_mmap)
+        sq_ring_size_ = cq_ring_size_ = std::max(sq_ring_size_, cq_ring_size_);
+      sq_ring_ = mmap(NULL, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                      IORING_OFF_SQ_RING);
+      EXP_CHK_ERRNO(sq_ring_ != MAP_FAILED, sq_ring_ = NULL; UninitUring(); return false)
+      if (single_mmap) {
+        cq_ring_ = sq_ring_;
+      } else {
+        cq_ring_ = mmap(NULL, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_,
+                        IORING_OFF_CQ_RING);
+        EXP_CHK_ERRNO(cq_ring_ != MAP_FAILED, cq_ring_ = NULL; UninitUring(); return false)
+      }
+      sqes_size_ = params.sq_entries * sizeof(struct io_uring_sqe);
+      sqes_ = static_cast<struct io_uring_sqe*>(mmap(NULL, sqes_size_, PROT_READ | PROT_WRITE,
+                                                     MAP_SHARED | MAP_POPULATE, ring_fd_, IORING_OFF_SQES));
+      EXP_CHK_ERRNO(sqes_ != MAP_FAILED, sqes_ = NULL; UninitUring(); return false)
+
+      uint8_t *sq_ptr = static_cast<uint8_t*>(sq_ring_), *cq_ptr = static_cast<uint8_t*>(cq_ring_);
+      sq_head_ = reinterpret_cast<unsigned int*>(sq_ptr + params.sq_off.head);
+      sq_tail_ = reinterpret_cast<unsigned int*>(sq_ptr + params.sq_off.tail);
+      sq_mask_ = reinterpret_cast<unsigned int*>(sq_ptr + params.sq_off.ring_mask);
+      sq_array_ = reinterpret_cast<unsigned int*>(sq_ptr + params.sq_off.array);
+      cq_head_ = reinterpret_cast<unsigned int*>(cq_ptr + params.cq_off.head);
+      cq_tail_ = reinterpret_cast<unsigned int*>(cq_ptr + params.cq_off.tail);
+      cq_mask_ = reinterpret_cast<unsigned int*>(cq_ptr + params.cq_off.ring_mask);
+      cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq_ptr + params.cq_off.cqes);
+      return true;
+    }
+
+    void UninitUring() {
+      if (sqes_ != NULL)
+        munmap(sqes_, sqes_size_);
+      if (cq_ring_ != NULL && cq_ring_ != sq_ring_)
+        munmap(cq_ring_, cq_ring_size_);
+      if (sq_ring_ != NULL)
+        munmap(sq_ring_, sq_ring_size_);
+      if (ring_fd_ != -1)
+        close(ring_fd_);
+      sqes_ = NULL;
+      sq_ring_ = cq_ring_ = NULL;
+      ring_fd_ = -1;
+    }
+
+    // Makes room for num_sqe more sqes, submitting what is queued when the ring is full. The sqes of one
+    // operation are reserved together, so its link is not split across two submissions.
+    bool ReserveSqes(const unsigned int num_sqe) {
+      if (*sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) + num_sqe <= num_entry_)
+        return true;
+      EXP_CHK_ERRNO(Enter(num_to_submit_, 0, 0, NULL, 0) != -1, return false)
+      num_to_submit_ = 0;
+      return *sq_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) + num_sqe <= num_entry_;
+    }
+
+    // Returns a zeroed sqe, after ReserveSqes()
+    struct io_uring_sqe *GetSqe() {
+      const unsigned int tail = *sq_tail_;
+      const unsigned int idx = tail & *sq_mask_;
+      struct io_uring_sqe *sqe = &sqes_[idx];
+      memset(sqe, 0, sizeof(*sqe));
+      sq_array_[idx] = idx;
+      __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+      ++num_to_submit_;
+      return sqe;
+    }
+
+    void SetFd(struct io_uring_sqe *sqe, const int fd) {
+      std::unordered_map<int, int>::const_iterator it = fixed_file_map_.find(fd);
+      if (it == fixed_file_map_.end()) {
+        sqe->fd = fd;
+      } else {
+        sqe->fd = it->second;
+        sqe->flags |= IOSQE_FIXED_FILE;
+      }
+    }
+
+    // Index of the registered buffer holding [buf, buf + len), or -1
+    int FindFixedBuffer(const uint8_t *buf, const size_t len) const {
+      for (size_t i = 0; i < fixed_buf_vec_.size(); ++i) {
+        const uint8_t *base = static_cast<const uint8_t*>(fixed_buf_vec_[i].iov_base);
+        if (buf >= base && buf + len <= base + fixed_buf_vec_[i].iov_len)
+          return static_cast<int>(i);
+      }
+      return -1;
+    }
+
+    // Queues the transfer, with poll_first behind a poll for the fd that it is linked to
+    bool SubmitUringOp(const uint64_t op_id, const Op &op) {
+      EXP_CHK_M(ReserveSqes(op.poll_first ? 2 : 1), return false, "submission queue is full")
+      if (op.poll_first) {
+        struct io_uring_sqe *poll_sqe = GetSqe();
+        poll_sqe->opcode = IORING_OP_POLL_ADD;
+        SetFd(poll_sqe, op.fd);
+        poll_sqe->poll32_events = (op.type == kRead || op.type == kRecv) ? POLLIN : POLLOUT;
+        poll_sqe->flags |= IOSQE_IO_LINK;
+        poll_sqe->user_data = (op_id << 2) | kPoll;
+      }
+
+      struct io_uring_sqe *sqe = GetSqe();
+      SetFd(sqe, op.fd);
+      sqe->addr = reinterpret_cast<uint64_t>(op.buf);
+      sqe->len = static_cast<uint32_t>(op.len);
+      sqe->user_data = (op_id << 2) | kTransfer;
+      if (op.type == kRecv || op.type == kSend) {
+        sqe->opcode = (op.type == kRecv) ? IORING_OP_RECV : IORING_OP_SEND;
+        sqe->msg_flags = static_cast<uint32_t>(op.flags);
+        return true;
+      }
+      sqe->off = static_cast<uint64_t>(-1);  // the current file position, streams have none
+      const int buf_idx = FindFixedBuffer(op.buf, op.len);
+      if (buf_idx == -1) {
+        sqe->opcode = (op.type == kRead) ? IORING_OP_READ : IORING_OP_WRITE;
+      } else {
+        sqe->opcode = (op.type == kRead) ? IORING_OP_READ_FIXED : IORING_OP_WRITE_FIXED;
+        sqe->buf_index = static_cast<uint16_t>(buf_idx);
+      }
+      return true;
+    }
+
+    void SubmitCancel(const uint64_t user_data) {
+      EXP_CHK_M(ReserveSqes(1), return, "submission queue is full")
+      struct io_uring_sqe *sqe = GetSqe();
+      sqe->opcode = IORING_OP_ASYNC_CANCEL;
+      sqe->addr = user_data;
+      sqe->user_data = (user_data & ~3ull) | kCancel;
+    }
+
+    void HandleCqe(const uint64_t user_data, const int result) {
+      const RequestKind kind = static_cast<RequestKind>(user_data & 3);
+      if (kind == kCancel)
+        return;
+      std::unordered_map<uint64_t, Op>::iterator it = op_map_.find(user_data >> 2);
+      if (it == op_map_.end())
+        return;
+      Op &op = it->second;
+      if (kind == kPoll) {
+        if (result < 0 && result != -ECANCELED)
+          op.poll_result = result;  // the linked transfer completes with -ECANCELED
+        return;
+      }
+      if (result == -EAGAIN && !op.expired) {  // a non-blocking fd that is not ready, wait for it with a poll
+        op.poll_first = true;
+        if (SubmitUringOp(it->first, op))
+          return;
+      }
+      Complete(it, result);
+    }
+
+    // Submits what is queued and waits up to wait_ms (-1 forever) for a completion, then reaps all there are
+    int WaitUring(const int wait_ms) {
+      struct __kernel_timespec ts;
+      struct io_uring_getevents_arg arg;
+      memset(&arg, 0, sizeof(arg));
+      if (wait_ms >= 0) {
+        ts.tv_sec = wait_ms / 1000;
+        ts.tv_nsec = (wait_ms % 1000) * 1000000ll;
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+      }
+      const bool have_cqe = *cq_head_ != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      const unsigned int min_complete = (wait_ms == 0 || have_cqe) ? 0 : 1;
+      if (num_to_submit_ > 0 || min_complete > 0) {
+        const int num_submitted = Enter(num_to_submit_, min_complete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG,
+                                        &arg, sizeof(arg));
+        EXP_CHK_ERRNO(num_submitted != -1 || errno == ETIME || errno == EINTR || errno == EBUSY, return -1)
+        if (num_submitted > 0)
+          num_to_submit_ -= std::min<unsigned int>(num_to_submit_, num_submitted);
+      }
+      unsigned int head = *cq_head_;
+      const unsigned int tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+      std::vector< std::pair<uint64_t, int> > cqe_vec;
+      cqe_vec.reserve(tail - head);
+      for (; head != tail; ++head) {
+        const struct io_uring_cqe &cqe = cqes_[head & *cq_mask_];
+        cqe_vec.push_back(std::make_pair(static_cast<uint64_t>(cqe.user_data), static_cast<int>(cqe.res)));
+      }
+      __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+      for (size_t i = 0; i < cqe_vec.size(); ++i)
+        HandleCqe(cqe_vec[i].first, cqe_vec[i].second);
+      return 0;
+    }
+#endif //IORING_FEAT_EXT_ARG
+
+    void Complete(std::unordered_map<uint64_t, Op>::iterator it, int result) {
+      const Op &op = it->second;
+      if (op.has_deadline)
+        --num_deadline_;
+      if (op.expired && (result == -ECANCELED || result == -EAGAIN))
+        result = -ETIMEDOUT;
+      else if (result == -ECANCELED && op.poll_result < 0)
+        result = op.poll_result;
+      completion_vec_.push_back(Completion{op.callback, result});
+      op_map_.erase(it);
+    }
+
+    // One system call for the operation, -EAGAIN if the fd was not ready after all
+    static int Transfer(const Op &op) {
+      ssize_t result = -1;
+      switch (op.type) {
+        case kRead:
+          result = read(op.fd, op.buf, op.len);
+          break;
+        case kWrite:
+          result = write(op.fd, op.buf, op.len);
+          break;
+        case kRecv:
+          result = recv(op.fd, op.buf, op.len, op.flags | MSG_DONTWAIT);
+          break;
+        case kSend:
+          result = send(op.fd, op.buf, op.len, op.flags | MSG_DONTWAIT | MSG_NOSIGNAL);
+          break;
+      }
+      return result == -1 ? -errno : static_cast<int>(result);
+    }
+
+    // poll() on the fd of every operation, then runs the transfers that are ready
+    int WaitPoll(const int wait_ms) {
+      std::vector<struct pollfd> pfd_vec;
+      std::vector<uint64_t> op_id_vec;
+      pfd_vec.reserve(op_map_.size());
+      op_id_vec.reserve(op_map_.size());
+      for (std::unordered_map<uint64_t, Op>::const_iterator it = op_map_.begin(); it != op_map_.end(); ++it) {
+        struct pollfd pfd;
+        pfd.fd = it->second.fd;
+        pfd.events = (it->second.type == kRead || it->second.type == kRecv) ? POLLIN : POLLOUT;
+        pfd.revents = 0;
+        pfd_vec.push_back(pfd);
+        op_id_vec.push_back(it->first);
+      }
+      const int num_ready = poll(pfd_vec.data(), pfd_vec.size(), wait_ms);
+      EXP_CHK_ERRNO(num_ready != -1 || errno == EINTR, return -1)
+      for (size_t i = 0; num_ready > 0 && i < pfd_vec.size(); ++i) {
+        if (pfd_vec[i].revents == 0)
+          continue;
+        std::unordered_map<uint64_t, Op>::iterator it = op_map_.find(op_id_vec[i]);
+        const int result = (pfd_vec[i].revents & POLLNVAL) ? -EBADF : Transfer(it->second);
+        if (result != -EAGAIN && result != -EINTR)
+          Complete(it, result);
+      }
+      return 0;
+    }
+
+    void HandleExpired() {
+      if (num_deadline_ == 0)
+        return;
+      const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      for (std::unordered_map<uint64_t, Op>::iterator it = op_map_.begin(); it != op_map_.end();) {
+        Op &op = it->second;
+        if (!op.has_deadline || op.expired || now < op.deadline) {
+          ++it;
+          continue;
+        }
+        op.expired = true;
+#ifdef IORING_FEAT_EXT_ARG
+        if (use_uring_) {  // the cancelled requests complete with -ECANCELED
+          SubmitCancel((it->first << 2) | kPoll);
+          SubmitCancel((it->first << 2) | kTransfer);
+          ++it;
+          continue;
+        }
+#endif
+        std::unordered_map<uint64_t, Op>::iterator expired_it = it++;
+        Complete(expired_it, -ETIMEDOUT);
+      }
+    }
+
+    // Milliseconds until the next deadline, capped at wait_ms (-1 is no cap)
+    int GetWaitMs(const int wait_ms) const {
+      int min_wait_ms = wait_ms;
+      if (num_deadline_ == 0)
+        return min_wait_ms;
+      const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+      for (std::unordered_map<uint64_t, Op>::const_iterator it = op_map_.begin(); it != op_map_.end(); ++it) {
+        if (!it->second.has_deadline || it->second.expired)
+          continue;
+        const int64_t ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            it->second.deadline - now).count() + 1;
+        const int op_wait_ms = static_cast<int>(std::max<int64_t>(ms, 0));
+        if (min_wait_ms < 0 || op_wait_ms < min_wait_ms)
+          min_wait_ms = op_wait_ms;
+      }
+      return min_wait_ms;
+    }
+
+    bool Add(const OpType type, const int fd, void *buf, const size_t len, const int flags, const Callback &callback,
+             const int timeout_ms) {
+      EXP_CHK(fd >= 0 && callback, return false)
+      Op op;
+      op.type = type;
+      op.fd = fd;
+      op.flags = flags;
+      op.buf = static_cast<uint8_t*>(buf);
+      op.len = len;
+      op.callback = callback;
+      op.has_deadline = timeout_ms >= 0;
+      op.expired = false;
+      op.poll_first = false;
+      op.poll_result = 0;
+      if (op.has_deadline)
+        op.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+      const uint64_t op_id = next_op_id_++;
+#ifdef IORING_FEAT_EXT_ARG
+      if (use_uring_) {
+        EXP_CHK(SubmitUringOp(op_id, op), return false)
+      }
+#endif
+      op_map_[op_id] = op;
+      if (op.has_deadline)
+        ++num_deadline_;
+      return true;
+    }
+
+  public:
+    // num_entry is the size of the submission queue, up to two entries per operation
+    IoEngine(const unsigned int num_entry = 256, const bool use_uring = true) :
+        next_op_id_(0), num_deadline_(0), use_uring_(false) {
+#ifdef IORING_FEAT_EXT_ARG
+      ring_fd_ = -1;
+      num_entry_ = num_to_submit_ = 0;
+      sq_ring_ = cq_ring_ = NULL;
+      sqes_ = NULL;
+      if (use_uring)
+        use_uring_ = InitUring(num_entry);
+#endif
+    }
+
+    ~IoEngine() {
+#ifdef IORING_FEAT_EXT_ARG
+      if (use_uring_)
+        UninitUring();  // pending operations are cancelled, without their callbacks
+#endif
+    }
+
+    IoEngine(const IoEngine&) = delete;
+    IoEngine &operator=(const IoEngine&) = delete;
+
+    bool IsUring() const {
+      return use_uring_;
+    }
+
+    // Makes fd a fixed file for its operations until UnregisterFile(), up to 64 fds
+    bool RegisterFile(const int fd) {
+#ifdef IORING_FEAT_EXT_ARG
+      if (!use_uring_ || fixed_file_map_.count(fd) > 0)
+        return true;
+      if (fixed_file_vec_.empty()) {  // a sparse table, slots are filled in one at a time
+        std::vector<int> fd_vec(kNumFixedFile, -1);
+        EXP_CHK_ERRNO(Register(IORING_REGISTER_FILES, fd_vec.data(), kNumFixedFile) != -1, return false)
+        fixed_file_vec_ = fd_vec;
+      }
+      const size_t slot = std::find(fixed_file_vec_.begin(), fixed_file_vec_.end(), -1) - fixed_file_vec_.begin();
+      EXP_CHK_M(slot < fixed_file_vec_.size(), return false, "no free fixed file slot")
+      struct io_uring_files_update update;
+      memset(&update, 0, sizeof(update));
+      int update_fd = fd;
+      update.offset = static_cast<uint32_t>(slot);
+      update.fds = reinterpret_cast<uint64_t>(&update_fd);
+      EXP_CHK_ERRNO(Register(IORING_REGISTER_FILES_UPDATE, &update, 1) == 1, return false)
+      fixed_file_vec_[slot] = fd;
+      fixed_file_map_[fd] = static_cast<int>(slot);
+#else
+      (void)fd;
+#endif
+      return true;
+    }
+
+    // Call before the fd is closed, once none of its operations are pending
+    bool UnregisterFile(const int fd) {
+#ifdef IORING_FEAT_EXT_ARG
+      std::unordered_map<int, int>::iterator it = fixed_file_map_.find(fd);
+      if (it == fixed_file_map_.end())
+        return true;
+      struct io_uring_files_update update;
+      memset(&update, 0, sizeof(update));
+      int update_fd = -1;
+      update.offset = static_cast<uint32_t>(it->second);
+      update.fds = reinterpret_cast<uint64_t>(&update_fd);
+      EXP_CHK_ERRNO(Register(IORING_REGISTER_FILES_UPDATE, &update, 1) == 1, return false)
+      fixed_file_vec_[it->second] = -1;
+      fixed_file_map_.erase(it);
+#else
+      (void)fd;
+#endif
+      return true;
+    }
+
+    // Pins the buffers for Read()/Write(), replacing the ones registered before. Pinned memory counts against
+    // RLIMIT_MEMLOCK on older kernels.
+    bool RegisterBuffers(const struct iovec *iov, const unsigned int iov_cnt) {
+#ifdef IORING_FEAT_EXT_ARG
+      if (!use_uring_)
+        return true;
+      EXP_CHK_M(op_map_.empty(), return false, "operations are pending")
+      if (!fixed_buf_vec_.empty()) {
+        EXP_CHK_ERRNO(Register(IORING_UNREGISTER_BUFFERS, NULL, 0) != -1, return false)
+        fixed_buf_vec_.clear();
+      }
+      if (iov_cnt == 0)
+        return true;
+      EXP_CHK_ERRNO(Register(IORING_REGISTER_BUFFERS, iov, iov_cnt) != -1, return false)
+      fixed_buf_vec_.assign(iov, iov + iov_cnt);
+#else
+      (void)iov;
+      (void)iov_cnt;
+#endif
+      return true;
+    }
+
+    // Every operation calls back exactly once; buf has to stay valid until then. timeout_ms -1 waits forever.
+    bool Read(const int fd, void *buf, const size_t len, const Callback &callback, const int timeout_ms = -1) {
+      return Add(kRead, fd, buf, len, 0, callback, timeout_ms);
+    }
+
+    bool Write(const int fd, const void *buf, const size_t len, const Callback &callback, const int timeout_ms = -1) {
+      return Add(kWrite, fd, const_cast<void*>(buf), len, 0, callback, timeout_ms);
+    }
+
+    bool Recv(const int fd, void *buf, const size_t len, const int flags, const Callback &callback,
+              const int timeout_ms = -1) {
+      return Add(kRecv, fd, buf, len, flags, callback, timeout_ms);
+    }
+
+    bool Send(const int fd, const void *buf, const size_t len, const int flags, const Callback &callback,
+              const int timeout_ms = -1) {
+      return Add(kSend, fd, const_cast<void*>(buf), len, flags, callback, timeout_ms);
+    }
+
+    // Submits the new operations, waits up to timeout_ms (-1 forever) for at least one to complete and runs the
+    // callbacks of all that did. Returns the number of callbacks run, or -1 on error.
+    int Run(const int timeout_ms = -1) {
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      for (;;) {
+        HandleExpired();
+        int wait_ms = timeout_ms;
+        if (timeout_ms > 0) {
+          const int64_t elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+              std::chrono::steady_clock::now() - start).count();
+          wait_ms = static_cast<int>(std::max<int64_t>(timeout_ms - elapsed_ms, 0));
+        }
+        wait_ms = completion_vec_.empty() ? GetWaitMs(wait_ms) : 0;
+        if (completion_vec_.empty() && op_map_.empty())
+          return 0;
+#ifdef IORING_FEAT_EXT_ARG
+        if (use_uring_) {
+          if (WaitUring(wait_ms) == -1)
+            return -1;
+        } else if (WaitPoll(wait_ms) == -1) {
+          return -1;
+        }
+#else
+        if (WaitPoll(wait_ms) == -1)
+          return -1;
+#endif
+        HandleExpired();
+        if (!completion_vec_.empty()) {
+          std::vector<Completion> completion_vec;
+          completion_vec.swap(completion_vec_);  // callbacks can add operations
+          for (size_t i = 0; i < completion_vec.size(); ++i)
+            completion_vec[i].callback(completion_vec[i].result);
+          return static_cast<int>(completion_vec.size());
+        }
+        if (timeout_ms == 0 || (timeout_ms > 0 && std::chrono::steady_clock::now() - start >=
+                                                  std::chrono::milliseconds(timeout_ms)))
+          return 0;
+      }
+    }
+
+    size_t GetNumPending() const {
+      return op_map_.size();
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_IO_ENGINE_H__
@@ -0,0 +1,175 @@
+#include "mio/altro/io_engine.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+typedef std::chrono::steady_clock std_sc_t;
+
+const int kNumPipe = 100;
+
+
+// Runs the engine until num_callback callbacks ran, false on an error or 2 seconds without one
+static bool RunUntil(mio::IoEngine &io_engine, const int num_callback) {
+  for (int num_run = 0; num_run < num_callback;) {
+    const int num = io_engine.Run(2000);
+    if (num <= 0)
+      return false;
+    num_run += num;
+  }
+  return true;
+}
+
+
+// Many reads wait at once, half of them on fixed files; none completes before its pipe is written
+static bool TestPendingReads(mio::IoEngine &io_engine) {
+  int pipe_fd[kNumPipe][2];
+  char buf[kNumPipe][16];
+  int num_done = 0, num_byte = 0;
+  for (int i = 0; i < kNumPipe; ++i) {
+    EXP_CHK_ERRNO(pipe(pipe_fd[i]) == 0, return false)
+    if (i % 2 == 1) {
+      EXP_CHK(io_engine.RegisterFile(pipe_fd[i][0]), return false)
+    }
+    EXP_CHK(io_engine.Read(pipe_fd[i][0], buf[i], sizeof(buf[i]), [&](const int result) {
+      ++num_done;
+      num_byte += result;
+    }), return false)
+  }
+  EXP_CHK(io_engine.Run(10) == 0 && io_engine.GetNumPending() == kNumPipe, return false)
+  for (int i = 0; i < kNumPipe; ++i)
+    EXP_CHK(write(pipe_fd[i][1], "hello", 5) == 5, return false)
+  EXP_CHK(RunUntil(io_engine, kNumPipe), return false)
+  EXP_CHK(num_done == kNumPipe && num_byte == 5*kNumPipe, return false)
+  for (int i = 0; i < kNumPipe; ++i) {
+    EXP_CHK(io_engine.UnregisterFile(pipe_fd[i][0]), return false)
+    close(pipe_fd[i][0]);
+    close(pipe_fd[i][1]);
+  }
+  return true;
+}
+
+
+// A read on a blocking and on a non-blocking fd that nothing is written to
+static bool TestTimeout(mio::IoEngine &io_engine) {
+  for (int flags = 0; flags <= O_NONBLOCK; flags += O_NONBLOCK) {
+    int pipe_fd[2];
+    EXP_CHK_ERRNO(pipe2(pipe_fd, flags) == 0, return false)
+    char buf[16];
+    int read_result = 0;
+    const std_sc_t::time_point start = std_sc_t::now();
+    EXP_CHK(io_engine.Read(pipe_fd[0], buf, sizeof(buf), [&](const int result) { read_result = result; }, 50),
+            return false)
+    EXP_CHK(RunUntil(io_engine, 1), return false)
+    const std_sc_t::duration elapsed = std_sc_t::now() - start;
+    EXP_CHK(read_result == -ETIMEDOUT, return false)
+    EXP_CHK(elapsed >= std::chrono::milliseconds(50) && elapsed < std::chrono::milliseconds(1000), return false)
+    EXP_CHK(io_engine.GetNumPending() == 0, return false)
+    close(pipe_fd[0]);
+    close(pipe_fd[1]);
+  }
+  return true;
+}
+
+
+// A read on a non-blocking fd that is not ready yet fails with EAGAIN inside the engine and waits for the fd
+static bool TestNonBlocking(mio::IoEngine &io_engine) {
+  int pipe_fd[2];
+  EXP_CHK_ERRNO(pipe2(pipe_fd, O_NONBLOCK) == 0, return false)
+  char buf[16];
+  int read_result = 0;
+  EXP_CHK(io_engine.Read(pipe_fd[0], buf, sizeof(buf), [&](const int result) { read_result = result; }),
+          return false)
+  EXP_CHK(io_engine.Run(20) == 0 && io_engine.GetNumPending() == 1, return false)
+  EXP_CHK(write(pipe_fd[1], "abc", 3) == 3, return false)
+  EXP_CHK(RunUntil(io_engine, 1), return false)
+  EXP_CHK(read_result == 3 && memcmp(buf, "abc", 3) == 0, return false)
+  close(pipe_fd[0]);
+  close(pipe_fd[1]);
+  return true;
+}
+
+
+// Read()/Write() in registered buffers, Send()/Recv(), end of stream and a bad fd
+static bool TestTransfers(mio::IoEngine &io_engine) {
+  static char fixed_buf[2][4096];
+  struct iovec iov[2] = {{fixed_buf[0], sizeof(fixed_buf[0])}, {fixed_buf[1], sizeof(fixed_buf[1])}};
+  EXP_CHK(io_engine.RegisterBuffers(iov, 2), return false)
+  int sock_fd[2];
+  EXP_CHK_ERRNO(socketpair(AF_UNIX, SOCK_STREAM, 0, sock_fd) == 0, return false)
+
+  int read_result = 0, write_result = 0;
+  strcpy(fixed_buf[1], "fixed-write");
+  EXP_CHK(io_engine.Read(sock_fd[0], fixed_buf[0], sizeof(fixed_buf[0]),
+                         [&](const int result) { read_result = result; }), return false)
+  EXP_CHK(io_engine.Write(sock_fd[1], fixed_buf[1], 11, [&](const int result) { write_result = result; }),
+          return false)
+  EXP_CHK(RunUntil(io_engine, 2), return false)
+  EXP_CHK(write_result == 11 && read_result == 11 && memcmp(fixed_buf[0], "fixed-write", 11) == 0, return false)
+
+  char buf[32];
+  int recv_result = 0, send_result = 0;
+  EXP_CHK(io_engine.Recv(sock_fd[1], buf, sizeof(buf), 0, [&](const int result) { recv_result = result; }),
+          return false)
+  EXP_CHK(io_engine.Send(sock_fd[0], "send-recv", 9, 0, [&](const int result) { send_result = result; }),
+          return false)
+  EXP_CHK(RunUntil(io_engine, 2), return false)
+  EXP_CHK(send_result == 9 && recv_result == 9 && memcmp(buf, "send-recv", 9) == 0, return false)
+
+  close(sock_fd[0]);
+  EXP_CHK(io_engine.Recv(sock_fd[1], buf, sizeof(buf), 0, [&](const int result) { recv_result = result; }),
+          return false)
+  EXP_CHK(RunUntil(io_engine, 1) && recv_result == 0, return false)
+  close(sock_fd[1]);
+
+  int bad_fd_result = 0;
+  EXP_CHK(io_engine.Read(sock_fd[1], buf, sizeof(buf), [&](const int result) { bad_fd_result = result; }),
+          return false)
+  EXP_CHK(RunUntil(io_engine, 1) && bad_fd_result == -EBADF, return false)
+  EXP_CHK(io_engine.RegisterBuffers(NULL, 0), return false)
+  return true;
+}
+
+
+// A callback that queues the next read, the way a reader stays armed
+static bool TestRearm(mio::IoEngine &io_engine) {
+  const int kNumRead = 10000;
+  int pipe_fd[2];
+  EXP_CHK_ERRNO(pipe(pipe_fd) == 0, return false)
+  char buf[8];
+  int num_read = 0;
+  std::function<void(int)> on_read = [&](const int result) {
+    if (result == 1 && ++num_read < kNumRead) {
+      EXP_CHK(write(pipe_fd[1], "x", 1) == 1, return)
+      io_engine.Read(pipe_fd[0], buf, sizeof(buf), on_read);
+    }
+  };
+  EXP_CHK(write(pipe_fd[1], "x", 1) == 1, return false)
+  EXP_CHK(io_engine.Read(pipe_fd[0], buf, sizeof(buf), on_read), return false)
+  EXP_CHK(RunUntil(io_engine, kNumRead) && num_read == kNumRead, return false)
+  EXP_CHK(io_engine.GetNumPending() == 0, return false)
+  close(pipe_fd[0]);
+  close(pipe_fd[1]);
+  return true;
+}
+
+
+// Runs every test on io_uring (where the kernel has it) and on the poll() fallback
+int main() {
+  for (int use_uring = 1; use_uring >= 0; --use_uring) {
+    mio::IoEngine io_engine(256, use_uring == 1);
+    const std::string backend = io_engine.IsUring() ? "io_uring" : "poll()";
+    EXP_CHK_M(TestPendingReads(io_engine), return -1, backend)
+    EXP_CHK_M(TestTimeout(io_engine), return -1, backend)
+    EXP_CHK_M(TestNonBlocking(io_engine), return -1, backend)
+    EXP_CHK_M(TestTransfers(io_engine), return -1, backend)
+    EXP_CHK_M(TestRearm(io_engine), return -1, backend)
+    std::cout << backend << ": passed\n";
+  }
+  return 0;
+}
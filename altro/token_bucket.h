@@ -0,0 +1,67 @@
+#ifndef __MIO_TOKEN_BUCKET_H__
+#define __MIO_TOKEN_BUCKET_H__
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace mio{
+
+/*
+Token bucket rate limiter, eg. to pace datagrams so a burst does not overflow
+the receivers' socket buffers. Tokens (usually bytes) refill at rate per second
+up to burst. Take() sleeps until the tokens are there; a request larger than
+burst is let through once the bucket is full, so it can not block forever.
+A rate of 0 disables pacing.
+*/
+class TokenBucket{
+  typedef std::chrono::steady_clock std_sc_t;
+
+  double rate_, burst_, num_token_;
+  std_sc_t::time_point refill_time_;
+
+  void Refill(){
+    const std_sc_t::time_point now = std_sc_t::now();
+    num_token_ = std::min(burst_, num_token_ + rate_*std::chrono::duration<double>(now - refill_time_).count());
+    refill_time_ = now;
+  }
+
+  public:
+    TokenBucket(const double rate = 0, const double burst = 0){
+      SetRate(rate, burst);
+    }
+
+    // Starts out with a full bucket
+    void SetRate(const double rate, const double burst){
+      rate_ = std::max(0.0, rate);
+      burst_ = std::max(0.0, burst);
+      num_token_ = burst_;
+      refill_time_ = std_sc_t::now();
+    }
+
+    bool TryTake(const double num_token){
+      if(rate_ == 0)
+        return true;
+      Refill();
+      const double needed = std::min(num_token, burst_);
+      if(num_token_ < needed)
+        return false;
+      num_token_ -= num_token;
+      return true;
+    }
+
+    void Take(const double num_token){
+      if(rate_ == 0)
+        return;
+      Refill();
+      const double needed = std::min(num_token, burst_);
+      if(num_token_ < needed)
+        std::this_thread::sleep_for( std::chrono::duration<double>((needed - num_token_) / rate_) );
+      Refill();
+      num_token_ -= num_token; // may go negative for a request larger than burst
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_TOKEN_BUCKET_H__
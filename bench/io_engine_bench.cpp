@@ -0,0 +1,114 @@
+#include "mio/altro/io_engine.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <vector>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// Keeps one read armed on each of num_fd pipes and, num_round times, writes
+// a byte to every pipe and runs the mio::IoEngine until all the reads
+// completed; each callback queues the next read on its pipe. Reports the time
+// per completed read, the write included, for the io_uring and the poll()
+// backend. The first 64 pipes are fixed files under io_uring.
+//
+// Usage: io_engine_bench [num rounds] [num fds]
+// Without a number of fds it runs 16, 256 and 1000.
+
+typedef std::chrono::steady_clock std_sc_t;
+
+const size_t kNumFixedFile = 64;
+
+
+// Both ends of num_fd pipes, closed with the set
+struct PipeSet {
+  std::vector<int> read_fd_vec, write_fd_vec;
+
+  ~PipeSet() {
+    for (const int fd : read_fd_vec)
+      close(fd);
+    for (const int fd : write_fd_vec)
+      close(fd);
+  }
+
+  bool Init(const size_t num_fd) {
+    for (size_t i = 0; i < num_fd; ++i) {
+      int pipe_fd[2];
+      EXP_CHK_ERRNO(pipe(pipe_fd) == 0, return false)
+      read_fd_vec.push_back(pipe_fd[0]);
+      write_fd_vec.push_back(pipe_fd[1]);
+    }
+    return true;
+  }
+};
+
+
+// Returns the microseconds per read, or -1
+static double Run(const bool use_uring, const size_t num_fd, const size_t num_round, bool &is_uring) {
+  PipeSet pipe_set;
+  EXP_CHK(pipe_set.Init(num_fd), return -1)
+  mio::IoEngine io_engine(4*num_fd, use_uring);
+  is_uring = io_engine.IsUring();
+  std::vector<char> buf(8*num_fd);
+  std::vector< std::function<void(int)> > on_read_vec(num_fd);
+  size_t num_read = 0;
+  for (size_t i = 0; i < num_fd; ++i) {
+    const int read_fd = pipe_set.read_fd_vec[i];
+    if (i < kNumFixedFile) {
+      EXP_CHK(io_engine.RegisterFile(read_fd), return -1)
+    }
+    on_read_vec[i] = [&, i, read_fd](const int result) {
+      if (result == 1)
+        ++num_read;
+      io_engine.Read(read_fd, &buf[8*i], 8, on_read_vec[i]);
+    };
+    EXP_CHK(io_engine.Read(read_fd, &buf[8*i], 8, on_read_vec[i]), return -1)
+  }
+  io_engine.Run(0);  // submits the first reads
+
+  const std_sc_t::time_point start = std_sc_t::now();
+  for (size_t round = 1; round <= num_round; ++round) {
+    for (size_t i = 0; i < num_fd; ++i)
+      EXP_CHK_ERRNO(write(pipe_set.write_fd_vec[i], "x", 1) == 1, return -1)
+    while (num_read < round*num_fd)
+      EXP_CHK(io_engine.Run(1000) > 0, return -1)
+  }
+  return std::chrono::duration<double, std::micro>(std_sc_t::now() - start).count() / (num_round*num_fd);
+}
+
+
+static void Report(const bool use_uring, const size_t num_fd, const size_t num_round) {
+  bool is_uring;
+  const double us_per_read = Run(use_uring, num_fd, num_round, is_uring);
+  if (use_uring && !is_uring) {
+    std::cout << std::left << std::setw(10) << "io_uring" << "unavailable\n";
+    return;
+  }
+  std::cout << std::left << std::setw(10) << (is_uring ? "io_uring" : "poll()") << std::right << std::fixed
+            << std::setprecision(3) << std::setw(8) << us_per_read << " us/read\n";
+}
+
+
+int main(int argc, char *argv[]) {
+  const size_t num_round = (argc > 1) ? std::max(atoi(argv[1]), 1) : 2000;
+  std::vector<size_t> num_fd_vec = {16, 256, 1000};
+  if (argc > 2)
+    num_fd_vec = {static_cast<size_t>(std::max(atoi(argv[2]), 1))};
+
+  // Two fds per pipe, the default soft limit is often 1024
+  struct rlimit limit;
+  if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+  }
+
+  for (const size_t num_fd : num_fd_vec) {
+    std::cout << num_fd << " pipes, " << num_round << " rounds\n";
+    Report(true, num_fd, num_round);
+    Report(false, num_fd, num_round);
+  }
+  return 0;
+}
@@ -0,0 +1,547 @@
+#include "mio/ipc/shared_mem.h"
+#include "mio/ipc/sem.h"
+#include "mio/socket/socket.h"
+#ifdef MIO_BENCH_LCM
+#include <lcm/lcm.h>
+#include "mio/lcm/lcm_opencv_mat_t.h"
+#include "mio/lcm/lcm_int_t.h"
+#endif
+#include <netinet/tcp.h>  // TCP_NODELAY
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// Moves the same payload from one producer process to one or more consumer
+// processes over each transport and reports the one-way latency percentiles,
+// throughput and CPU time per message. One message is in flight at a time:
+// the producer stamps CLOCK_MONOTONIC (steady_clock) into the first 8 bytes of
+// the payload, every consumer copies the whole payload out of the transport,
+// takes its latency sample and acks, and only then is the next message sent.
+// Throughput is therefore the synchronous (ping-pong) rate, not a streaming one.
+//
+// Usage: ipc_bench [max consumers] [max payload bytes] [all|shm|tcp|lcm]
+// Consumer counts sweep 1, 2, 4, ... up to max consumers. The lcm transport
+// needs a multicast route on lo, see mio/lcm/udp_multicast_setup.sh
+
+typedef std::chrono::steady_clock std_sc_t;
+
+const char kShmName[] = "/mio_ipc_bench";
+const char kReadySemPrefix[] = "/mio_ipc_bench_ready_";
+const char kAckSemName[] = "/mio_ipc_bench_ack";
+const int kTcpBasePort = 47300;
+const char kLcmChannel[] = "IPC_BENCH";
+const char kLcmAckChannel[] = "IPC_BENCH_ACK";
+const size_t kNumWarmup = 5;
+const size_t kMaxBenchBytes = 256*1024*1024;  // bytes per run, sets the message count
+
+
+enum class Transport { kShm, kTcp, kLcm };
+
+struct RunParams {
+  Transport transport;
+  size_t num_consumer, payload_size, num_msg;
+};
+
+// Written by each child to its result pipe when it is done
+struct ChildResult {
+  int64_t cpu_ns, elapsed_ns;
+  uint64_t num_sample;  // followed by num_sample int64_t latencies in ns
+};
+
+
+static int64_t NowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(std_sc_t::now().time_since_epoch()).count();
+}
+
+
+static int64_t CpuNs() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000000LL +
+         (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1000LL;
+}
+
+
+static bool WriteAll(const int fd, const void *buf, size_t len) {
+  const uint8_t *ptr = static_cast<const uint8_t*>(buf);
+  while (len > 0) {
+    const ssize_t n = write(fd, ptr, len);
+    if (n == -1 && errno == EINTR)
+      continue;
+    EXP_CHK_ERRNO(n > 0, return false)
+    ptr += n;
+    len -= n;
+  }
+  return true;
+}
+
+
+static bool ReadAll(const int fd, void *buf, size_t len) {
+  uint8_t *ptr = static_cast<uint8_t*>(buf);
+  while (len > 0) {
+    const ssize_t n = read(fd, ptr, len);
+    if (n == -1 && errno == EINTR)
+      continue;
+    EXP_CHK_ERRNO(n > 0, return false)
+    ptr += n;
+    len -= n;
+  }
+  return true;
+}
+
+
+// Runs on the consumer side after each payload has been copied out
+class LatencyRecorder {
+  size_t num_recv_;
+  int64_t cpu_start_ns_;
+  std::vector<int64_t> latency_ns_;
+
+ public:
+  explicit LatencyRecorder(const size_t num_msg) : num_recv_(0), cpu_start_ns_(CpuNs()) {
+    latency_ns_.reserve(num_msg);
+  }
+
+  void Add(const uint8_t *payload) {
+    const int64_t recv_ns = NowNs();
+    int64_t send_ns;
+    memcpy(&send_ns, payload, sizeof(send_ns));
+    if (++num_recv_ == kNumWarmup)
+      cpu_start_ns_ = CpuNs();
+    else if (num_recv_ > kNumWarmup)
+      latency_ns_.push_back(recv_ns - send_ns);
+  }
+
+  size_t GetNumRecv() const {
+    return num_recv_;
+  }
+
+  bool WriteResult(const int fd) const {
+    ChildResult result;
+    result.cpu_ns = CpuNs() - cpu_start_ns_;
+    result.elapsed_ns = 0;
+    result.num_sample = latency_ns_.size();
+    EXP_CHK(WriteAll(fd, &result, sizeof(result)), return false)
+    return WriteAll(fd, latency_ns_.data(), latency_ns_.size()*sizeof(int64_t));
+  }
+};
+
+
+// Producer side timing, started once the warmup messages are through
+class ProducerTimer {
+  int64_t start_ns_, cpu_start_ns_;
+
+ public:
+  ProducerTimer() : start_ns_(NowNs()), cpu_start_ns_(CpuNs()) {}
+
+  void Start() {
+    start_ns_ = NowNs();
+    cpu_start_ns_ = CpuNs();
+  }
+
+  bool WriteResult(const int fd) const {
+    ChildResult result;
+    result.cpu_ns = CpuNs() - cpu_start_ns_;
+    result.elapsed_ns = NowNs() - start_ns_;
+    result.num_sample = 0;
+    return WriteAll(fd, &result, sizeof(result));
+  }
+};
+
+
+// shm: one segment holds the payload, a ready semaphore per consumer announces
+// it and a single ack semaphore collects one post per consumer
+static bool ShmConsumer(const RunParams &params, const size_t idx, const int ready_fd, const int result_fd) {
+  mio::SharedMemory<uint8_t> shm;
+  mio::Semaphore ready_sem, ack_sem;
+  EXP_CHK(shm.Init(kShmName, params.payload_size, false), return false)
+  EXP_CHK(ready_sem.Init(kReadySemPrefix + std::to_string(idx), 0, false), return false)
+  EXP_CHK(ack_sem.Init(kAckSemName, 0, false), return false)
+  std::vector<uint8_t> payload(params.payload_size);
+  LatencyRecorder recorder(params.num_msg);
+  const char ready = 1;
+  EXP_CHK(WriteAll(ready_fd, &ready, 1), return false)
+
+  for (size_t i = 0; i < kNumWarmup + params.num_msg; ++i) {
+    EXP_CHK(ready_sem.Wait(), return false)
+    memcpy(payload.data(), shm.shm_addr_, params.payload_size);
+    recorder.Add(payload.data());
+    EXP_CHK(ack_sem.Post(), return false)
+  }
+  return recorder.WriteResult(result_fd);
+}
+
+
+static bool ShmProducer(const RunParams &params, const int ready_fd, const int result_fd) {
+  mio::SharedMemory<uint8_t> shm;
+  std::vector< std::unique_ptr<mio::Semaphore> > ready_sem_vec;
+  mio::Semaphore ack_sem;
+  EXP_CHK(shm.Init(kShmName, params.payload_size, false), return false)
+  for (size_t i = 0; i < params.num_consumer; ++i) {
+    ready_sem_vec.emplace_back(new mio::Semaphore);
+    EXP_CHK(ready_sem_vec.back()->Init(kReadySemPrefix + std::to_string(i), 0, false), return false)
+  }
+  EXP_CHK(ack_sem.Init(kAckSemName, 0, false), return false)
+  std::vector<uint8_t> payload(params.payload_size, 0x5a);
+  std::vector<char> ready(params.num_consumer);
+  EXP_CHK(ReadAll(ready_fd, ready.data(), ready.size()), return false)
+
+  ProducerTimer timer;
+  for (size_t i = 0; i < kNumWarmup + params.num_msg; ++i) {
+    if (i == kNumWarmup)
+      timer.Start();
+    const int64_t send_ns = NowNs();
+    memcpy(payload.data(), &send_ns, sizeof(send_ns));
+    memcpy(shm.shm_addr_, payload.data(), params.payload_size);
+    for (auto &ready_sem : ready_sem_vec)
+      EXP_CHK(ready_sem->Post(), return false)
+    for (size_t j = 0; j < params.num_consumer; ++j)
+      EXP_CHK(ack_sem.Wait(), return false)
+  }
+  return timer.WriteResult(result_fd);
+}
+
+
+// tcp: each consumer is a CServerTCP on kTcpBasePort + its index, the producer
+// holds a CClientTCP per consumer and sends the payload to each in turn
+static bool TcpConsumer(const RunParams &params, const size_t idx, const int ready_fd, const int result_fd) {
+  mio::CServerTCP server;
+  EXP_CHK(server.Init("127.0.0.1", std::to_string(kTcpBasePort + idx)) == 0, return false)
+  std::vector<uint8_t> payload(params.payload_size);
+  LatencyRecorder recorder(params.num_msg);
+  const char ready = 1;
+  EXP_CHK(WriteAll(ready_fd, &ready, 1), return false)
+  EXP_CHK(server.ListenAccept() == 0, return false)
+  const int flag = 1;
+  setsockopt(server.accept_sock_fd(), IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+  for (size_t i = 0; i < kNumWarmup + params.num_msg; ++i) {
+    EXP_CHK(server.RecvFromClientAdv(payload.data(), params.payload_size) > 0, return false)
+    recorder.Add(payload.data());
+    const uint8_t ack = 1;
+    EXP_CHK(server.SendToClientAdv(&ack, 1) == 1, return false)
+  }
+  return recorder.WriteResult(result_fd);
+}
+
+
+static bool TcpProducer(const RunParams &params, const int ready_fd, const int result_fd) {
+  std::vector<char> ready(params.num_consumer);
+  EXP_CHK(ReadAll(ready_fd, ready.data(), ready.size()), return false)
+  // The consumer signals ready just before it listens, so retry briefly
+  std::vector< std::unique_ptr<mio::CClientTCP> > client_vec;
+  for (size_t i = 0; i < params.num_consumer; ++i) {
+    for (int attempt = 0; ; ++attempt) {
+      std::unique_ptr<mio::CClientTCP> client(new mio::CClientTCP);
+      if (client->Init("127.0.0.1", std::to_string(kTcpBasePort + i)) == 0) {
+        const int flag = 1;
+        setsockopt(client->server_sock_fd(), IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+        client_vec.push_back(std::move(client));
+        break;
+      }
+      EXP_CHK(attempt < 100, return false)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+  }
+  std::vector<uint8_t> payload(params.payload_size, 0x5a);
+
+  ProducerTimer timer;
+  for (size_t i = 0; i < kNumWarmup + params.num_msg; ++i) {
+    if (i == kNumWarmup)
+      timer.Start();
+    const int64_t send_ns = NowNs();
+    memcpy(payload.data(), &send_ns, sizeof(send_ns));
+    for (auto &client : client_vec)
+      EXP_CHK(mio::SendTo(client->server_sock_fd(), payload.data(), params.payload_size) ==
+              static_cast<int>(params.payload_size), return false)
+    for (auto &client : client_vec) {
+      uint8_t ack;
+      EXP_CHK(mio::RecvFrom(client->server_sock_fd(), &ack, 1) == 1, return false)
+    }
+  }
+  return timer.WriteResult(result_fd);
+}
+
+
+#ifdef MIO_BENCH_LCM
+// lcm: the payload is the data of an lcm_opencv_mat_t, consumers ack with an
+// lcm_int_t holding the message index. UDP multicast can drop messages, so
+// neither side waits forever: a missing ack or message costs kLcmTimeoutMs and
+// is reported as lost. The producer gives up on the run after
+// kLcmMaxConsecutiveTimeout messages in a row go unanswered, eg. when the
+// payload is larger than the LCM provider accepts.
+const int kLcmTimeoutMs = 1000;
+const int kLcmMaxConsecutiveTimeout = 3;
+
+struct LcmConsumerState {
+  lcm_t *lcm;
+  LatencyRecorder *recorder;
+};
+
+
+static void LcmMatHandler(const lcm_recv_buf_t *rbuf, const char *channel,
+                          const lcm_opencv_mat_t *msg, void *userdata) {
+  LcmConsumerState *state = static_cast<LcmConsumerState*>(userdata);
+  state->recorder->Add(reinterpret_cast<const uint8_t*>(msg->data));
+  lcm_int_t ack;
+  ack.val = msg->index;
+  lcm_int_t_publish(state->lcm, kLcmAckChannel, &ack);
+}
+
+
+static bool LcmConsumer(const RunParams &params, const size_t idx, const int ready_fd, const int result_fd) {
+  lcm_t *lcm = lcm_create(NULL);
+  EXP_CHK_M(lcm != NULL, return false, "lcm_create() error")
+  LatencyRecorder recorder(params.num_msg);
+  LcmConsumerState state = {lcm, &recorder};
+  lcm_opencv_mat_t_subscription_t *sub = lcm_opencv_mat_t_subscribe(lcm, kLcmChannel, &LcmMatHandler, &state);
+  const char ready = 1;
+  EXP_CHK(WriteAll(ready_fd, &ready, 1), return false)
+
+  while (recorder.GetNumRecv() < kNumWarmup + params.num_msg)
+    if (lcm_handle_timeout(lcm, kLcmTimeoutMs) <= 0)
+      break;
+  lcm_opencv_mat_t_unsubscribe(lcm, sub);
+  lcm_destroy(lcm);
+  return recorder.WriteResult(result_fd);
+}
+
+
+struct LcmProducerState {
+  int32_t index;
+  size_t num_ack;
+};
+
+
+static void LcmAckHandler(const lcm_recv_buf_t *rbuf, const char *channel,
+                          const lcm_int_t *msg, void *userdata) {
+  LcmProducerState *state = static_cast<LcmProducerState*>(userdata);
+  if (msg->val == state->index)  // a late ack for an earlier message does not count
+    ++state->num_ack;
+}
+
+
+static bool LcmProducer(const RunParams &params, const int ready_fd, const int result_fd) {
+  lcm_t *lcm = lcm_create(NULL);
+  EXP_CHK_M(lcm != NULL, return false, "lcm_create() error")
+  LcmProducerState state = {0, 0};
+  lcm_int_t_subscription_t *sub = lcm_int_t_subscribe(lcm, kLcmAckChannel, &LcmAckHandler, &state);
+  std::vector<uint8_t> payload(params.payload_size, 0x5a);
+  lcm_opencv_mat_t msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.rows = 1;
+  msg.cols = msg.length = params.payload_size;
+  msg.channels = 1;
+  msg.data = reinterpret_cast<int8_t*>(payload.data());
+  std::vector<char> ready(params.num_consumer);
+  EXP_CHK(ReadAll(ready_fd, ready.data(), ready.size()), return false)
+
+  ProducerTimer timer;
+  int num_consecutive_timeout = 0;
+  for (size_t i = 0; i < kNumWarmup + params.num_msg && num_consecutive_timeout < kLcmMaxConsecutiveTimeout; ++i) {
+    if (i == kNumWarmup)
+      timer.Start();
+    state.index = msg.index = i;
+    state.num_ack = 0;
+    const int64_t send_ns = NowNs();
+    memcpy(payload.data(), &send_ns, sizeof(send_ns));
+    lcm_opencv_mat_t_publish(lcm, kLcmChannel, &msg);
+    while (state.num_ack < params.num_consumer)
+      if (lcm_handle_timeout(lcm, kLcmTimeoutMs) <= 0)
+        break;
+    num_consecutive_timeout = (state.num_ack < params.num_consumer) ? num_consecutive_timeout + 1 : 0;
+  }
+  const bool success = timer.WriteResult(result_fd);
+  lcm_int_t_unsubscribe(lcm, sub);
+  lcm_destroy(lcm);
+  return success;
+}
+#endif
+
+
+static const char *TransportName(const Transport transport) {
+  switch (transport) {
+    case Transport::kShm: return "shm+sem";
+    case Transport::kTcp: return "tcp";
+    case Transport::kLcm: return "lcm";
+  }
+  return "";
+}
+
+
+static bool RunConsumer(const RunParams &params, const size_t idx, const int ready_fd, const int result_fd) {
+  switch (params.transport) {
+    case Transport::kShm: return ShmConsumer(params, idx, ready_fd, result_fd);
+    case Transport::kTcp: return TcpConsumer(params, idx, ready_fd, result_fd);
+#ifdef MIO_BENCH_LCM
+    case Transport::kLcm: return LcmConsumer(params, idx, ready_fd, result_fd);
+#endif
+    default: return false;
+  }
+}
+
+
+static bool RunProducer(const RunParams &params, const int ready_fd, const int result_fd) {
+  switch (params.transport) {
+    case Transport::kShm: return ShmProducer(params, ready_fd, result_fd);
+    case Transport::kTcp: return TcpProducer(params, ready_fd, result_fd);
+#ifdef MIO_BENCH_LCM
+    case Transport::kLcm: return LcmProducer(params, ready_fd, result_fd);
+#endif
+    default: return false;
+  }
+}
+
+
+// Forks a child that runs func with the write end of a fresh result pipe and
+// appends the read end to result_fd_vec. The children's own chatter (eg. the
+// socket classes' connection messages) goes to /dev/null, errors still reach stderr.
+template <typename FUNC_T>
+static bool ForkChild(const FUNC_T &func, std::vector<pid_t> &pid_vec, std::vector<int> &result_fd_vec) {
+  int result_pipe[2];
+  EXP_CHK_ERRNO(pipe(result_pipe) == 0, return false)
+  std::cout.flush();
+  const pid_t pid = fork();
+  EXP_CHK_ERRNO(pid != -1, return false)
+  if (pid == 0) {
+    close(result_pipe[0]);
+    for (const int fd : result_fd_vec)
+      close(fd);
+    const int null_fd = open("/dev/null", O_WRONLY);
+    dup2(null_fd, STDOUT_FILENO);
+    _exit(func(result_pipe[1]) ? 0 : 1);
+  }
+  close(result_pipe[1]);
+  result_fd_vec.push_back(result_pipe[0]);
+  pid_vec.push_back(pid);
+  return true;
+}
+
+
+static int64_t Percentile(const std::vector<int64_t> &sorted_ns, const double p) {
+  if (sorted_ns.empty())
+    return 0;
+  const size_t idx = std::min(sorted_ns.size() - 1, static_cast<size_t>(p * sorted_ns.size()));
+  return sorted_ns[idx];
+}
+
+
+static bool Run(const RunParams &params) {
+  // The producer creates nothing, named objects are made here so every child can open them
+  mio::SharedMemory<uint8_t> shm;
+  std::vector< std::unique_ptr<mio::Semaphore> > sem_vec;
+  if (params.transport == Transport::kShm) {
+    mio::SharedMemory<uint8_t>::Unlink(kShmName);
+    EXP_CHK(shm.Init(kShmName, params.payload_size, true, true), return false)
+    for (size_t i = 0; i <= params.num_consumer; ++i) {
+      const std::string sem_name = (i < params.num_consumer) ? kReadySemPrefix + std::to_string(i) : kAckSemName;
+      sem_unlink(sem_name.c_str());
+      sem_vec.emplace_back(new mio::Semaphore);
+      EXP_CHK(sem_vec.back()->Init(sem_name, 0, true, true), return false)
+    }
+  }
+
+  int ready_pipe[2];
+  EXP_CHK_ERRNO(pipe(ready_pipe) == 0, return false)
+  std::vector<pid_t> pid_vec;
+  std::vector<int> result_fd_vec;  // consumers first, then the producer
+  bool success = true;
+  for (size_t i = 0; i < params.num_consumer && success; ++i)
+    success = ForkChild([&](const int result_fd) {
+      close(ready_pipe[0]);
+      return RunConsumer(params, i, ready_pipe[1], result_fd);
+    }, pid_vec, result_fd_vec);
+  success = success && ForkChild([&](const int result_fd) {
+    close(ready_pipe[1]);
+    return RunProducer(params, ready_pipe[0], result_fd);
+  }, pid_vec, result_fd_vec);
+  close(ready_pipe[0]);
+  close(ready_pipe[1]);
+
+  // Children block on a full pipe until it is read, so read in order before waiting
+  std::vector<int64_t> latency_ns;
+  int64_t cpu_ns = 0, elapsed_ns = 0;
+  size_t num_lost = 0;
+  for (size_t i = 0; i < result_fd_vec.size(); ++i) {
+    ChildResult result;
+    if (ReadAll(result_fd_vec[i], &result, sizeof(result))) {
+      const size_t num_prev = latency_ns.size();
+      latency_ns.resize(num_prev + result.num_sample);
+      success &= ReadAll(result_fd_vec[i], latency_ns.data() + num_prev, result.num_sample*sizeof(int64_t));
+      cpu_ns += result.cpu_ns;
+      elapsed_ns = std::max(elapsed_ns, result.elapsed_ns);
+      if (i < params.num_consumer)
+        num_lost += params.num_msg - result.num_sample;
+    }
+    else
+      success = false;
+    close(result_fd_vec[i]);
+  }
+  for (const pid_t pid : pid_vec) {
+    int status;
+    waitpid(pid, &status, 0);
+    success &= WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  }
+  EXP_CHK_M(success, return false, std::string(TransportName(params.transport)) + " run failed")
+
+  std::sort(latency_ns.begin(), latency_ns.end());
+  const double elapsed_sec = std::max(elapsed_ns, int64_t(1)) * 1e-9;
+  std::cout << std::left << std::setw(10) << TransportName(params.transport) << std::right
+            << std::setw(5) << params.num_consumer << std::setw(11) << params.payload_size
+            << std::setw(8) << params.num_msg << std::fixed << std::setprecision(1)
+            << std::setw(11) << Percentile(latency_ns, 0.5)*1e-3 << std::setw(11) << Percentile(latency_ns, 0.99)*1e-3
+            << std::setw(11) << Percentile(latency_ns, 0.999)*1e-3
+            << std::setw(11) << params.payload_size*latency_ns.size()/params.num_consumer/elapsed_sec/1e6
+            << std::setw(11) << cpu_ns*1e-3/params.num_msg << std::setw(6) << num_lost << "\n";
+  return true;
+}
+
+
+int main(int argc, char *argv[]) {
+  const size_t kMaxConsumer = (argc > 1) ? std::max(atoi(argv[1]), 1) : 1;
+  const size_t kMaxPayload = (argc > 2) ? std::max(atol(argv[2]), 8L) : 32*1024*1024;
+  const std::string kTransportArg = (argc > 3) ? argv[3] : "all";
+
+  std::vector<Transport> transport_vec;
+  if (kTransportArg == "all" || kTransportArg == "shm")
+    transport_vec.push_back(Transport::kShm);
+  if (kTransportArg == "all" || kTransportArg == "tcp")
+    transport_vec.push_back(Transport::kTcp);
+#ifdef MIO_BENCH_LCM
+  if (kTransportArg == "all" || kTransportArg == "lcm")
+    transport_vec.push_back(Transport::kLcm);
+#else
+  if (kTransportArg == "lcm")
+    std::cerr << "ipc_bench was built without LCM\n";
+#endif
+  EXP_CHK_M(!transport_vec.empty(), return -1, "unknown transport " + kTransportArg)
+
+  // 8 B, 64 B, 512 B, ... in steps of 8x, then kMaxPayload itself
+  std::vector<size_t> payload_size_vec;
+  for (size_t size = 8; size < kMaxPayload; size *= 8)
+    payload_size_vec.push_back(size);
+  payload_size_vec.push_back(kMaxPayload);
+
+  std::cout << "latency in us (one-way), throughput in MB/s per consumer, "
+               "cpu in us per message summed over all processes\n"
+            << std::left << std::setw(10) << "transport" << std::right << std::setw(5) << "cons"
+            << std::setw(11) << "bytes" << std::setw(8) << "msgs" << std::setw(11) << "p50"
+            << std::setw(11) << "p99" << std::setw(11) << "p99.9" << std::setw(11) << "MB/s"
+            << std::setw(11) << "cpu/msg" << std::setw(6) << "lost" << "\n";
+  for (const Transport transport : transport_vec)
+    for (size_t num_consumer = 1; num_consumer <= kMaxConsumer; num_consumer *= 2)
+      for (const size_t payload_size : payload_size_vec) {
+        RunParams params;
+        params.transport = transport;
+        params.num_consumer = num_consumer;
+        params.payload_size = payload_size;
+        params.num_msg = std::max(size_t(50), std::min(size_t(10000), kMaxBenchBytes / payload_size));
+        Run(params);
+      }
+
+  return 0;
+}
@@ -0,0 +1,151 @@
+#include "mio/lcm/lcm_opencv_mat_codec.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// Encodes and decodes frames with every lcm_opencv_mat_t codec that supports
+// their type and reports the message size and the encode/decode time per
+// frame. The frames are synthetic (16 bit thermal, 8 bit mono and an 8 bit
+// mask) unless image files are given, which are read with cv::IMREAD_UNCHANGED.
+//
+// Usage: lcm_codec_bench [num frames] [image file ...]
+
+typedef std::chrono::steady_clock std_sc_t;
+
+struct BenchFrame {
+  std::string name;
+  cv::Mat img;
+};
+
+
+// Smooth scene with sensor noise, like a thermal or mono camera
+template <typename T>
+static cv::Mat MakeScene(const int rows, const int cols, const int type, const double amplitude,
+                         const double noise, std::mt19937 &rng) {
+  cv::Mat img(rows, cols, type);
+  std::normal_distribution<double> noise_dist(0, noise);
+  for (int r = 0; r < rows; ++r) {
+    T *row = img.ptr<T>(r);
+    for (int c = 0; c < cols; ++c) {
+      const double v = amplitude * (0.5 + 0.25*std::sin(c * 0.01) + 0.2*std::cos(r * 0.013 + c * 0.004));
+      row[c] = static_cast<T>(std::max(0.0, std::min(amplitude, v + noise_dist(rng))));
+    }
+  }
+  return img;
+}
+
+
+// A few filled rectangles, like a segmentation mask
+static cv::Mat MakeMask(const int rows, const int cols, std::mt19937 &rng) {
+  cv::Mat img(rows, cols, CV_8UC1);
+  memset(img.data, 0, img.total());
+  std::uniform_int_distribution<int> row_dist(0, rows - 1), col_dist(0, cols - 1);
+  for (int i = 0; i < 20; ++i) {
+    const int r0 = row_dist(rng), c0 = col_dist(rng);
+    const int r1 = std::min(rows, r0 + rows/8), c1 = std::min(cols, c0 + cols/8);
+    for (int r = r0; r < r1; ++r)
+      memset(img.ptr(r) + c0, 255, c1 - c0);
+  }
+  return img;
+}
+
+
+static bool CodecSupports(const mio::LcmImageCodec codec, const cv::Mat &img) {
+  if (codec == mio::kLcmImageJpeg)
+    return img.depth() == CV_8U && (img.channels() == 1 || img.channels() == 3);
+  return true;
+}
+
+
+// Largest absolute difference between two images of the same type, 0 if lossless
+static double MaxAbsDiff(const cv::Mat &a, const cv::Mat &b) {
+  const size_t row_num_sample = a.cols * a.channels();
+  double max_diff = 0;
+  for (int r = 0; r < a.rows; ++r)
+    for (size_t i = 0; i < row_num_sample; ++i) {
+      double va, vb;
+      if (a.elemSize1() == 1) {
+        va = a.ptr<uint8_t>(r)[i];
+        vb = b.ptr<uint8_t>(r)[i];
+      } else if (a.elemSize1() == 2) {
+        va = a.ptr<uint16_t>(r)[i];
+        vb = b.ptr<uint16_t>(r)[i];
+      } else {
+        if (memcmp(a.ptr(r), b.ptr(r), a.cols * a.elemSize()) != 0)
+          return -1;  // reported as lossy without a magnitude
+        break;
+      }
+      max_diff = std::max(max_diff, std::abs(va - vb));
+    }
+  return max_diff;
+}
+
+
+int main(int argc, char *argv[]) {
+  const int kNumFrame = (argc > 1) ? std::max(atoi(argv[1]), 1) : 100;
+
+  std::vector<BenchFrame> frame_vec;
+  if (argc > 2) {
+    for (int i = 2; i < argc; ++i) {
+#if CV_MAJOR_VERSION < 3
+      cv::Mat img = cv::imread(argv[i], CV_LOAD_IMAGE_UNCHANGED);
+#else
+      cv::Mat img = cv::imread(argv[i], cv::IMREAD_UNCHANGED);
+#endif
+      EXP_CHK_M(!img.empty(), return -1, std::string("could not read ") + argv[i])
+      frame_vec.push_back({argv[i], img});
+    }
+  } else {
+    std::mt19937 rng(42);
+    frame_vec.push_back({"thermal 640x512 16U", MakeScene<uint16_t>(512, 640, CV_16UC1, 16000, 20, rng)});
+    frame_vec.push_back({"mono 1280x1024 8U", MakeScene<uint8_t>(1024, 1280, CV_8UC1, 255, 2, rng)});
+    frame_vec.push_back({"mask 1280x1024 8U", MakeMask(1024, 1280, rng)});
+  }
+
+  const std::vector<std::pair<mio::LcmImageCodec, std::string>> codec_vec = {
+      {mio::kLcmImageRaw, "raw"}, {mio::kLcmImageDeltaLz4, "delta_lz4"},
+      {mio::kLcmImagePackBits, "packbits"}, {mio::kLcmImageJpeg, "jpeg q90"}};
+
+  std::cout << kNumFrame << " frames per mode, times in ms per frame\n"
+            << std::left << std::setw(24) << "frame" << std::setw(11) << "codec" << std::right
+            << std::setw(12) << "bytes" << std::setw(8) << "ratio" << std::setw(10) << "encode"
+            << std::setw(10) << "decode" << std::setw(10) << "max err" << "\n";
+  std::vector<uint8_t> buf;
+  mio::CvMatPool pool;
+  for (const BenchFrame &frame : frame_vec)
+    for (const auto &codec : codec_vec) {
+      if (!CodecSupports(codec.first, frame.img))
+        continue;
+      const mio::LcmImageEncoding encoding(codec.first, 90);
+      mio::LcmOpencvMatInfo info;
+      cv::Mat decoded;
+
+      const std_sc_t::time_point encode_start = std_sc_t::now();
+      for (int i = 0; i < kNumFrame; ++i)
+        EXP_CHK(mio::EncodeLcmOpencvMat(frame.img, info, buf, encoding), return -1)
+      const double encode_ms =
+          std::chrono::duration<double, std::milli>(std_sc_t::now() - encode_start).count() / kNumFrame;
+
+      const std_sc_t::time_point decode_start = std_sc_t::now();
+      for (int i = 0; i < kNumFrame; ++i) {
+        decoded.release();  // so the pool buffer is free again
+        EXP_CHK(mio::DecodeLcmOpencvMat(buf.data(), buf.size(), pool, decoded), return -1)
+      }
+      const double decode_ms =
+          std::chrono::duration<double, std::milli>(std_sc_t::now() - decode_start).count() / kNumFrame;
+
+      const double raw_size = frame.img.total() * frame.img.elemSize();
+      std::cout << std::left << std::setw(24) << frame.name << std::setw(11) << codec.second << std::right
+                << std::setw(12) << buf.size() << std::setw(8) << std::fixed << std::setprecision(2)
+                << raw_size / buf.size() << std::setw(10) << std::setprecision(3) << encode_ms
+                << std::setw(10) << decode_ms << std::setw(10) << std::setprecision(0)
+                << MaxAbsDiff(frame.img, decoded) << "\n";
+    }
+
+  return 0;
+}
@@ -0,0 +1,98 @@
+#include "mio/lcm/lcm_typed.h"
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+// Publishes and handles lcm_double_t messages on an in-process LCM
+// (memq://), once with the generated <type>_publish()/<type>_subscribe() and
+// once with mio::LcmPublisher/mio::LcmSubscribe(), and reports messages per
+// second. Every message is handled before the next one is published, so the
+// numbers are the full publish, encode, decode and dispatch cost.
+//
+// Usage: lcm_typed_bench [num messages] [lcm url]
+
+typedef std::chrono::steady_clock std_sc_t;
+
+static double g_sum = 0;
+
+static void GeneratedHandler(const lcm_recv_buf_t *rbuf, const char *channel, const lcm_double_t *msg,
+                             void *userdata) {
+  g_sum += msg->val;
+}
+
+
+struct Receiver {
+  double sum = 0;
+
+  void NewValue(const lcm_double_t &msg) {
+    sum += msg.val;
+  }
+};
+
+
+static void Report(const std::string &name, const int num_msg, const std_sc_t::time_point start) {
+  const double sec = std::chrono::duration<double>(std_sc_t::now() - start).count();
+  std::cout << std::left << std::setw(28) << name << std::right << std::setw(12) << std::fixed
+            << std::setprecision(0) << num_msg / sec << " msg/s" << std::setw(10) << std::setprecision(3)
+            << sec * 1e9 / num_msg << " ns/msg\n";
+}
+
+
+int main(int argc, char *argv[]) {
+  const int kNumMsg = (argc > 1) ? std::max(atoi(argv[1]), 1) : 1000000;
+  const std::string url = (argc > 2) ? argv[2] : "memq://";
+
+  lcm_t *lcm = lcm_create(url.c_str());
+  EXP_CHK_M(lcm != NULL, return -1, "lcm_create() error, " + url)
+  lcm_double_t msg;
+  std::cout << kNumMsg << " lcm_double_t messages on " << url << "\n";
+
+  {
+    lcm_double_t_subscription_t *sub = lcm_double_t_subscribe(lcm, "BENCH_GENERATED", &GeneratedHandler, NULL);
+    const std_sc_t::time_point start = std_sc_t::now();
+    for (int i = 0; i < kNumMsg; ++i) {
+      msg.val = i;
+      lcm_double_t_publish(lcm, "BENCH_GENERATED", &msg);
+      lcm_handle(lcm);
+    }
+    Report("generated", kNumMsg, start);
+    lcm_double_t_unsubscribe(lcm, sub);
+  }
+
+  {
+    double sum = 0;
+    mio::LcmPublisher<lcm_double_t> publisher(lcm, "BENCH_LAMBDA");
+    std::unique_ptr<mio::LcmSubscription> sub =
+        mio::LcmSubscribe<lcm_double_t>(lcm, "BENCH_LAMBDA", [&sum](const lcm_double_t &msg) { sum += msg.val; });
+    EXP_CHK(sub, return -1)
+    const std_sc_t::time_point start = std_sc_t::now();
+    for (int i = 0; i < kNumMsg; ++i) {
+      msg.val = i;
+      publisher.Publish(msg);
+      lcm_handle(lcm);
+    }
+    Report("typed, lambda", kNumMsg, start);
+    EXP_CHK_M(sum == g_sum, return -1, "lost messages")
+  }
+
+  {
+    Receiver receiver;
+    mio::LcmPublisher<lcm_double_t> publisher(lcm, "BENCH_METHOD");
+    std::unique_ptr<mio::LcmSubscription> sub =
+        mio::LcmSubscribe<&Receiver::NewValue>(lcm, "BENCH_METHOD", &receiver);
+    EXP_CHK(sub, return -1)
+    const std_sc_t::time_point start = std_sc_t::now();
+    for (int i = 0; i < kNumMsg; ++i) {
+      msg.val = i;
+      publisher.Publish(msg);
+      lcm_handle(lcm);
+    }
+    Report("typed, member function", kNumMsg, start);
+    EXP_CHK_M(receiver.sum == g_sum, return -1, "lost messages")
+  }
+
+  lcm_destroy(lcm);
+  return 0;
+}
@@ -0,0 +1,141 @@
+#include "mio/socket/socket.h"
+#include "mio/socket/udp_batch.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Streams datagrams over loopback from a CClientUDP to a CServerUDP as fast
+// as the sender goes, and reports datagrams per second on each side:
+//   single - one mio::SendTo()/mio::RecvFrom() system call per datagram
+//   batch  - mio::UdpBatchSender/mio::UdpBatchReceiver, sendmmsg()/recvmmsg()
+//            of kBatchSize datagrams
+//   gso    - batch plus UDP_SEGMENT on the sender and UDP_GRO on the receiver,
+//            up to 64 datagrams per buffer
+// The receiver rate is taken from its first to its last datagram. Loopback
+// drops what the receiver does not keep up with, which shows as loss.
+//
+// Usage: udp_batch_bench [num datagrams] [payload bytes]
+// Without a payload size it runs 64 and 1400 bytes.
+
+typedef std::chrono::steady_clock std_sc_t;
+
+const int kBasePort = 47400;
+const size_t kBatchSize = 64;
+const size_t kMaxGsoBytes = 63*1024;  // one UDP_SEGMENT send is limited to 64 KB
+const int kIdleMs = 200;  // the receiver stops after this long without a datagram
+
+
+enum class Mode { kSingle, kBatch, kGso };
+
+struct Result {
+  double send_sec, recv_sec;
+  size_t num_recv;
+};
+
+
+static double Seconds(const std_sc_t::time_point start, const std_sc_t::time_point end) {
+  return std::chrono::duration<double>(end - start).count();
+}
+
+
+static void Receive(const Mode mode, const int sock_fd, const size_t num_datagram, const size_t payload_size,
+                    std::atomic<bool> &ready, Result &result) {
+  std_sc_t::time_point first, last;
+  size_t num_recv = 0;
+  if (mode == Mode::kSingle) {
+    std::vector<uint8_t> buf(payload_size);
+    ready = true;
+    while (num_recv < num_datagram) {
+      // 1 second of silence ends the run, without an error message
+      if (mio::RecvFrom(sock_fd, buf.data(), payload_size, 0, 0, NULL, NULL, 1, 1, true) <= 0)
+        break;
+      last = std_sc_t::now();
+      if (num_recv++ == 0)
+        first = last;
+    }
+  } else {
+    mio::UdpBatchReceiver receiver(sock_fd, kBatchSize, payload_size, true, mode == Mode::kGso);
+    ready = true;
+    while (num_recv < num_datagram) {
+      const int num = receiver.Recv(kIdleMs);
+      if (num <= 0)
+        break;
+      last = std_sc_t::now();
+      if (num_recv == 0)
+        first = last;
+      num_recv += num;
+    }
+  }
+  result.num_recv = num_recv;
+  result.recv_sec = num_recv > 1 ? Seconds(first, last) : 0;
+}
+
+
+static Result Run(const Mode mode, const size_t num_datagram, const size_t payload_size, const int port) {
+  Result result = {0, 0, 0};
+  mio::CServerUDP server;
+  EXP_CHK(server.Init("127.0.0.1", std::to_string(port)) == 0, return result)
+  const int rcvbuf_size = 16*1024*1024;  // capped at net.core.rmem_max
+  setsockopt(server.interface_sock_fd(), SOL_SOCKET, SO_RCVBUF, &rcvbuf_size, sizeof(rcvbuf_size));
+  mio::CClientUDP client;
+  EXP_CHK(client.Init("127.0.0.1", std::to_string(port)) == 0, return result)
+
+  std::atomic<bool> ready(false);
+  std::thread recv_thread(Receive, mode, server.interface_sock_fd(), num_datagram, payload_size, std::ref(ready),
+                          std::ref(result));
+  while (!ready)
+    std::this_thread::yield();
+
+  const size_t num_per_send = (mode == Mode::kGso) ? std::max<size_t>(1, std::min<size_t>(64,
+                                                         kMaxGsoBytes / payload_size)) : 1;
+  std::vector<uint8_t> payload(payload_size*num_per_send, 0x5a);
+  const std_sc_t::time_point start = std_sc_t::now();
+  if (mode == Mode::kSingle) {
+    for (size_t i = 0; i < num_datagram; ++i)
+      EXP_CHK(mio::SendTo(client.server_sock_fd(), payload.data(), payload_size, 0, 0, client.server_ai_addr(),
+                          client.server_ai_addrlen()) == static_cast<int>(payload_size), break)
+  } else {
+    mio::UdpBatchSender sender(client.server_sock_fd(), client.server_ai_addr(), client.server_ai_addrlen(),
+                               kBatchSize);
+    if (mode == Mode::kGso) {
+      EXP_CHK(sender.SetSegmentSize(payload_size), recv_thread.join(); return result)
+    }
+    for (size_t i = 0; i < num_datagram; i += num_per_send)
+      EXP_CHK(sender.Add(payload.data(), payload_size*std::min(num_per_send, num_datagram - i)) != -1, break)
+    sender.Flush();
+  }
+  result.send_sec = Seconds(start, std_sc_t::now());
+  recv_thread.join();
+  return result;
+}
+
+
+static void Report(const std::string &name, const size_t num_datagram, const Result &result) {
+  std::cout << std::left << std::setw(8) << name << std::right << std::fixed << std::setprecision(0)
+            << std::setw(12) << num_datagram / result.send_sec << " sent/s" << std::setw(12)
+            << (result.recv_sec > 0 ? result.num_recv / result.recv_sec : 0) << " recv/s" << std::setw(8)
+            << std::setprecision(1) << 100.0 * (num_datagram - result.num_recv) / num_datagram << " % loss\n";
+}
+
+
+int main(int argc, char *argv[]) {
+  const size_t num_datagram = (argc > 1) ? std::max(atoi(argv[1]), 1) : 1000000;
+  std::vector<size_t> payload_size_vec = {64, 1400};
+  if (argc > 2)
+    payload_size_vec = {static_cast<size_t>(std::max(atoi(argv[2]), 8))};
+
+  int port = kBasePort;
+  for (const size_t payload_size : payload_size_vec) {
+    std::cout << num_datagram << " datagrams of " << payload_size << " bytes\n";
+    Report("single", num_datagram, Run(Mode::kSingle, num_datagram, payload_size, port++));
+    Report("batch", num_datagram, Run(Mode::kBatch, num_datagram, payload_size, port++));
+    Report("gso", num_datagram, Run(Mode::kGso, num_datagram, payload_size, port++));
+  }
+  return 0;
+}
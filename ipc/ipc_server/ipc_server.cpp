@@ -4,52 +4,101 @@
 
 namespace mio{
 
-void CIpcServer::CreateShm(const lcm_recv_buf_t *rbuf, const char *channel,
-                           const lcm_create_shm_t *msg, void *userdata){
-  std::string shm_name(msg->shm_name);
-  EXP_CHK(!shm_name.empty(), return)
-  EXP_CHK_M(msg->shm_size > 0, return, std::string("shm_name: ") + shm_name);
-  printf("request to create shared memory segment %s with size %d\n", msg->shm_name, msg->shm_size);
-
-  CIpcServer *ipcs = static_cast<CIpcServer*>(userdata);
-
-  auto item_it = ipcs->m_shared_memory_map.find(shm_name);
-  if( item_it == ipcs->m_shared_memory_map.end() ){
-    ipcs->m_shared_memory_map.insert( std::pair<std::string, CSharedMemoryServer>( shm_name, CSharedMemoryServer() ) );
-    CSharedMemoryServer &shm = ipcs->m_shared_memory_map.at(shm_name);
-    shm.init(__FILE__, string_to_key(shm_name), msg->shm_size);
+bool CIpcServer::AllocateBlock(const std::string &shm_name, const size_t shm_size, const pid_t pid,
+                               lcm_shm_block_t &block){
+  std::lock_guard<std::mutex> lock(m_mtx);
+  uint64_t offset, size;
+  size_t arena_idx;
+  auto item_it = m_block_arena_map.find(shm_name);
+  if( item_it != m_block_arena_map.end() ){
+    printf("CIpcServer::AllocateBlock() - a shared memory block with this name exists.\n");
+    arena_idx = item_it->second;
+    EXP_CHK(m_arena_vec[arena_idx].Find(shm_name, offset, size), return false)
+    std::string error_str = std::string("a memory block with the name ") + shm_name +
+                            " exists, but with a different size. Existing size: " + std::to_string(size) +
+                            ", Requested size: " + std::to_string(shm_size);
+    EXP_CHK_M(size == shm_size, return false, error_str)
+    EXP_CHK(m_arena_vec[arena_idx].AttachReader(shm_name, pid), return false)
   }
   else{
-    printf("CIpcServer::CreateShm() - a shared memory segment with this name exists.\n");
-    const size_t existing_shm_size = ipcs->m_shared_memory_map[shm_name].getSize();
-    std::string error_str = std::string("a memory segment with the name ") + shm_name +
-                            "exists, but with a different size. Existing size: " + std::to_string(existing_shm_size) +
-                            ", Requested size: " + std::to_string(msg->shm_size);
-    EXP_CHK_M(existing_shm_size == msg->shm_size, return, error_str)
+    for(arena_idx = 0; arena_idx < m_arena_vec.size(); ++arena_idx)
+      if( m_arena_vec[arena_idx].Allocate(shm_name, shm_size, offset, pid) )
+        break;
+    if( arena_idx == m_arena_vec.size() ){
+      EXP_CHK(AddArena(shm_size), return false)
+      EXP_CHK(m_arena_vec[arena_idx].Allocate(shm_name, shm_size, offset, pid), return false)
+    }
+    m_block_arena_map[shm_name] = arena_idx;
   }
 
-  lcm_create_shm_t response_msg;
-  response_msg.shm_name = msg->shm_name;
-  response_msg.shm_size = msg->shm_size;
-  response_msg.numeric_id = msg->numeric_id;
-  lcm_create_shm_t_publish(ipcs->m_lcm, "ipcs_create_shm_response", &response_msg);
+  block.arena_name = strdup( GetArenaName(arena_idx).c_str() );
+  block.arena_size = m_arena_vec[arena_idx].GetArenaSize();
+  block.offset = offset;
+  block.size = shm_size;
+  return true;
 }
 
 
-void CIpcServerShmClient::CreateShmResponse(const lcm_recv_buf_t *rbuf, const char *channel,
-                                            const lcm_create_shm_t *msg, void *userdata){
-  std::string shm_name(msg->shm_name);
+void CIpcServer::HandleRequest(const lcm_create_shm_t &request, lcm_shm_block_t &response){
+  response.shm_name = request.shm_name;
+  response.numeric_id = request.numeric_id;
+  response.arena_name = const_cast<char*>("");
+  response.arena_size = response.offset = response.size = 0;
+  response.success = false;
+
+  std::string shm_name(request.shm_name);
   EXP_CHK(!shm_name.empty(), return)
-  std::hash<std::string> hash_func;
-  size_t name_hash_key = hash_func(shm_name);
-  CIpcServerShmClient *shm_client = static_cast<CIpcServerShmClient*>(userdata);
-
-  if(msg->numeric_id == shm_client->m_numeric_id){
-    shm_client->m_numeric_id_match = true;
-    shm_client->m_shm.init(__FILE__, string_to_key(shm_name), msg->shm_size); //TODO - error check
-    shm_client->m_init_success = true;
+  EXP_CHK_M(request.shm_size > 0, return, std::string("shm_name: ") + shm_name);
+  printf("request to create shared memory block %s with size %d\n", request.shm_name, request.shm_size);
+  const pid_t pid = (request.pid > 0) ? static_cast<pid_t>(request.pid) : 0;
+  response.success = AllocateBlock(shm_name, request.shm_size, pid, response);
+}
+
+
+void CIpcServer::CreateShmBatch(const lcm_recv_buf_t *rbuf, const char *channel,
+                                const lcm_create_shm_batch_t *msg, void *userdata){
+  CIpcServer *ipcs = static_cast<CIpcServer*>(userdata);
+  std::vector<lcm_shm_block_t> block_vec(msg->num_request);
+  for(int i = 0; i < msg->num_request; ++i)
+    ipcs->HandleRequest(msg->requests[i], block_vec[i]);
+
+  lcm_shm_block_batch_t response_msg;
+  response_msg.num_block = msg->num_request;
+  response_msg.blocks = block_vec.data();
+  lcm_shm_block_batch_t_publish(ipcs->m_lcm, "ipcs_shm_block_batch", &response_msg);
+  for(lcm_shm_block_t &block : block_vec)
+    FreeResponse(block);
+}
+
+
+void CIpcServerShmAsyncClient::ShmBlockBatchResponse(const lcm_recv_buf_t *rbuf, const char *channel,
+                                                     const lcm_shm_block_batch_t *msg, void *userdata){
+  CIpcServerShmAsyncClient *shm_client = static_cast<CIpcServerShmAsyncClient*>(userdata);
+
+  for(int i = 0; i < msg->num_block; ++i){
+    const lcm_shm_block_t &block_msg = msg->blocks[i];
+    std::promise<IpcsShmBlock> promise;
+    {
+      std::lock_guard<std::mutex> lock(shm_client->m_mtx);
+      auto item_it = shm_client->m_pending_map.find(block_msg.numeric_id);
+      if( item_it == shm_client->m_pending_map.end() )
+        continue; // another client's request, or a duplicate response to a retry
+      promise = std::move(item_it->second.promise);
+      shm_client->m_pending_map.erase(item_it);
+    }
+
+    IpcsShmBlock block;
+    block.shm_name = block_msg.shm_name;
+    if(block_msg.success){
+      uint8_t *arena_addr = CIpcsArenaMap::instance().map(block_msg.arena_name, block_msg.arena_size);
+      if(arena_addr != NULL){
+        block.shm_addr = arena_addr + block_msg.offset;
+        block.shm_size = block_msg.size;
+        block.success = true;
+      }
+    }
+    promise.set_value(block);
   }
 }
 
 } //namespace mio
-
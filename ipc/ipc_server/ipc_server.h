@@ -1,28 +1,114 @@
 #ifndef __MIO_IPC_SERVER__
 #define __MIO_IPC_SERVER__
 
-#include <thread>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <vector>
 #include <lcm/lcm.h>
+#include "mio/altro/event_loop.h"
 #include "mio/ipc/shared_mem.h"
+#include "mio/ipc/shm_arena.h"
 #include "mio/lcm/lcm_utils.h"
 #include "lcm_types/lcm_create_shm_t.h"
 #include "lcm_types/lcm_destroy_shm_t.h"
+#include "lcm_types/lcm_shm_block_t.h"
+#include "lcm_types/lcm_create_shm_batch_t.h"
+#include "lcm_types/lcm_shm_block_batch_t.h"
+
+#ifdef USE_SYS_V_SHM
+#error "the IPC server arenas are named posix shared memory segments, build it without USE_SYS_V_SHM"
+#endif
+
+
+MIO_LCM_TYPE_TRAITS(lcm_destroy_shm_t)
+MIO_LCM_TYPE_TRAITS(lcm_create_shm_batch_t)
 
 
 namespace mio{
 
+// Named shared memory blocks are sub-allocated from a few large arenas
+// (posix segments named kIpcsArenaPrefix<index>) instead of one segment per
+// block. A client maps an arena once and addresses its blocks by offset.
+const char kIpcsArenaPrefix[] = "/mio_ipcs_arena_";
+const size_t kIpcsDefaultArenaSize = 64*1024*1024;
+
+struct IpcsBlockInfo{
+  std::string arena_name;
+  ShmArenaBlockInfo block;
+};
+
+// Blocks belong to the process that first requested them, later requesters
+// are recorded as readers. Every m_reclaim_period the server frees blocks
+// whose owner and readers have all exited, so crashed clients do not leak
+// shared memory. Requests carry the requester's pid in their pid field (see
+// CIpcServerShmAsyncClient). A block requested with a pid of 0, ie. by an
+// unknown requester, is kept until an explicit destroy request.
+//
+// Protocol: a client publishes an lcm_create_shm_batch_t on
+// "ipcs_create_shm_batch" and the server answers every request of it in one
+// lcm_shm_block_batch_t on "ipcs_shm_block_batch", matched by numeric_id. An
+// lcm_destroy_shm_t on "ipcs_destroy_shm" frees a block. A single request is a
+// batch of one (see CIpcServerShmAsyncClient).
 class CIpcServer{
-  std::unordered_map<std::string, CSharedMemoryServer> m_shared_memory_map;
+  std::mutex m_mtx; // guards the arenas and m_block_arena_map
+  std::vector< std::unique_ptr< SharedMemory<uint8_t> > > m_arena_shm_vec;
+  std::vector<ShmArena> m_arena_vec;
+  std::unordered_map<std::string, size_t> m_block_arena_map; // block name -> arena index
+  size_t m_arena_size;
+  std::chrono::milliseconds m_reclaim_period;
   lcm_t *m_lcm;
-  int m_lcm_fd;
-  bool m_exit_flag;
-  std::thread m_thread;
-  lcm_create_shm_t_subscription_t *m_create_sub;
-  lcm_destroy_shm_t_subscription_t *m_destroy_sub;
+  EventLoop m_event_loop; // handles m_lcm and the reclaim timer
+  bool m_started;
+  LcmStats m_lcm_stats; // the request subscriptions go through it
+  lcm_subscription_t *m_destroy_sub, *m_create_batch_sub;
 
-  static void CreateShm(const lcm_recv_buf_t *rbuf, const char *channel,
-                        const lcm_create_shm_t *msg, void *userdata);
+  static std::string GetArenaName(const size_t arena_idx){
+    return kIpcsArenaPrefix + std::to_string(arena_idx);
+  }
+
+  // Arenas grow to fit blocks that are larger than the default arena size
+  bool AddArena(const size_t min_block_size){
+    const size_t arena_size = std::max(m_arena_size, ShmArena::GetDataOffset() + min_block_size);
+    const std::string arena_name = GetArenaName(m_arena_vec.size());
+    // An arena left behind by a previous server instance is stale
+    SharedMemory<uint8_t>::Unlink(arena_name);
+    std::unique_ptr< SharedMemory<uint8_t> > shm(new SharedMemory<uint8_t>);
+    EXP_CHK_M(shm->Init(arena_name, arena_size, true, true), return false, "failed to create arena " + arena_name)
+    ShmArena arena;
+    EXP_CHK(arena.Format(shm->shm_addr_void_, arena_size), return false)
+    m_arena_shm_vec.push_back(std::move(shm));
+    m_arena_vec.push_back(arena);
+    printf("CIpcServer - created arena %s, size %zu\n", arena_name.c_str(), arena_size);
+    return true;
+  }
+
+  bool AllocateBlock(const std::string &shm_name, const size_t shm_size, const pid_t pid, lcm_shm_block_t &block);
+
+  void Reclaim(){
+    std::lock_guard<std::mutex> lock(m_mtx);
+    for(size_t i = 0; i < m_arena_vec.size(); ++i){
+      std::vector<std::string> reclaimed_names;
+      m_arena_vec[i].Reclaim(&reclaimed_names);
+      for(const std::string &shm_name : reclaimed_names){
+        printf("CIpcServer - reclaimed block %s, its processes exited\n", shm_name.c_str());
+        m_block_arena_map.erase(shm_name);
+      }
+    }
+  }
+
+  // Fills in a response for the request. Free it with FreeResponse().
+  void HandleRequest(const lcm_create_shm_t &request, lcm_shm_block_t &response);
+
+  static void FreeResponse(lcm_shm_block_t &response){
+    if(response.success)
+      free(response.arena_name);
+  }
+
+  static void CreateShmBatch(const lcm_recv_buf_t *rbuf, const char *channel,
+                             const lcm_create_shm_batch_t *msg, void *userdata);
 
   static void DestroyShm(const lcm_recv_buf_t *rbuf, const char *channel,
                          const lcm_destroy_shm_t *msg, void *userdata){
@@ -30,53 +116,81 @@ class CIpcServer{
     EXP_CHK(!shm_name.empty(), return)
 
     CIpcServer *ipcs = static_cast<CIpcServer*>(userdata);
-
-    auto item_it = ipcs->m_shared_memory_map.find(shm_name);
-    if( item_it == ipcs->m_shared_memory_map.end() )
-      printf("CIpcServer::DestroyShm() - the shared memory segment %s does not exist\n", msg->shm_name);
-    else
-      EXP_CHK_M(ipcs->m_shared_memory_map.erase(shm_name) == 1, return, "serious internal error");
+    std::lock_guard<std::mutex> lock(ipcs->m_mtx);
+
+    auto item_it = ipcs->m_block_arena_map.find(shm_name);
+    if( item_it == ipcs->m_block_arena_map.end() )
+      printf("CIpcServer::DestroyShm() - the shared memory block %s does not exist\n", msg->shm_name);
+    else{
+      EXP_CHK_M(ipcs->m_arena_vec[item_it->second].Free(shm_name), return, "serious internal error");
+      ipcs->m_block_arena_map.erase(item_it);
+    }
   }
 
   public:
-    CIpcServer() : m_lcm(NULL), m_exit_flag(false){
+    CIpcServer(const size_t arena_size = kIpcsDefaultArenaSize,
+               const std::chrono::milliseconds reclaim_period = std::chrono::milliseconds(2000)) :
+        m_arena_size(arena_size), m_reclaim_period(reclaim_period), m_lcm(NULL), m_started(false){
       m_lcm = lcm_create(NULL);
       EXP_CHK_M(m_lcm != NULL, return, "lcm_create() error")
-      m_lcm_fd = lcm_get_fileno(m_lcm);
 
-      m_create_sub = lcm_create_shm_t_subscribe(m_lcm, "ipcs_create_shm", &CreateShm, this);
-      m_destroy_sub = lcm_destroy_shm_t_subscribe(m_lcm, "ipcs_destroy_shm", &DestroyShm, this);
-      lcm_create_shm_t_subscription_set_queue_capacity(m_create_sub, 3);
-      lcm_destroy_shm_t_subscription_set_queue_capacity(m_destroy_sub, 3);
+      m_destroy_sub = m_lcm_stats.Subscribe(m_lcm, "ipcs_destroy_shm", &DestroyShm, this, 3);
+      m_create_batch_sub = m_lcm_stats.Subscribe(m_lcm, "ipcs_create_shm_batch", &CreateShmBatch, this, 16);
+      EXP_CHK(AddLcmToEventLoop(m_event_loop, m_lcm), return)
+      EXP_CHK(m_event_loop.AddTimer([this](){ Reclaim(); }, m_reclaim_period, m_reclaim_period) != -1, return)
     }
 
     ~CIpcServer(){
-      m_shared_memory_map.clear();
+      if(m_started)
+        stop();
+      m_block_arena_map.clear();
+      m_arena_vec.clear();
+      m_arena_shm_vec.clear();
       if(m_lcm != NULL){
-        lcm_create_shm_t_unsubscribe(m_lcm, m_create_sub);
-        lcm_destroy_shm_t_unsubscribe(m_lcm, m_destroy_sub);
+        m_lcm_stats.Unsubscribe(m_lcm, m_destroy_sub);
+        m_lcm_stats.Unsubscribe(m_lcm, m_create_batch_sub);
         lcm_destroy(m_lcm);
       }
     }
 
-    void ipcServerHandlerThread(){
-      for(;;){
-        if(m_exit_flag)
-          break;
-        if( lcm_handle_to(m_lcm, m_lcm_fd, 1, 0) );
-        //else printf("ipcServerHandlerThread() - timeout\n");
+    // Every block with its size, owner, last access time and live reader count
+    std::vector<IpcsBlockInfo> getInventory(){
+      std::lock_guard<std::mutex> lock(m_mtx);
+      std::vector<IpcsBlockInfo> inventory;
+      for(size_t i = 0; i < m_arena_vec.size(); ++i){
+        std::vector<ShmArenaBlockInfo> block_info_vec;
+        m_arena_vec[i].GetInventory(block_info_vec);
+        for(const ShmArenaBlockInfo &block_info : block_info_vec){
+          IpcsBlockInfo info;
+          info.arena_name = GetArenaName(i);
+          info.block = block_info;
+          inventory.push_back(info);
+        }
       }
+      return inventory;
     }
 
+    // Request counts, rates, handler times and queue overflows per channel.
+    // A request queue that keeps overflowing drops client requests.
+    std::vector<LcmChannelStats> getStats(){
+      std::vector<LcmChannelStats> stats_vec;
+      m_lcm_stats.GetStats(stats_vec);
+      return stats_vec;
+    }
+
+    // Requests and the periodic reclaim are handled on one event loop thread,
+    // which sleeps until a request arrives or the reclaim timer fires
     void start(){
-      if(!m_exit_flag)
-        m_thread = std::thread(&CIpcServer::ipcServerHandlerThread, this);
+      EXP_CHK(m_lcm != NULL && !m_started, return)
+      m_event_loop.Start();
+      m_started = true;
     }
 
     void stop(){
+      EXP_CHK(m_started, return)
       printf("CIpcServer::stop() - exiting...\n");
-      m_exit_flag = true;
-      m_thread.join();
+      m_event_loop.Stop();
+      m_started = false;
       printf("CIpcServer::stop() - thread stopped.\n");
     }
 };
@@ -84,4 +198,3 @@ class CIpcServer{
 } //namespace mio
 
 #endif //__MIO_IPC_SERVER__
-
@@ -1,11 +1,27 @@
 #ifndef __MIO_IPC_SERVER_SHM_CLIENT__
 #define __MIO_IPC_SERVER_SHM_CLIENT__
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
 #include <lcm/lcm.h>
+#include "mio/altro/event_loop.h"
 #include "mio/lcm/lcm_utils.h"
 #include "mio/ipc/shared_mem.h"
 #include "lcm_types/lcm_create_shm_t.h"
+#include "lcm_types/lcm_shm_block_t.h"
+#include "lcm_types/lcm_create_shm_batch_t.h"
+#include "lcm_types/lcm_shm_block_batch_t.h"
+
+#ifdef USE_SYS_V_SHM
+#error "the IPC server arenas are named posix shared memory segments, build it without USE_SYS_V_SHM"
+#endif
 
 
 namespace mio{
@@ -19,83 +35,224 @@ namespace mio{
 
 
 #define IPCS_CREATE_SHM_CLIENT(var_name, shm_name, shm_size)\
-mio::CIpcServerShmClient var_name( shm_name, shm_size, mio::string_to_key( std::string(__FILE__) + std::to_string(__LINE__) ) );
+mio::CIpcServerShmClient var_name(shm_name, shm_size);
 
 #define IPCS_SHM_CLIENT_INIT(var_name, shm_name, shm_size)\
-var_name.init( shm_name, shm_size, mio::string_to_key( std::string(__FILE__) + std::to_string(__LINE__) ) );
+var_name.init(shm_name, shm_size);
 
 
 namespace mio{
 
-class CIpcServerShmClient{
-  lcm_t *m_lcm;
-  int m_lcm_fd;
-  bool m_is_init, m_init_success, m_numeric_id_match;
-  size_t m_numeric_id;
-  lcm_create_shm_t_subscription_t *m_response_sub;
-
-  static void CreateShmResponse(const lcm_recv_buf_t *rbuf, const char *channel, 
-                                const lcm_create_shm_t *msg, void *userdata);
-  
+// Process wide table of the IPC server arenas this process has mapped. Each
+// arena is mapped once, on first use, and stays mapped for the life of the
+// process, so every later block in it costs no mmap.
+class CIpcsArenaMap{
+  std::unordered_map< std::string, std::unique_ptr< SharedMemory<uint8_t> > > m_arena_map;
+  std::mutex m_mtx;
+
+  CIpcsArenaMap(){}
+
   public:
-    CSharedMemoryClient m_shm;
+    static CIpcsArenaMap &instance(){
+      static CIpcsArenaMap arena_map;
+      return arena_map;
+    }
+
+    // Returns the base address of the arena, or NULL on error
+    uint8_t *map(const std::string &arena_name, const size_t arena_size){
+      std::lock_guard<std::mutex> lock(m_mtx);
+      auto item_it = m_arena_map.find(arena_name);
+      if( item_it != m_arena_map.end() )
+        return item_it->second->shm_addr_;
+      std::unique_ptr< SharedMemory<uint8_t> > shm(new SharedMemory<uint8_t>);
+      EXP_CHK_M(shm->Init(arena_name, arena_size, false), return NULL, "failed to map arena " + arena_name)
+      uint8_t *arena_addr = shm->shm_addr_;
+      m_arena_map[arena_name] = std::move(shm);
+      return arena_addr;
+    }
+};
+
+
+struct IpcsShmBlock{
+  std::string shm_name;
+  void *shm_addr; // inside an arena that is shared with every other client
+  size_t shm_size;
+  bool success;
+
+  IpcsShmBlock() : shm_addr(NULL), shm_size(0), success(false){}
+};
+
+
+// Requests named blocks from the IPC server without blocking. Requests made
+// in one call go out in a single lcm_create_shm_batch_t message and each one
+// gets a future. Responses are matched to requests by numeric_id. Requests
+// that are still unanswered are resent together with exponential backoff
+// (kInitialRetryDelay doubling up to kMaxRetryDelay) until m_timeout passes,
+// after which their futures hold a block with success == false, eg.
+//
+//   mio::CIpcServerShmAsyncClient ipcs_client;
+//   auto block_fut_vec = ipcs_client.create({{"left_frame", frame_size}, {"right_frame", frame_size}});
+//   ...
+//   mio::IpcsShmBlock left_block = block_fut_vec[0].get();
+class CIpcServerShmAsyncClient{
+  typedef std::chrono::steady_clock std_sc_t;
+
+  struct PendingRequest{
+    std::string shm_name;
+    size_t shm_size;
+    std::promise<IpcsShmBlock> promise;
+    std_sc_t::time_point give_up_time;
+  };
+
+  lcm_t *m_lcm;
+  lcm_shm_block_batch_t_subscription_t *m_response_sub;
+  std::mutex m_mtx;
+  std::unordered_map<int64_t, PendingRequest> m_pending_map; // numeric_id -> request
+  std::chrono::milliseconds m_timeout, m_retry_delay;
+  EventLoop m_event_loop; // handles responses and the retry timer, idle while nothing is pending
+  int m_retry_timer;
 
-    CIpcServerShmClient() : m_lcm(NULL), m_response_sub(NULL){
-      m_is_init = m_init_success = m_numeric_id_match = false;
+  static void ShmBlockBatchResponse(const lcm_recv_buf_t *rbuf, const char *channel,
+                                    const lcm_shm_block_batch_t *msg, void *userdata);
+
+  // Unique across clients and processes, so a client never takes another
+  // client's response. The upper 32 bits are the pid.
+  static int64_t NextNumericId(){
+    static std::atomic<int64_t> next_numeric_id( static_cast<int64_t>( getpid() ) << 32 );
+    return next_numeric_id++;
+  }
+
+  // Caller holds m_mtx
+  void PublishRequests(const std::vector<int64_t> &numeric_id_vec){
+    std::vector<lcm_create_shm_t> request_vec(numeric_id_vec.size());
+    for(size_t i = 0; i < numeric_id_vec.size(); ++i){
+      const PendingRequest &pending = m_pending_map.at(numeric_id_vec[i]);
+      request_vec[i].shm_name = const_cast<char*>( pending.shm_name.c_str() );
+      request_vec[i].shm_size = pending.shm_size;
+      request_vec[i].numeric_id = numeric_id_vec[i];
+      request_vec[i].pid = getpid(); // the server tracks who owns and reads each block
     }
+    lcm_create_shm_batch_t msg;
+    msg.num_request = request_vec.size();
+    msg.requests = request_vec.data();
+    lcm_create_shm_batch_t_publish(m_lcm, "ipcs_create_shm_batch", &msg);
+  }
 
-    CIpcServerShmClient(const std::string shm_name, const size_t shm_size, 
-                        const size_t numeric_id) : m_lcm(NULL), m_response_sub(NULL){
-      m_is_init = m_init_success = m_numeric_id_match = false;
-      init(shm_name, shm_size, numeric_id);
+  // Resend everything that is still pending, or give up on it
+  void RetryPending(){
+    std::lock_guard<std::mutex> lock(m_mtx);
+    const std_sc_t::time_point now = std_sc_t::now();
+    if( m_pending_map.empty() )
+      return;
+    std::vector<int64_t> numeric_id_vec;
+    for(auto item_it = m_pending_map.begin(); item_it != m_pending_map.end();){
+      if(now >= item_it->second.give_up_time){
+        printf("CIpcServerShmAsyncClient - no response from IPC Server for %s\n", item_it->second.shm_name.c_str());
+        IpcsShmBlock block;
+        block.shm_name = item_it->second.shm_name;
+        item_it->second.promise.set_value(block);
+        item_it = m_pending_map.erase(item_it);
+      }
+      else{
+        numeric_id_vec.push_back(item_it->first);
+        ++item_it;
+      }
     }
+    if( numeric_id_vec.empty() )
+      return; // the retry timer stays disarmed until the next create()
+    PublishRequests(numeric_id_vec);
+    m_retry_delay = std::min(m_retry_delay*2, kMaxRetryDelay);
+    m_event_loop.SetTimer(m_retry_timer, m_retry_delay);
+  }
+
+  public:
+    static constexpr std::chrono::milliseconds kInitialRetryDelay{10};
+    static constexpr std::chrono::milliseconds kMaxRetryDelay{500};
 
-    void init(const std::string shm_name, const size_t shm_size, const size_t numeric_id){
+    CIpcServerShmAsyncClient(const std::chrono::milliseconds timeout = std::chrono::milliseconds(3000)) :
+        m_lcm(NULL), m_response_sub(NULL), m_timeout(timeout),
+        m_retry_delay(kInitialRetryDelay), m_retry_timer(-1){
       m_lcm = lcm_create(NULL);
-      EXP_CHK_M(m_lcm != NULL, return, std::string("lcm_create() error, shm_name: ") + shm_name)
-      m_lcm_fd = lcm_get_fileno(m_lcm);
-
-      m_response_sub = lcm_create_shm_t_subscribe(m_lcm, "ipcs_create_shm_response", &CreateShmResponse, this);
-      lcm_create_shm_t_subscription_set_queue_capacity(m_response_sub, 3);
-
-      lcm_create_shm_t msg;
-      char *shm_name_c_str = strcpy( static_cast<char*>( malloc(shm_name.length() + 1) ), shm_name.c_str() );
-      msg.shm_name = shm_name_c_str;
-      msg.shm_size = shm_size;
-      msg.numeric_id = m_numeric_id = numeric_id;
-      lcm_create_shm_t_publish(m_lcm, "ipcs_create_shm", &msg);
-
-      for(size_t time_out = 0;;)
-        if( lcm_handle_to(m_lcm, m_lcm_fd, 1, 0) ){
-          if(!m_numeric_id_match){
-            printf("received a message with wrong id\n");
-            continue;
-          }
-          EXP_CHK_M(m_init_success, return, "critical error - IPC Server could not create shared memory segment")
-          break;
-        }
-        else{
-          time_out++;
-          lcm_create_shm_t_publish(m_lcm, "ipcs_create_shm", &msg);
-          EXP_CHK_M(time_out > 2, return, "critical error - didn't receive response from IPC Server")
-        }
-
-      printf("successful init of mem segment - name: %s, size: %d\n", shm_name_c_str, shm_size);
-      free(shm_name_c_str);
-      m_is_init = true;
+      EXP_CHK_M(m_lcm != NULL, return, "lcm_create() error")
+      m_response_sub = lcm_shm_block_batch_t_subscribe(m_lcm, "ipcs_shm_block_batch", &ShmBlockBatchResponse, this);
+      lcm_shm_block_batch_t_subscription_set_queue_capacity(m_response_sub, 16);
+      EXP_CHK(AddLcmToEventLoop(m_event_loop, m_lcm), return)
+      // Disarmed, create() arms it
+      m_retry_timer = m_event_loop.AddTimer([this](){ RetryPending(); }, std::chrono::nanoseconds(0));
+      m_event_loop.Start();
     }
 
-    ~CIpcServerShmClient(){
+    // Unanswered requests are abandoned, their futures get a broken_promise error
+    ~CIpcServerShmAsyncClient(){
       if(m_lcm != NULL){
-        if( m_shm.isInit() )
-          m_shm.uninit();
-        lcm_create_shm_t_unsubscribe(m_lcm, m_response_sub);
+        m_event_loop.Stop();
+        lcm_shm_block_batch_t_unsubscribe(m_lcm, m_response_sub);
         lcm_destroy(m_lcm);
       }
     }
+
+    std::vector< std::future<IpcsShmBlock> > create(const std::vector< std::pair<std::string, size_t> > &request_vec){
+      std::vector< std::future<IpcsShmBlock> > future_vec;
+      EXP_CHK(m_lcm != NULL && m_retry_timer != -1, return future_vec)
+      std::lock_guard<std::mutex> lock(m_mtx);
+      std::vector<int64_t> numeric_id_vec;
+      const std_sc_t::time_point now = std_sc_t::now();
+      for(const auto &request : request_vec){
+        const int64_t numeric_id = NextNumericId();
+        PendingRequest &pending = m_pending_map[numeric_id];
+        pending.shm_name = request.first;
+        pending.shm_size = request.second;
+        pending.give_up_time = now + m_timeout;
+        future_vec.push_back( pending.promise.get_future() );
+        numeric_id_vec.push_back(numeric_id);
+      }
+      PublishRequests(numeric_id_vec);
+      m_retry_delay = kInitialRetryDelay;
+      m_event_loop.SetTimer(m_retry_timer, m_retry_delay);
+      return future_vec;
+    }
+
+    std::future<IpcsShmBlock> create(const std::string &shm_name, const size_t shm_size){
+      std::vector< std::future<IpcsShmBlock> > future_vec = create({{shm_name, shm_size}});
+      EXP_CHK(!future_vec.empty(), return std::future<IpcsShmBlock>())
+      return std::move(future_vec[0]);
+    }
+};
+
+
+// Blocking client for a single block
+class CIpcServerShmClient{
+  bool m_is_init;
+
+  public:
+    // The block, inside an arena that is shared with every other client
+    void *m_shm_addr;
+    size_t m_shm_size;
+
+    CIpcServerShmClient() : m_is_init(false), m_shm_addr(NULL), m_shm_size(0){}
+
+    CIpcServerShmClient(const std::string shm_name, const size_t shm_size) :
+        m_is_init(false), m_shm_addr(NULL), m_shm_size(0){
+      init(shm_name, shm_size);
+    }
+
+    void init(const std::string shm_name, const size_t shm_size){
+      CIpcServerShmAsyncClient async_client;
+      std::future<IpcsShmBlock> block_fut = async_client.create(shm_name, shm_size);
+      EXP_CHK_M(block_fut.valid(), return, std::string("shm_name: ") + shm_name)
+      const IpcsShmBlock block = block_fut.get();
+      EXP_CHK_M(block.success, return, "critical error - IPC Server could not create shared memory block " + shm_name)
+      m_shm_addr = block.shm_addr;
+      m_shm_size = block.shm_size;
+      printf("successful init of mem block - name: %s, size: %zu\n", shm_name.c_str(), m_shm_size);
+      m_is_init = true;
+    }
+
+    bool isInit(){
+      return m_is_init;
+    }
 };
 
 } //namespace mio
 
 #endif //__MIO_IPC_SERVER_SHM_CLIENT__
-
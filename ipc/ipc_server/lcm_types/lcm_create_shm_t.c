@@ -21,10 +21,11 @@ int64_t __lcm_create_shm_t_hash_recursive(const __lcm_hash_ptr *p)
     cp.v = (void*)__lcm_create_shm_t_get_hash;
     (void) cp;
 
-    int64_t hash = (int64_t)0xf3a4cb5515b71be0LL
+    int64_t hash = (int64_t)0x2935cc091c03199bLL
          + __string_hash_recursive(&cp)
          + __int32_t_hash_recursive(&cp)
          + __int64_t_hash_recursive(&cp)
+         + __int32_t_hash_recursive(&cp)
         ;
 
     return (hash<<1) + ((hash>>63)&1);
@@ -55,6 +56,9 @@ int __lcm_create_shm_t_encode_array(void *buf, int offset, int maxlen, const lcm
         thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].numeric_id), 1);
         if (thislen < 0) return thislen; else pos += thislen;
 
+        thislen = __int32_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].pid), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
     }
     return pos;
 }
@@ -84,6 +88,8 @@ int __lcm_create_shm_t_encoded_array_size(const lcm_create_shm_t *p, int element
 
         size += __int64_t_encoded_array_size(&(p[element].numeric_id), 1);
 
+        size += __int32_t_encoded_array_size(&(p[element].pid), 1);
+
     }
     return size;
 }
@@ -108,6 +114,9 @@ int __lcm_create_shm_t_decode_array(const void *buf, int offset, int maxlen, lcm
         thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].numeric_id), 1);
         if (thislen < 0) return thislen; else pos += thislen;
 
+        thislen = __int32_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].pid), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
     }
     return pos;
 }
@@ -123,6 +132,8 @@ int __lcm_create_shm_t_decode_array_cleanup(lcm_create_shm_t *p, int elements)
 
         __int64_t_decode_array_cleanup(&(p[element].numeric_id), 1);
 
+        __int32_t_decode_array_cleanup(&(p[element].pid), 1);
+
     }
     return 0;
 }
@@ -159,6 +170,8 @@ int __lcm_create_shm_t_clone_array(const lcm_create_shm_t *p, lcm_create_shm_t *
 
         __int64_t_clone_array(&(p[element].numeric_id), &(q[element].numeric_id), 1);
 
+        __int32_t_clone_array(&(p[element].pid), &(q[element].pid), 1);
+
     }
     return 0;
 }
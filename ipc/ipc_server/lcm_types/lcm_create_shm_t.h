@@ -21,6 +21,7 @@ struct _lcm_create_shm_t
     char*      shm_name;
     int32_t    shm_size;
     int64_t    numeric_id;
+    int32_t    pid;
 };
 
 /**
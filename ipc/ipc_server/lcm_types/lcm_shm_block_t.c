@@ -0,0 +1,306 @@
+// THIS IS AN AUTOMATICALLY GENERATED FILE.  DO NOT MODIFY
+// BY HAND!!
+//
+// Generated by lcm-gen
+
+#include <string.h>
+#include "lcm_shm_block_t.h"
+
+static int __lcm_shm_block_t_hash_computed;
+static uint64_t __lcm_shm_block_t_hash;
+
+uint64_t __lcm_shm_block_t_hash_recursive(const __lcm_hash_ptr *p)
+{
+    const __lcm_hash_ptr *fp;
+    for (fp = p; fp != NULL; fp = fp->parent)
+        if (fp->v == __lcm_shm_block_t_get_hash)
+            return 0;
+
+    __lcm_hash_ptr cp;
+    cp.parent =  p;
+    cp.v = (void*)__lcm_shm_block_t_get_hash;
+    (void) cp;
+
+    uint64_t hash = (uint64_t)0x6081dbb1ba2ed993LL
+         + __string_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __string_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __int64_t_hash_recursive(&cp)
+         + __boolean_hash_recursive(&cp)
+        ;
+
+    return (hash<<1) + ((hash>>63)&1);
+}
+
+int64_t __lcm_shm_block_t_get_hash(void)
+{
+    if (!__lcm_shm_block_t_hash_computed) {
+        __lcm_shm_block_t_hash = (int64_t)__lcm_shm_block_t_hash_recursive(NULL);
+        __lcm_shm_block_t_hash_computed = 1;
+    }
+
+    return __lcm_shm_block_t_hash;
+}
+
+int __lcm_shm_block_t_encode_array(void *buf, int offset, int maxlen, const lcm_shm_block_t *p, int elements)
+{
+    int pos = 0, element;
+    int thislen;
+
+    for (element = 0; element < elements; element++) {
+
+        thislen = __string_encode_array(buf, offset + pos, maxlen - pos, &(p[element].shm_name), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].numeric_id), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+        thislen = __string_encode_array(buf, offset + pos, maxlen - pos, &(p[element].arena_name), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].arena_size), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].offset), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+        thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &(p[element].size), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+        thislen = __boolean_encode_array(buf, offset + pos, maxlen - pos, &(p[element].success), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+    }
+    return pos;
+}
+
+int lcm_shm_block_t_encode(void *buf, int offset, int maxlen, const lcm_shm_block_t *p)
+{
+    int pos = 0, thislen;
+    int64_t hash = __lcm_shm_block_t_get_hash();
+
+    thislen = __int64_t_encode_array(buf, offset + pos, maxlen - pos, &hash, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+
+    thislen = __lcm_shm_block_t_encode_array(buf, offset + pos, maxlen - pos, p, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+
+    return pos;
+}
+
+int __lcm_shm_block_t_encoded_array_size(const lcm_shm_block_t *p, int elements)
+{
+    int size = 0, element;
+    for (element = 0; element < elements; element++) {
+
+        size += __string_encoded_array_size(&(p[element].shm_name), 1);
+
+        size += __int64_t_encoded_array_size(&(p[element].numeric_id), 1);
+
+        size += __string_encoded_array_size(&(p[element].arena_name), 1);
+
+        size += __int64_t_encoded_array_size(&(p[element].arena_size), 1);
+
+        size += __int64_t_encoded_array_size(&(p[element].offset), 1);
+
+        size += __int64_t_encoded_array_size(&(p[element].size), 1);
+
+        size += __boolean_encoded_array_size(&(p[element].success), 1);
+
+    }
+    return size;
+}
+
+int lcm_shm_block_t_encoded_size(const lcm_shm_block_t *p)
+{
+    return 8 + __lcm_shm_block_t_encoded_array_size(p, 1);
+}
+
+int __lcm_shm_block_t_decode_array(const void *buf, int offset, int maxlen, lcm_shm_block_t *p, int elements)
+{
+    int pos = 0, thislen, element;
+
+    for (element = 0; element < elements; element++) {
+
+        thislen = __string_decode_array(buf, offset + pos, maxlen - pos, &(p[element].shm_name), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].numeric_id), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+        thislen = __string_decode_array(buf, offset + pos, maxlen - pos, &(p[element].arena_name), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].arena_size), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].offset), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+        thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &(p[element].size), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+        thislen = __boolean_decode_array(buf, offset + pos, maxlen - pos, &(p[element].success), 1);
+        if (thislen < 0) return thislen; else pos += thislen;
+
+    }
+    return pos;
+}
+
+int __lcm_shm_block_t_decode_array_cleanup(lcm_shm_block_t *p, int elements)
+{
+    int element;
+    for (element = 0; element < elements; element++) {
+
+        __string_decode_array_cleanup(&(p[element].shm_name), 1);
+
+        __int64_t_decode_array_cleanup(&(p[element].numeric_id), 1);
+
+        __string_decode_array_cleanup(&(p[element].arena_name), 1);
+
+        __int64_t_decode_array_cleanup(&(p[element].arena_size), 1);
+
+        __int64_t_decode_array_cleanup(&(p[element].offset), 1);
+
+        __int64_t_decode_array_cleanup(&(p[element].size), 1);
+
+        __boolean_decode_array_cleanup(&(p[element].success), 1);
+
+    }
+    return 0;
+}
+
+int lcm_shm_block_t_decode(const void *buf, int offset, int maxlen, lcm_shm_block_t *p)
+{
+    int pos = 0, thislen;
+    int64_t hash = __lcm_shm_block_t_get_hash();
+
+    int64_t this_hash;
+    thislen = __int64_t_decode_array(buf, offset + pos, maxlen - pos, &this_hash, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+    if (this_hash != hash) return -1;
+
+    thislen = __lcm_shm_block_t_decode_array(buf, offset + pos, maxlen - pos, p, 1);
+    if (thislen < 0) return thislen; else pos += thislen;
+
+    return pos;
+}
+
+int lcm_shm_block_t_decode_cleanup(lcm_shm_block_t *p)
+{
+    return __lcm_shm_block_t_decode_array_cleanup(p, 1);
+}
+
+int __lcm_shm_block_t_clone_array(const lcm_shm_block_t *p, lcm_shm_block_t *q, int elements)
+{
+    int element;
+    for (element = 0; element < elements; element++) {
+
+        __string_clone_array(&(p[element].shm_name), &(q[element].shm_name), 1);
+
+        __int64_t_clone_array(&(p[element].numeric_id), &(q[element].numeric_id), 1);
+
+        __string_clone_array(&(p[element].arena_name), &(q[element].arena_name), 1);
+
+        __int64_t_clone_array(&(p[element].arena_size), &(q[element].arena_size), 1);
+
+        __int64_t_clone_array(&(p[element].offset), &(q[element].offset), 1);
+
+        __int64_t_clone_array(&(p[element].size), &(q[element].size), 1);
+
+        __boolean_clone_array(&(p[element].success), &(q[element].success), 1);
+
+    }
+    return 0;
+}
+
+lcm_shm_block_t *lcm_shm_block_t_copy(const lcm_shm_block_t *p)
+{
+    lcm_shm_block_t *q = (lcm_shm_block_t*) malloc(sizeof(lcm_shm_block_t));
+    __lcm_shm_block_t_clone_array(p, q, 1);
+    return q;
+}
+
+void lcm_shm_block_t_destroy(lcm_shm_block_t *p)
+{
+    __lcm_shm_block_t_decode_array_cleanup(p, 1);
+    free(p);
+}
+
+int lcm_shm_block_t_publish(lcm_t *lc, const char *channel, const lcm_shm_block_t *p)
+{
+      int max_data_size = lcm_shm_block_t_encoded_size (p);
+      uint8_t *buf = (uint8_t*) malloc (max_data_size);
+      if (!buf) return -1;
+      int data_size = lcm_shm_block_t_encode (buf, 0, max_data_size, p);
+      if (data_size < 0) {
+          free (buf);
+          return data_size;
+      }
+      int status = lcm_publish (lc, channel, buf, data_size);
+      free (buf);
+      return status;
+}
+
+struct _lcm_shm_block_t_subscription_t {
+    lcm_shm_block_t_handler_t user_handler;
+    void *userdata;
+    lcm_subscription_t *lc_h;
+};
+static
+void lcm_shm_block_t_handler_stub (const lcm_recv_buf_t *rbuf,
+                            const char *channel, void *userdata)
+{
+    int status;
+    lcm_shm_block_t p;
+    memset(&p, 0, sizeof(lcm_shm_block_t));
+    status = lcm_shm_block_t_decode (rbuf->data, 0, rbuf->data_size, &p);
+    if (status < 0) {
+        fprintf (stderr, "error %d decoding lcm_shm_block_t!!!\n", status);
+        return;
+    }
+
+    lcm_shm_block_t_subscription_t *h = (lcm_shm_block_t_subscription_t*) userdata;
+    h->user_handler (rbuf, channel, &p, h->userdata);
+
+    lcm_shm_block_t_decode_cleanup (&p);
+}
+
+lcm_shm_block_t_subscription_t* lcm_shm_block_t_subscribe (lcm_t *lcm,
+                    const char *channel,
+                    lcm_shm_block_t_handler_t f, void *userdata)
+{
+    lcm_shm_block_t_subscription_t *n = (lcm_shm_block_t_subscription_t*)
+                       malloc(sizeof(lcm_shm_block_t_subscription_t));
+    n->user_handler = f;
+    n->userdata = userdata;
+    n->lc_h = lcm_subscribe (lcm, channel,
+                                 lcm_shm_block_t_handler_stub, n);
+    if (n->lc_h == NULL) {
+        fprintf (stderr,"couldn't reg lcm_shm_block_t LCM handler!\n");
+        free (n);
+        return NULL;
+    }
+    return n;
+}
+
+int lcm_shm_block_t_subscription_set_queue_capacity (lcm_shm_block_t_subscription_t* subs,
+                              int num_messages)
+{
+    return lcm_subscription_set_queue_capacity (subs->lc_h, num_messages);
+}
+
+int lcm_shm_block_t_unsubscribe(lcm_t *lcm, lcm_shm_block_t_subscription_t* hid)
+{
+    int status = lcm_unsubscribe (lcm, hid->lc_h);
+    if (0 != status) {
+        fprintf(stderr,
+           "couldn't unsubscribe lcm_shm_block_t_handler %p!\n", hid);
+        return -1;
+    }
+    free (hid);
+    return 0;
+}
+
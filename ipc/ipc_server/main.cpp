@@ -4,14 +4,6 @@
 
 
 int main(int argc, char ** argv){
-  if(false){
-    CSharedMemoryServer shm_server;
-    shm_server.init(__FILE__, 33, 1024);
-    char *data_ptr = static_cast<char*>(shm_server.m_pvShMemAddr);
-    snprintf(data_ptr, 1024, "[hello_world]\n");
-    printf("data_ptr: [%s]\n", data_ptr);
-  }
-
   mio::CIpcServer ipc_server;
   ipc_server.start();
 
@@ -19,8 +11,8 @@ int main(int argc, char ** argv){
     IPCS_CREATE_SHM_CLIENT(shm_test_1, "test_shm_name", 1024)
     IPCS_CREATE_SHM_CLIENT(shm_test_2, "test_shm_name", 1024)
 
-    char *str_1 = static_cast<char*>(shm_test_1.m_shm.m_pvShMemAddr);
-    char *str_2 = static_cast<char*>(shm_test_2.m_shm.m_pvShMemAddr);
+    char *str_1 = static_cast<char*>(shm_test_1.m_shm_addr);
+    char *str_2 = static_cast<char*>(shm_test_2.m_shm_addr);
 
     std::string hello_str("hello world");
     strcpy( str_1, hello_str.c_str() );
@@ -28,12 +20,24 @@ int main(int argc, char ** argv){
     printf("str_2: [%s]\n", str_2);
   }
 
-  printf("press q to quit\n");
-  for(;;)
-    if(getch() == 'q')
+  printf("press i for the block inventory, s for request stats, q to quit\n");
+  for(;;){
+    const int key = getch();
+    if(key == 'q')
       break;
+    else if(key == 'i'){
+      const int64_t now = mio::GetShmArenaTime();
+      for(const mio::IpcsBlockInfo &info : ipc_server.getInventory())
+        printf("%s %s - size: %zu, owner: %d%s, readers: %zu, last access: %.1f s ago\n",
+               info.arena_name.c_str(), info.block.name.c_str(), static_cast<size_t>(info.block.size),
+               info.block.owner_pid, info.block.owner_alive ? "" : " (exited)", info.block.num_reader,
+               (now - info.block.last_access_time)/1000.0);
+    }
+    else if(key == 's')
+      printf("%s", mio::LcmStats::FormatStats( ipc_server.getStats() ).c_str());
     else
-      printf("press q to quit\n");
+      printf("press i for the block inventory, s for request stats, q to quit\n");
+  }
 
   printf("exiting...\n");
   ipc_server.stop();
@@ -0,0 +1,212 @@
+#ifndef __MIO_SHARED_BROADCAST_RING_H__
+#define __MIO_SHARED_BROADCAST_RING_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+#include "mio/altro/error.h"
+#include "mio/ipc/shared_ring.h"  // MIO_CACHE_LINE_SIZE
+
+/*
+Single-writer, many-reader broadcast ring that is placed directly inside a
+mio::SharedMemory segment, eg.
+
+  typedef mio::SharedBroadcastRing<Frame, 8> FrameRing;
+  mio::SharedMemory<FrameRing> shmem;
+  shmem.Init("/frame_bcast", sizeof(FrameRing));
+
+  // Writer, never blocks
+  Frame *frame = shmem.shm_addr_->Reserve();
+  FillFrame(frame);
+  shmem.shm_addr_->Commit();
+
+  // Each reader process
+  const int reader_id = shmem.shm_addr_->AttachReader();
+  const Frame *frame = shmem.shm_addr_->Peek(reader_id);
+  if (frame != nullptr) {
+    UseFrame(frame);
+    if (!shmem.shm_addr_->Release(reader_id))
+      DiscardResults();  // the writer lapped us while we were using the frame
+  }
+  shmem.shm_addr_->DetachReader(reader_id);
+
+Every reader keeps its own cursor in the segment. The writer never looks at the
+readers, so publishing costs the same no matter how many are attached. A reader
+that falls more than N frames behind is moved forward to the oldest frame still
+in the ring and the frames it missed are added to its skip count. Each slot
+carries a sequence number (odd while being written) so a reader can tell when a
+frame was overwritten underneath it.
+
+A new segment is zero filled by the OS, which is a valid empty ring. If a reader
+process dies without calling DetachReader() its reader slot stays claimed.
+*/
+
+namespace mio{
+
+template <class DATA_T, size_t N, size_t MAX_READERS = 8>
+class SharedBroadcastRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SharedBroadcastRing size must be a power of two");
+  static_assert(MAX_READERS > 0, "SharedBroadcastRing needs at least one reader slot");
+  static_assert(std::is_trivially_copyable<DATA_T>::value, "SharedBroadcastRing data type must be trivially copyable");
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "SharedBroadcastRing needs lock-free 64 bit atomics");
+
+  private:
+    struct Slot {
+      std::atomic<uint64_t> seq;  // 2*idx + 2 once item idx is committed, odd while it is written
+      DATA_T data;
+    };
+
+    struct ReaderState {
+      alignas(MIO_CACHE_LINE_SIZE) std::atomic<uint32_t> in_use;
+      std::atomic<uint64_t> cursor;  // index of the next item to read
+      std::atomic<uint64_t> num_read, num_skipped;
+      uint64_t peek_seq;
+    };
+
+    alignas(MIO_CACHE_LINE_SIZE) std::atomic<uint64_t> head_;  // number of committed items
+    ReaderState readers_[MAX_READERS];
+    alignas(MIO_CACHE_LINE_SIZE) Slot slots_[N];
+
+    static constexpr uint64_t CommittedSeq(const uint64_t idx) {
+      return 2*idx + 2;
+    }
+
+    bool ValidReader(const int reader_id) const {
+      return reader_id >= 0 && static_cast<size_t>(reader_id) < MAX_READERS &&
+             readers_[reader_id].in_use.load(std::memory_order_relaxed) != 0;
+    }
+
+  public:
+    // Writer side. Returns the slot for the next item; always succeeds. The slot
+    // is marked as being written, so readers that still hold it will fail their
+    // Release().
+    DATA_T *Reserve() {
+      const uint64_t head = head_.load(std::memory_order_relaxed);
+      Slot &slot = slots_[head & (N - 1)];
+      slot.seq.store(2*head + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      return &slot.data;
+    }
+
+    // Publish the slot returned by the last Reserve()
+    void Commit() {
+      const uint64_t head = head_.load(std::memory_order_relaxed);
+      slots_[head & (N - 1)].seq.store(CommittedSeq(head), std::memory_order_release);
+      head_.store(head + 1, std::memory_order_release);
+    }
+
+    void Publish(const DATA_T &item) {
+      *Reserve() = item;
+      Commit();
+    }
+
+    // Claim a reader slot. The reader starts at the next item the writer
+    // commits. Returns the reader id, or -1 if all MAX_READERS slots are in use.
+    int AttachReader() {
+      for (size_t i = 0; i < MAX_READERS; ++i) {
+        uint32_t expected = 0;
+        if (readers_[i].in_use.compare_exchange_strong(expected, 1, std::memory_order_acq_rel)) {
+          readers_[i].cursor.store(head_.load(std::memory_order_acquire), std::memory_order_relaxed);
+          readers_[i].num_read.store(0, std::memory_order_relaxed);
+          readers_[i].num_skipped.store(0, std::memory_order_relaxed);
+          return static_cast<int>(i);
+        }
+      }
+      return -1;
+    }
+
+    bool DetachReader(const int reader_id) {
+      EXP_CHK(ValidReader(reader_id), return false)
+      readers_[reader_id].in_use.store(0, std::memory_order_release);
+      return true;
+    }
+
+    // Reader side. Returns the reader's next item in place, or nullptr if it has
+    // caught up with the writer. A reader that was lapped is moved forward to
+    // the oldest item still in the ring.
+    const DATA_T *Peek(const int reader_id) {
+      EXP_CHK(ValidReader(reader_id), return nullptr)
+      ReaderState &reader = readers_[reader_id];
+      uint64_t cursor = reader.cursor.load(std::memory_order_relaxed);
+      for (;;) {
+        const uint64_t head = head_.load(std::memory_order_acquire);
+        if (cursor == head)
+          return nullptr;
+        if (head - cursor > N) {
+          reader.num_skipped.fetch_add(head - N - cursor, std::memory_order_relaxed);
+          cursor = head - N;
+          reader.cursor.store(cursor, std::memory_order_relaxed);
+        }
+        Slot &slot = slots_[cursor & (N - 1)];
+        reader.peek_seq = slot.seq.load(std::memory_order_acquire);
+        if (reader.peek_seq == CommittedSeq(cursor))
+          return &slot.data;
+        // The writer lapped us between reading head_ and the slot, try again
+        reader.num_skipped.fetch_add(1, std::memory_order_relaxed);
+        reader.cursor.store(++cursor, std::memory_order_relaxed);
+      }
+    }
+
+    // Move past the item returned by the last successful Peek(). Returns false
+    // if the writer overwrote the item while it was in use, in which case
+    // anything derived from it should be discarded.
+    bool Release(const int reader_id) {
+      EXP_CHK(ValidReader(reader_id), return false)
+      ReaderState &reader = readers_[reader_id];
+      const uint64_t cursor = reader.cursor.load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      const bool intact = slots_[cursor & (N - 1)].seq.load(std::memory_order_relaxed) == reader.peek_seq;
+      if (intact)
+        reader.num_read.fetch_add(1, std::memory_order_relaxed);
+      else
+        reader.num_skipped.fetch_add(1, std::memory_order_relaxed);
+      reader.cursor.store(cursor + 1, std::memory_order_relaxed);
+      return intact;
+    }
+
+    // Copying read. Returns false if there is no new item.
+    bool Read(const int reader_id, DATA_T &item) {
+      for (;;) {
+        const DATA_T *slot_data = Peek(reader_id);
+        if (slot_data == nullptr)
+          return false;
+        item = *slot_data;
+        if (Release(reader_id))
+          return true;
+      }
+    }
+
+    // Number of committed items the reader has not consumed yet
+    uint64_t GetLag(const int reader_id) const {
+      EXP_CHK(ValidReader(reader_id), return 0)
+      return head_.load(std::memory_order_acquire) - readers_[reader_id].cursor.load(std::memory_order_relaxed);
+    }
+
+    // Number of items the reader lost because the writer lapped it
+    uint64_t GetSkipCount(const int reader_id) const {
+      EXP_CHK(ValidReader(reader_id), return 0)
+      return readers_[reader_id].num_skipped.load(std::memory_order_relaxed);
+    }
+
+    uint64_t GetReadCount(const int reader_id) const {
+      EXP_CHK(ValidReader(reader_id), return 0)
+      return readers_[reader_id].num_read.load(std::memory_order_relaxed);
+    }
+
+    uint64_t GetPublishCount() const {
+      return head_.load(std::memory_order_acquire);
+    }
+
+    static constexpr size_t Capacity() {
+      return N;
+    }
+
+    static constexpr size_t MaxReaders() {
+      return MAX_READERS;
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_SHARED_BROADCAST_RING_H__
@@ -0,0 +1,150 @@
+#ifndef __MIO_SHARED_EVENT_H__
+#define __MIO_SHARED_EVENT_H__
+
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "mio/altro/error.h"
+
+/*
+Process-shared wait/notify event that is placed directly inside a
+mio::SharedMemory segment, usually next to the data it guards, eg.
+
+  struct Channel {
+    mio::SharedEvent new_frame;
+    mio::SharedRing<Frame, 4> ring;
+  };
+
+  // Consumer
+  for (;;) {
+    const uint32_t seq = chan->new_frame.GetSeq();
+    const Frame *frame = chan->ring.Peek();
+    if (frame == nullptr) {
+      chan->new_frame.WaitFor(seq, std::chrono::milliseconds(10));
+      continue;
+    }
+    ...
+  }
+
+  // Producer
+  chan->ring.Commit();
+  chan->new_frame.Notify();
+
+The caller takes a snapshot of the sequence number before checking its
+condition and waits for the sequence number to move, so a Notify() between the
+check and the wait is never lost. Wait spins briefly before falling back to a
+futex wait, and Notify() only makes a system call when somebody is blocked in
+the kernel. Timeouts use CLOCK_MONOTONIC. Unlike mio::Semaphore, a timeout or a
+signal is not reported as an error.
+
+A new segment is zero filled by the OS, which is a valid event.
+*/
+
+namespace mio{
+
+class SharedEvent {
+  static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be a plain 32 bit integer");
+  static_assert(std::atomic<uint32_t>::is_always_lock_free, "SharedEvent needs lock-free 32 bit atomics");
+
+  private:
+    std::atomic<uint32_t> seq_;
+    std::atomic<uint32_t> num_waiter_;
+
+    uint32_t *FutexAddr() {
+      return reinterpret_cast<uint32_t*>(&seq_);
+    }
+
+    static void CpuRelax() {
+#if defined(__x86_64__) || defined(__i386__)
+      __builtin_ia32_pause();
+#elif defined(__aarch64__)
+      asm volatile("yield");
+#endif
+    }
+
+    // Returns true if the sequence number moved away from seq while spinning
+    bool Spin(const uint32_t seq, const unsigned int spin_count) {
+      for (unsigned int i = 0; i < spin_count; ++i) {
+        if (seq_.load(std::memory_order_acquire) != seq)
+          return true;
+        CpuRelax();
+      }
+      return false;
+    }
+
+    // abs_timeout is a CLOCK_MONOTONIC time point, nullptr waits forever
+    bool FutexWait(const uint32_t seq, const timespec *abs_timeout) {
+      num_waiter_.fetch_add(1, std::memory_order_seq_cst);
+      bool changed = false;
+      for (;;) {
+        if (seq_.load(std::memory_order_seq_cst) != seq) {
+          changed = true;
+          break;
+        }
+        // FUTEX_WAIT_BITSET takes an absolute timeout, so retrying after EINTR
+        // or a spurious wake up does not stretch the deadline.
+        const long rv = syscall(SYS_futex, FutexAddr(), FUTEX_WAIT_BITSET, seq, abs_timeout,
+                                nullptr, FUTEX_BITSET_MATCH_ANY);
+        if (rv == -1 && errno == ETIMEDOUT) {
+          changed = (seq_.load(std::memory_order_acquire) != seq);
+          break;
+        }
+        EXP_CHK_ERRNO(rv == 0 || errno == EAGAIN || errno == EINTR, break)
+      }
+      num_waiter_.fetch_sub(1, std::memory_order_release);
+      return changed;
+    }
+
+  public:
+    static const unsigned int kDefaultSpinCount = 256;
+
+    // Snapshot to pass to one of the Wait functions
+    uint32_t GetSeq() const {
+      return seq_.load(std::memory_order_acquire);
+    }
+
+    // Wake every waiter. Only enters the kernel if a waiter is blocked there.
+    void Notify() {
+      seq_.fetch_add(1, std::memory_order_seq_cst);
+      if (num_waiter_.load(std::memory_order_seq_cst) > 0) {
+        EXP_CHK_ERRNO(syscall(SYS_futex, FutexAddr(), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0) != -1, return)
+      }
+    }
+
+    // Block until Notify() is called after seq was read with GetSeq()
+    bool Wait(const uint32_t seq, const unsigned int spin_count = kDefaultSpinCount) {
+      if (Spin(seq, spin_count))
+        return true;
+      return FutexWait(seq, nullptr);
+    }
+
+    // Returns false if abs_timeout, a CLOCK_MONOTONIC time point, passes first
+    bool WaitUntil(const uint32_t seq, const timespec &abs_timeout,
+                   const unsigned int spin_count = kDefaultSpinCount) {
+      if (Spin(seq, spin_count))
+        return true;
+      return FutexWait(seq, &abs_timeout);
+    }
+
+    // Returns false if timeout passes first
+    bool WaitFor(const uint32_t seq, const std::chrono::nanoseconds timeout,
+                 const unsigned int spin_count = kDefaultSpinCount) {
+      if (timeout.count() <= 0)
+        return GetSeq() != seq;
+      timespec abs_timeout;
+      EXP_CHK_ERRNO(clock_gettime(CLOCK_MONOTONIC, &abs_timeout) == 0, return false)
+      const int64_t nsec = static_cast<int64_t>(abs_timeout.tv_nsec) + timeout.count() % 1000000000;
+      abs_timeout.tv_sec += timeout.count() / 1000000000 + nsec / 1000000000;
+      abs_timeout.tv_nsec = nsec % 1000000000;
+      return WaitUntil(seq, abs_timeout, spin_count);
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_SHARED_EVENT_H__
@@ -0,0 +1,379 @@
+#ifndef __MIO_SHARED_FRAME_POOL_H__
+#define __MIO_SHARED_FRAME_POOL_H__
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "mio/altro/opencv.h"
+#include "mio/ipc/shared_mem.h"
+#include "mio/ipc/shared_ring.h"  // MIO_CACHE_LINE_SIZE
+
+/*
+Pool of image slots in one shared memory segment. The writer fills a slot in
+place and publishes it, readers lease the newest frame and get a cv::Mat header
+that points straight into shared memory, eg.
+
+  // Writer
+  mio::SharedFramePool pool;
+  pool.Init("/camera_frames", 4, 1920*1080*3);
+  mio::SharedFrameWriteLease frame = pool.AcquireWrite(1080, 1920, CV_8UC3);
+  if (!frame.Empty()) {
+    camera.Grab(frame.GetMat());
+    frame.Commit();
+  }
+
+  // Reader
+  mio::SharedFramePool pool;
+  pool.Init("/camera_frames", 4, 1920*1080*3);
+  uint64_t last_seq = 0;
+  mio::SharedFrameLease frame = pool.AcquireLatest(last_seq);
+  if (!frame.Empty()) {
+    last_seq = frame.GetSeq();
+    Process(frame.GetMat());
+  }  // the slot may be reused once frame goes out of scope
+
+Each slot has a reference count in the segment. A lease holds one reference and
+the writer only reuses slots whose count is zero, so a leased frame is never
+overwritten. The cv::Mat does not own the memory: it is valid only while its
+lease lives, clone() it to keep the image longer. If every slot is leased
+AcquireWrite() fails and the writer should drop the frame, so use at least one
+more slot than the number of frames readers hold at once.
+
+Every process must call Init() with the same slot count and size. A new segment
+is zero filled by the OS, which is a valid empty pool. If a reader process dies
+while holding a lease the slot stays referenced.
+*/
+
+namespace mio{
+
+class SharedFramePool;
+
+
+// Reference to a published frame, move only
+class SharedFrameLease {
+  friend class SharedFramePool;
+
+  private:
+    SharedFramePool *pool_;
+    size_t slot_idx_;
+    uint64_t seq_;
+    cv::Mat mat_;
+
+    SharedFrameLease(SharedFramePool *pool, const size_t slot_idx, const uint64_t seq, const cv::Mat &mat) :
+        pool_(pool), slot_idx_(slot_idx), seq_(seq), mat_(mat) {}
+
+  public:
+    SharedFrameLease() : pool_(nullptr), slot_idx_(0), seq_(0) {}
+
+    SharedFrameLease(SharedFrameLease &&other) : pool_(nullptr) {
+      *this = std::move(other);
+    }
+
+    SharedFrameLease &operator=(SharedFrameLease &&other);
+
+    SharedFrameLease(const SharedFrameLease&) = delete;
+    SharedFrameLease &operator=(const SharedFrameLease&) = delete;
+
+    ~SharedFrameLease() {
+      Release();
+    }
+
+    void Release();
+
+    bool Empty() const {
+      return pool_ == nullptr;
+    }
+
+    // Points into shared memory, valid until the lease is released
+    const cv::Mat &GetMat() const {
+      return mat_;
+    }
+
+    // Publish sequence number of the frame, starts at 1
+    uint64_t GetSeq() const {
+      return seq_;
+    }
+};
+
+
+// Exclusive hold of a slot for the writer, move only. Destroying it without
+// calling Commit() discards the frame.
+class SharedFrameWriteLease {
+  friend class SharedFramePool;
+
+  private:
+    SharedFramePool *pool_;
+    size_t slot_idx_;
+    cv::Mat mat_;
+
+    SharedFrameWriteLease(SharedFramePool *pool, const size_t slot_idx, const cv::Mat &mat) :
+        pool_(pool), slot_idx_(slot_idx), mat_(mat) {}
+
+  public:
+    SharedFrameWriteLease() : pool_(nullptr), slot_idx_(0) {}
+
+    SharedFrameWriteLease(SharedFrameWriteLease &&other) : pool_(nullptr) {
+      *this = std::move(other);
+    }
+
+    SharedFrameWriteLease &operator=(SharedFrameWriteLease &&other);
+
+    SharedFrameWriteLease(const SharedFrameWriteLease&) = delete;
+    SharedFrameWriteLease &operator=(const SharedFrameWriteLease&) = delete;
+
+    ~SharedFrameWriteLease() {
+      Release();
+    }
+
+    // Publish the frame. Returns its sequence number, 0 if the lease is empty.
+    uint64_t Commit();
+
+    // Give the slot back without publishing
+    void Release();
+
+    bool Empty() const {
+      return pool_ == nullptr;
+    }
+
+    // Write the image into this Mat in place. Do not assign another Mat to it
+    // or create() it with a different size or type.
+    cv::Mat &GetMat() {
+      return mat_;
+    }
+};
+
+
+class SharedFramePool {
+  friend class SharedFrameLease;
+  friend class SharedFrameWriteLease;
+
+  private:
+    // The writer holds a slot exclusively by setting this bit in its count
+    static const uint32_t kWriterBit = 1U << 31;
+    // The newest frame is published as (seq << kSlotBits) | slot index
+    static const int kSlotBits = 16;
+
+    struct PoolHeader {
+      alignas(MIO_CACHE_LINE_SIZE) std::atomic<uint64_t> latest;
+    };
+
+    struct SlotHeader {
+      alignas(MIO_CACHE_LINE_SIZE) std::atomic<uint32_t> ref_count;
+      uint64_t seq;
+      int32_t rows, cols, type;
+      uint64_t step;
+    };
+
+    SharedMemory<uint8_t> shm_;
+    size_t num_slot_, max_frame_size_, slot_size_;
+
+    static size_t AlignUp(const size_t value) {
+      return (value + MIO_CACHE_LINE_SIZE - 1) / MIO_CACHE_LINE_SIZE * MIO_CACHE_LINE_SIZE;
+    }
+
+    PoolHeader *GetPoolHeader() {
+      return reinterpret_cast<PoolHeader*>(shm_.shm_addr_);
+    }
+
+    SlotHeader *GetSlotHeader(const size_t slot_idx) {
+      return reinterpret_cast<SlotHeader*>(shm_.shm_addr_ + AlignUp(sizeof(PoolHeader)) + slot_idx*slot_size_);
+    }
+
+    uint8_t *GetSlotData(const size_t slot_idx) {
+      return reinterpret_cast<uint8_t*>(GetSlotHeader(slot_idx)) + AlignUp(sizeof(SlotHeader));
+    }
+
+    cv::Mat GetSlotMat(const size_t slot_idx) {
+      const SlotHeader *slot = GetSlotHeader(slot_idx);
+      return cv::Mat(slot->rows, slot->cols, slot->type, GetSlotData(slot_idx), slot->step);
+    }
+
+    void ReleaseRead(const size_t slot_idx) {
+      GetSlotHeader(slot_idx)->ref_count.fetch_sub(1, std::memory_order_release);
+    }
+
+    void ReleaseWrite(const size_t slot_idx) {
+      GetSlotHeader(slot_idx)->ref_count.store(0, std::memory_order_release);
+    }
+
+    uint64_t CommitWrite(const size_t slot_idx, const cv::Mat &mat) {
+      SlotHeader *slot = GetSlotHeader(slot_idx);
+      EXP_CHK_M(mat.data == GetSlotData(slot_idx) && mat.rows == slot->rows && mat.cols == slot->cols &&
+                mat.type() == slot->type, ReleaseWrite(slot_idx); return 0,
+                "the lease Mat was reallocated, write into it in place")
+      PoolHeader *header = GetPoolHeader();
+      const uint64_t seq = (header->latest.load(std::memory_order_relaxed) >> kSlotBits) + 1;
+      slot->seq = seq;
+      ReleaseWrite(slot_idx);
+      header->latest.store((seq << kSlotBits) | slot_idx, std::memory_order_release);
+      return seq;
+    }
+
+  public:
+    SharedFramePool() : num_slot_(0), max_frame_size_(0), slot_size_(0) {}
+
+    static size_t GetShmSize(const size_t num_slot, const size_t max_frame_size) {
+      return AlignUp(sizeof(PoolHeader)) + num_slot*(AlignUp(sizeof(SlotHeader)) + AlignUp(max_frame_size));
+    }
+
+    // max_frame_size is in bytes, ie. rows*step of the largest frame
+    bool Init(const std::string &shm_name, const size_t num_slot, const size_t max_frame_size,
+              const SharedMemoryOptions &options = SharedMemoryOptions()) {
+      EXP_CHK(!shm_.IsInit(), return true)
+      EXP_CHK_M(num_slot > 1 && num_slot < (1U << kSlotBits), return false, "invalid slot count")
+      EXP_CHK(max_frame_size > 0, return false)
+      EXP_CHK(shm_.Init(shm_name, GetShmSize(num_slot, max_frame_size), true, false, O_RDWR,
+                        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, options), return false)
+      num_slot_ = num_slot;
+      max_frame_size_ = max_frame_size;
+      slot_size_ = AlignUp(sizeof(SlotHeader)) + AlignUp(max_frame_size);
+      return true;
+    }
+
+    // Every lease must be released first
+    bool Uninit() {
+      num_slot_ = max_frame_size_ = slot_size_ = 0;
+      return shm_.Uninit();
+    }
+
+    bool IsInit() {
+      return shm_.IsInit();
+    }
+
+    // Writer side. Claims a free slot for a rows x cols frame. Returns an empty
+    // lease if every slot is leased. Only one process may write.
+    SharedFrameWriteLease AcquireWrite(const int rows, const int cols, const int type) {
+      EXP_CHK(IsInit(), return SharedFrameWriteLease())
+      const size_t step = cols*CV_ELEM_SIZE(type);
+      EXP_CHK_M(rows > 0 && cols > 0 && rows*step <= max_frame_size_, return SharedFrameWriteLease(),
+                "frame does not fit in a slot")
+      // Start after the newest frame so it stays available to readers
+      const size_t latest_idx = GetPoolHeader()->latest.load(std::memory_order_acquire) & ((1U << kSlotBits) - 1);
+      for (size_t i = 1; i <= num_slot_; ++i) {
+        const size_t slot_idx = (latest_idx + i) % num_slot_;
+        SlotHeader *slot = GetSlotHeader(slot_idx);
+        uint32_t expected = 0;
+        if (slot->ref_count.compare_exchange_strong(expected, kWriterBit, std::memory_order_acquire)) {
+          slot->rows = rows;
+          slot->cols = cols;
+          slot->type = type;
+          slot->step = step;
+          return SharedFrameWriteLease(this, slot_idx, GetSlotMat(slot_idx));
+        }
+      }
+      return SharedFrameWriteLease();
+    }
+
+    // Copy an image into a free slot and publish it. Returns the sequence
+    // number of the frame, 0 if no slot was free.
+    uint64_t Publish(const cv::Mat &img) {
+      SharedFrameWriteLease frame = AcquireWrite(img.rows, img.cols, img.type());
+      if (frame.Empty())
+        return 0;
+      img.copyTo(frame.GetMat());
+      return frame.Commit();
+    }
+
+    // Reader side. Leases the newest frame if its sequence number is greater
+    // than newer_than, otherwise returns an empty lease.
+    SharedFrameLease AcquireLatest(const uint64_t newer_than = 0) {
+      EXP_CHK(IsInit(), return SharedFrameLease())
+      for (;;) {
+        const uint64_t latest = GetPoolHeader()->latest.load(std::memory_order_acquire);
+        const uint64_t seq = latest >> kSlotBits;
+        if (seq == 0 || seq <= newer_than)
+          return SharedFrameLease();
+        const size_t slot_idx = latest & ((1U << kSlotBits) - 1);
+        SlotHeader *slot = GetSlotHeader(slot_idx);
+        uint32_t ref_count = slot->ref_count.load(std::memory_order_relaxed);
+        while ((ref_count & kWriterBit) == 0 &&
+               !slot->ref_count.compare_exchange_weak(ref_count, ref_count + 1, std::memory_order_acquire)) {}
+        if ((ref_count & kWriterBit) != 0) {
+          // The writer reclaimed the slot. Try again if it already published
+          // a newer frame elsewhere, otherwise there is nothing to lease now.
+          if (GetPoolHeader()->latest.load(std::memory_order_acquire) != latest)
+            continue;
+          return SharedFrameLease();
+        }
+        // The slot can not change any more, make sure it still holds the frame we wanted
+        if (slot->seq == seq)
+          return SharedFrameLease(this, slot_idx, seq, GetSlotMat(slot_idx));
+        ReleaseRead(slot_idx);
+      }
+    }
+
+    // Sequence number of the newest frame, 0 if nothing was published yet
+    uint64_t GetLatestSeq() {
+      EXP_CHK(IsInit(), return 0)
+      return GetPoolHeader()->latest.load(std::memory_order_acquire) >> kSlotBits;
+    }
+
+    // Number of leases on a slot, for diagnostics
+    uint32_t GetRefCount(const size_t slot_idx) {
+      EXP_CHK(IsInit() && slot_idx < num_slot_, return 0)
+      return GetSlotHeader(slot_idx)->ref_count.load(std::memory_order_relaxed) & ~kWriterBit;
+    }
+
+    size_t GetNumSlot() const {
+      return num_slot_;
+    }
+
+    size_t GetMaxFrameSize() const {
+      return max_frame_size_;
+    }
+};
+
+
+inline SharedFrameLease &SharedFrameLease::operator=(SharedFrameLease &&other) {
+  if (this != &other) {
+    Release();
+    pool_ = other.pool_;
+    slot_idx_ = other.slot_idx_;
+    seq_ = other.seq_;
+    mat_ = other.mat_;
+    other.pool_ = nullptr;
+    other.mat_ = cv::Mat();
+  }
+  return *this;
+}
+
+inline void SharedFrameLease::Release() {
+  if (pool_ != nullptr) {
+    mat_ = cv::Mat();
+    pool_->ReleaseRead(slot_idx_);
+    pool_ = nullptr;
+  }
+}
+
+
+inline SharedFrameWriteLease &SharedFrameWriteLease::operator=(SharedFrameWriteLease &&other) {
+  if (this != &other) {
+    Release();
+    pool_ = other.pool_;
+    slot_idx_ = other.slot_idx_;
+    mat_ = other.mat_;
+    other.pool_ = nullptr;
+    other.mat_ = cv::Mat();
+  }
+  return *this;
+}
+
+inline uint64_t SharedFrameWriteLease::Commit() {
+  EXP_CHK(pool_ != nullptr, return 0)
+  const uint64_t seq = pool_->CommitWrite(slot_idx_, mat_);
+  mat_ = cv::Mat();
+  pool_ = nullptr;
+  return seq;
+}
+
+inline void SharedFrameWriteLease::Release() {
+  if (pool_ != nullptr) {
+    mat_ = cv::Mat();
+    pool_->ReleaseWrite(slot_idx_);
+    pool_ = nullptr;
+  }
+}
+
+} //namespace mio
+
+#endif //__MIO_SHARED_FRAME_POOL_H__
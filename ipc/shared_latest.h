@@ -0,0 +1,90 @@
+#ifndef __MIO_SHARED_LATEST_H__
+#define __MIO_SHARED_LATEST_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#include "mio/ipc/shared_ring.h"  // MIO_CACHE_LINE_SIZE
+
+/*
+Latest-value slot protected by a sequence lock that is placed directly inside a
+mio::SharedMemory segment. Use it to publish "current state" such as a stage
+position or a temperature, where readers only care about the newest value, eg.
+
+  typedef mio::SharedLatest<StageState> StageSlot;
+  mio::SharedMemory<StageSlot> shmem;
+  shmem.Init("/stage_state", sizeof(StageSlot));
+
+  // Writer, never blocks
+  shmem.shm_addr_->Store(state);
+
+  // Reader
+  uint64_t version = 0;
+  StageState state;
+  if (shmem.shm_addr_->Changed(version) && shmem.shm_addr_->Load(state, &version))
+    Update(state);
+
+There must be only one writer at a time. Readers never block the writer; a read
+that overlaps a write is retried. The version starts at 0 (nothing stored yet)
+and increases by one with every Store(), so Changed() is a single atomic load.
+
+A new segment is zero filled by the OS, which is a valid empty slot.
+*/
+
+namespace mio{
+
+template <class DATA_T>
+class SharedLatest {
+  static_assert(std::is_trivially_copyable<DATA_T>::value, "SharedLatest data type must be trivially copyable");
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "SharedLatest needs lock-free 64 bit atomics");
+
+  private:
+    // Odd while a write is in progress, the version is seq_/2
+    alignas(MIO_CACHE_LINE_SIZE) std::atomic<uint64_t> seq_;
+    DATA_T value_;
+
+  public:
+    // Writer side
+    void Store(const DATA_T &value) {
+      const uint64_t seq = seq_.load(std::memory_order_relaxed);
+      seq_.store(seq + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+      std::memcpy(static_cast<void*>(&value_), &value, sizeof(DATA_T));
+      seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    // Reader side. Copies the newest value into value and returns true, or
+    // returns false if nothing has been stored yet. If version is not null it is
+    // set to the version of the value that was read.
+    bool Load(DATA_T &value, uint64_t *version = nullptr) const {
+      for (;;) {
+        const uint64_t seq_begin = seq_.load(std::memory_order_acquire);
+        if (seq_begin == 0)
+          return false;
+        if (seq_begin & 1)
+          continue;  // write in progress
+        std::memcpy(static_cast<void*>(&value), &value_, sizeof(DATA_T));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (seq_.load(std::memory_order_relaxed) == seq_begin) {
+          if (version != nullptr)
+            *version = seq_begin / 2;
+          return true;
+        }
+      }
+    }
+
+    // Version of the newest completed Store(), 0 if nothing has been stored
+    uint64_t GetVersion() const {
+      return seq_.load(std::memory_order_acquire) / 2;
+    }
+
+    // True if a Store() completed after the given version was read
+    bool Changed(const uint64_t version) const {
+      return GetVersion() != version;
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_SHARED_LATEST_H__
@@ -6,20 +6,100 @@
 #include <sys/shm.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/vfs.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
 #include <limits.h>
+#include <fstream>
+#include <limits>
+#include <vector>
 #include "mio/altro/error.h"
 
-// To list and remove Sys V shared memory, use 'ipcs' and 'ipcrm -M <shm key>', respectively
-// To remove posix shared memory, as root, cd to /dev/shm and rm desired files.
+// To list and remove Sys V shared memory, use 'ipcs' and 'ipcrm -M <shm key>', respectively, or call
+// SharedMemory<>::Unlink(<shm key>).
+// To remove posix shared memory, as root, cd to /dev/shm and rm desired files, or call SharedMemory<>::Unlink().
+// Huge page backed posix shared memory lives in SharedMemoryOptions::hugetlbfs_dir instead.
+
+#ifndef SHM_HUGE_SHIFT
+#define SHM_HUGE_SHIFT 26  // linux/shm.h, which clashes with sys/shm.h
+#endif
 
 namespace mio{
 
+// Optional mapping behavior for SharedMemory::Init()
+struct SharedMemoryOptions {
+  // Back the segment with huge pages. The system needs reserved huge pages, eg.
+  // 'echo 128 > /proc/sys/vm/nr_hugepages'. The posix version creates the
+  // segment in hugetlbfs_dir (a hugetlbfs mount) rather than /dev/shm.
+  bool huge_pages;
+  // Sys V only, 0 uses the system default huge page size. The posix version
+  // uses the page size of the hugetlbfs mount.
+  size_t huge_page_size;
+  std::string hugetlbfs_dir;
+  // Fault in every page during Init() instead of on first touch
+  bool populate;
+  // mlock() the mapping so it is never paged out
+  bool lock;
+  // Bind the segment's memory to this NUMA node, -1 leaves the default policy.
+  // Pages that already exist (eg. when attaching to another process' segment)
+  // are only moved if this process is their sole user.
+  int numa_node;
+
+  SharedMemoryOptions() : huge_pages(false), huge_page_size(0), hugetlbfs_dir("/dev/hugepages"),
+                          populate(false), lock(false), numa_node(-1) {}
+};
+
+
+// Huge page size from /proc/meminfo, 0 if unknown
+inline size_t GetDefaultHugePageSize() {
+  std::ifstream meminfo("/proc/meminfo");
+  std::string key;
+  size_t value;
+  while (meminfo >> key) {
+    if (key == "Hugepagesize:" && meminfo >> value)
+      return value * 1024;
+    meminfo.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+  return 0;
+}
+
+
+// Apply the numa_node, populate and lock options to a fresh mapping. The NUMA
+// policy has to be set before the pages are faulted in.
+inline bool ApplySharedMemoryOptions(void *addr, const size_t map_size, const size_t page_size,
+                                     const SharedMemoryOptions &options) {
+  if (options.numa_node >= 0) {
+    const size_t kBitsPerLong = 8 * sizeof(unsigned long);
+    std::vector<unsigned long> node_mask(options.numa_node / kBitsPerLong + 1, 0);
+    node_mask[options.numa_node / kBitsPerLong] |= 1UL << (options.numa_node % kBitsPerLong);
+    EXP_CHK_ERRNO(syscall(SYS_mbind, addr, map_size, MPOL_BIND, node_mask.data(),
+                          node_mask.size() * kBitsPerLong + 1, MPOL_MF_MOVE) == 0, return false)
+  }
+  if (options.populate) {
+    bool populated = false;
+#ifdef MADV_POPULATE_WRITE
+    // Linux 5.14 and newer. Older kernels return EINVAL and we touch the pages instead.
+    populated = (madvise(addr, map_size, MADV_POPULATE_WRITE) == 0);
+#endif
+    if (!populated) {
+      // A read fault allocates the page for shmem and hugetlbfs mappings
+      const volatile uint8_t *byte_ptr = static_cast<const volatile uint8_t*>(addr);
+      for (size_t offset = 0; offset < map_size; offset += page_size)
+        (void)byte_ptr[offset];
+    }
+  }
+  if (options.lock) {
+    EXP_CHK_ERRNO(mlock(addr, map_size) == 0, return false)
+  }
+  return true;
+}
+
 #ifdef USE_SYS_V_SHM
 
 template <class DATA_T>
 class SharedMemory {
   private:
-    size_t shm_size_;
+    size_t shm_size_, map_size_;
     int shm_id_;
     bool is_init_, created_;
     struct shmid_ds shm_id_ds_;
@@ -47,13 +127,25 @@ class SharedMemory {
               const size_t shm_size,
               const bool try_create = true,
               const bool must_create = false,
-              const int shmflg = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH) {
+              const int shmflg = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH,
+              const SharedMemoryOptions &options = SharedMemoryOptions()) {
       EXP_CHK(!is_init_, return true)
       EXP_CHK_M(shm_key > 0, return false, "invalid shared memory key value")
       EXP_CHK_M(shm_size > 0, return false, "invalid shared memory size")
+      int page_flg = 0;
+      size_t page_size = sysconf(_SC_PAGESIZE);
+      if (options.huge_pages) {
+        page_size = (options.huge_page_size > 0) ? options.huge_page_size : GetDefaultHugePageSize();
+        EXP_CHK_M(page_size > 0 && (page_size & (page_size - 1)) == 0, return false, "invalid huge page size")
+        page_flg = SHM_HUGETLB;
+        if (options.huge_page_size > 0)
+          page_flg |= __builtin_ctzl(page_size) << SHM_HUGE_SHIFT;
+      }
+      // Huge page segments must be a multiple of the huge page size
+      const size_t map_size = (shm_size + page_size - 1) / page_size * page_size;
       created_ = false;
       if (try_create) {
-        shm_id_ = shmget(shm_key, shm_size, shmflg | IPC_CREAT | IPC_EXCL);
+        shm_id_ = shmget(shm_key, options.huge_pages ? map_size : shm_size, shmflg | page_flg | IPC_CREAT | IPC_EXCL);
         if (shm_id_ == -1 && (errno == EEXIST && must_create || errno != EEXIST)) {
           std::cerr << FL_STRM << "shmget() error. " << ERRNO_STRM << std::endl;
           return false;
@@ -62,14 +154,16 @@ class SharedMemory {
         created_ = (errno != EEXIST);
       }
       if (!created_) {
-        EXP_CHK_ERRNO((shm_id_ = shmget(shm_key, shm_size, shmflg)) != -1, return false)
+        EXP_CHK_ERRNO((shm_id_ = shmget(shm_key, shm_size, shmflg | page_flg)) != -1, return false)
       }
       shm_addr_void_ = shmat(shm_id_, NULL, 0);
       int *shmat_result = static_cast<int*>(shm_addr_void_);
       EXP_CHK_ERRNO(shmat_result != (int*)(-1), return false)
       shm_addr_ = reinterpret_cast<DATA_T*>(shm_addr_void_);
       shm_size_ = shm_size;
+      map_size_ = map_size;
       is_init_ = true;
+      EXP_CHK(ApplySharedMemoryOptions(shm_addr_void_, map_size_, page_size, options), Uninit(); return false)
       return true;
     }
 
@@ -79,11 +173,12 @@ class SharedMemory {
               const size_t shm_size,
               const bool try_create = true,
               const bool must_create = false,
-              const int shmflg = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH) {
+              const int shmflg = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH,
+              const SharedMemoryOptions &options = SharedMemoryOptions()) {
       key_t key;
       EXP_CHK(proj_id > 0, return false)
       EXP_CHK_ERRNO((key = ftok(file_name, proj_id)) != -1, return false)
-      return Init(key, shm_size, try_create, must_create, shmflg);
+      return Init(key, shm_size, try_create, must_create, shmflg, options);
     }
 
     bool Init(const std::string &file_name,
@@ -91,8 +186,9 @@ class SharedMemory {
               const size_t shm_size,
               const bool try_create = true,
               const bool must_create = false,
-              const int shmflg = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH) {
-      return Init(file_name.c_str(), proj_id, shm_size, try_create, must_create, shmflg);
+              const int shmflg = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH,
+              const SharedMemoryOptions &options = SharedMemoryOptions()) {
+      return Init(file_name.c_str(), proj_id, shm_size, try_create, must_create, shmflg, options);
     }
 
     bool Uninit() {
@@ -104,7 +200,20 @@ class SharedMemory {
       }
       is_init_ = created_ = false;
       shm_addr_void_ = shm_addr_ = nullptr;
-      shm_size_ = 0;
+      shm_size_ = map_size_ = 0;
+      return true;
+    }
+
+    // Remove a segment left behind by a creator that exited without Uninit().
+    // Processes that still attach it keep their mapping. Returns false if the
+    // segment does not exist.
+    static bool Unlink(const key_t shm_key) {
+      const int shm_id = shmget(shm_key, 0, 0);
+      if (shm_id == -1) {
+        EXP_CHK_ERRNO(errno == ENOENT, return false)
+        return false;
+      }
+      EXP_CHK_ERRNO(shmctl(shm_id, IPC_RMID, NULL) != -1, return false)
       return true;
     }
 
@@ -122,10 +231,10 @@ class SharedMemory {
 template <class DATA_T>
 class SharedMemory {
   private:
-    size_t shm_size_;
+    size_t shm_size_, map_size_;
     int shm_fd_;
     bool is_init_, created_;
-    std::string shm_name_;
+    std::string shm_name_, hugetlbfs_path_;
 
   public:
     void *shm_addr_void_;
@@ -151,14 +260,28 @@ class SharedMemory {
               const bool try_create = true,
               const bool must_create = false,
               const int oflag = O_RDWR,
-              const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH) {
+              const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH,
+              const SharedMemoryOptions &options = SharedMemoryOptions()) {
       EXP_CHK(!is_init_, return true)
       EXP_CHK_M(shm_name.size() > 0, return false, "invalid shared memory name")
       EXP_CHK_M(shm_size > 0, return false, "invalid shared memory size")
       EXP_CHK_M(shm_name[0] == '/', return false, "semaphore name must start with a /")
+      size_t page_size = sysconf(_SC_PAGESIZE);
+      hugetlbfs_path_ = "";
+      if (options.huge_pages) {
+        // hugetlbfs reports its page size as the block size
+        struct statfs fs_stat;
+        EXP_CHK_ERRNO_M(statfs(options.hugetlbfs_dir.c_str(), &fs_stat) == 0, return false,
+                        std::string("can not stat hugetlbfs mount ") + options.hugetlbfs_dir)
+        page_size = fs_stat.f_bsize;
+        hugetlbfs_path_ = options.hugetlbfs_dir + shm_name;
+      }
+      // hugetlbfs files must be a multiple of the huge page size
+      const size_t map_size = (shm_size + page_size - 1) / page_size * page_size;
       created_ = false;
       if (try_create) {
-        shm_fd_ = shm_open(shm_name.c_str(), O_CREAT | O_EXCL | oflag, mode);
+        shm_fd_ = hugetlbfs_path_.empty() ? shm_open(shm_name.c_str(), O_CREAT | O_EXCL | oflag, mode) :
+                                            open(hugetlbfs_path_.c_str(), O_CREAT | O_EXCL | oflag, mode);
         if (shm_fd_ == -1 && ((errno == EEXIST && must_create) || errno != EEXIST)) {
           std::cerr << FL_STRM << "shm_open() error. " << ERRNO_STRM << std::endl;
           return false;
@@ -167,30 +290,53 @@ class SharedMemory {
         created_ = (errno != EEXIST);
       }
       if (!created_) {
-        EXP_CHK_ERRNO((shm_fd_ = shm_open(shm_name.c_str(), oflag, 0)) != -1, return false)
+        EXP_CHK_ERRNO((shm_fd_ = hugetlbfs_path_.empty() ? shm_open(shm_name.c_str(), oflag, 0) :
+                                                           open(hugetlbfs_path_.c_str(), oflag)) != -1, return false)
       } else {
-        EXP_CHK_ERRNO(ftruncate(shm_fd_, shm_size) != -1, return false)
+        EXP_CHK_ERRNO(ftruncate(shm_fd_, hugetlbfs_path_.empty() ? shm_size : map_size) != -1, return false)
       }
-      EXP_CHK_ERRNO((shm_addr_void_ = mmap(NULL, shm_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd_, 0)) != MAP_FAILED, return false)
+      EXP_CHK_ERRNO((shm_addr_void_ = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, shm_fd_, 0)) != MAP_FAILED, return false)
       shm_addr_ = reinterpret_cast<DATA_T*>(shm_addr_void_);
       shm_size_ = shm_size;
+      map_size_ = map_size;
       is_init_ = true;
       shm_name_ = shm_name;
+      EXP_CHK(ApplySharedMemoryOptions(shm_addr_void_, map_size_, page_size, options), Uninit(); return false)
       return true;
     }
 
     bool Uninit() {
+      EXP_CHK(is_init_, return true)
+      EXP_CHK_ERRNO(munmap(shm_addr_void_, map_size_) == 0, return false)
+      EXP_CHK_ERRNO(close(shm_fd_) == 0, return false)
       // Only the creator should mark the shm for removal
       if (created_) {
-        EXP_CHK_ERRNO(shm_unlink(shm_name_.c_str()) != -1, return false)
+        if (hugetlbfs_path_.empty()) {
+          EXP_CHK_ERRNO(shm_unlink(shm_name_.c_str()) != -1, return false)
+        } else {
+          EXP_CHK_ERRNO(unlink(hugetlbfs_path_.c_str()) != -1, return false)
+        }
       }
       is_init_ = created_ = false;
       shm_addr_void_ = shm_addr_ = nullptr;
-      shm_size_ = 0;
-      shm_name_ = "";
+      shm_size_ = map_size_ = 0;
+      shm_name_ = hugetlbfs_path_ = "";
       return true;
     }
 
+    // Remove a segment left behind by a creator that exited without Uninit().
+    // Processes that still map it keep their mapping. Pass the options the
+    // segment was created with, a huge page segment lives in hugetlbfs_dir.
+    // Returns false if the segment does not exist.
+    static bool Unlink(const std::string &shm_name, const SharedMemoryOptions &options = SharedMemoryOptions()) {
+      const int result = options.huge_pages ? unlink((options.hugetlbfs_dir + shm_name).c_str()) :
+                                              shm_unlink(shm_name.c_str());
+      if (result == 0)
+        return true;
+      EXP_CHK_ERRNO(errno == ENOENT, return false)
+      return false;
+    }
+
     size_t GetSize() {
       return shm_size_;
     }
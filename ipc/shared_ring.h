@@ -0,0 +1,131 @@
+#ifndef __MIO_SHARED_RING_H__
+#define __MIO_SHARED_RING_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+/*
+Lock-free single-producer/single-consumer ring that is placed directly inside a
+mio::SharedMemory segment, eg.
+
+  typedef mio::SharedRing<Frame, 4> FrameRing;
+  mio::SharedMemory<FrameRing> shmem;
+  shmem.Init("/frame_ring", sizeof(FrameRing));
+
+  // Producer
+  Frame *frame = shmem.shm_addr_->Reserve();
+  if (frame != nullptr) {
+    FillFrame(frame);
+    shmem.shm_addr_->Commit();
+  }
+
+  // Consumer
+  const Frame *frame = shmem.shm_addr_->Peek();
+  if (frame != nullptr) {
+    UseFrame(frame);
+    shmem.shm_addr_->Release();
+  }
+
+Frames are written and read in place, so nothing is copied and, in steady state,
+no system call is made per frame. A new segment is zero filled by the OS, which
+is a valid empty ring, so no constructor has to run in shared memory. The head
+and tail indices sit on their own cache lines so the producer and consumer do
+not false share.
+*/
+
+#ifndef MIO_CACHE_LINE_SIZE
+#define MIO_CACHE_LINE_SIZE 64
+#endif
+
+namespace mio{
+
+template <class DATA_T, size_t N>
+class SharedRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SharedRing size must be a power of two");
+  static_assert(std::is_trivially_copyable<DATA_T>::value, "SharedRing data type must be trivially copyable");
+  static_assert(std::atomic<uint64_t>::is_always_lock_free, "SharedRing needs lock-free 64 bit atomics");
+
+  private:
+    // Producer cache line. cached_tail_ is the producer's last view of tail_.
+    alignas(MIO_CACHE_LINE_SIZE) std::atomic<uint64_t> head_;
+    uint64_t cached_tail_;
+    // Consumer cache line. cached_head_ is the consumer's last view of head_.
+    alignas(MIO_CACHE_LINE_SIZE) std::atomic<uint64_t> tail_;
+    uint64_t cached_head_;
+    alignas(MIO_CACHE_LINE_SIZE) DATA_T slots_[N];
+
+  public:
+    // Producer side. Returns the next free slot or nullptr if the ring is full.
+    // The slot is not visible to the consumer until Commit() is called.
+    DATA_T *Reserve() {
+      const uint64_t head = head_.load(std::memory_order_relaxed);
+      if (head - cached_tail_ == N) {
+        cached_tail_ = tail_.load(std::memory_order_acquire);
+        if (head - cached_tail_ == N)
+          return nullptr;
+      }
+      return &slots_[head & (N - 1)];
+    }
+
+    // Publish the slot returned by the last successful Reserve()
+    void Commit() {
+      head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Consumer side. Returns the oldest committed slot or nullptr if the ring is
+    // empty. The slot stays valid until Release() is called.
+    const DATA_T *Peek() {
+      const uint64_t tail = tail_.load(std::memory_order_relaxed);
+      if (tail == cached_head_) {
+        cached_head_ = head_.load(std::memory_order_acquire);
+        if (tail == cached_head_)
+          return nullptr;
+      }
+      return &slots_[tail & (N - 1)];
+    }
+
+    // Hand the slot returned by the last successful Peek() back to the producer
+    void Release() {
+      tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Copying convenience wrappers around Reserve()/Commit() and Peek()/Release()
+    bool Push(const DATA_T &item) {
+      DATA_T *slot = Reserve();
+      if (slot == nullptr)
+        return false;
+      *slot = item;
+      Commit();
+      return true;
+    }
+
+    bool Pop(DATA_T &item) {
+      const DATA_T *slot = Peek();
+      if (slot == nullptr)
+        return false;
+      item = *slot;
+      Release();
+      return true;
+    }
+
+    // Number of committed slots that have not been released. Exact only when
+    // called from the producer or consumer while the other side is idle.
+    size_t Size() const {
+      return static_cast<size_t>(head_.load(std::memory_order_acquire) -
+                                 tail_.load(std::memory_order_acquire));
+    }
+
+    bool Empty() const {
+      return Size() == 0;
+    }
+
+    static constexpr size_t Capacity() {
+      return N;
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_SHARED_RING_H__
@@ -0,0 +1,413 @@
+#ifndef __MIO_SHM_ARENA_H__
+#define __MIO_SHM_ARENA_H__
+
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "mio/altro/error.h"
+
+/*
+Named block allocator that lives at the start of a large shared memory segment
+(an arena). Blocks are identified by name and addressed by their byte offset
+from the start of the arena, so a block handle is valid in every process that
+maps the arena, wherever the mapping lands, eg.
+
+  mio::SharedMemory<uint8_t> shmem;
+  shmem.Init("/my_arena", 64*1024*1024);
+  mio::ShmArena arena;
+  arena.Format(shmem.shm_addr_, shmem.GetSize());  // creator only
+  uint64_t offset;
+  arena.Allocate("frame_buffer", 5*1024*1024, offset);
+
+  // Another process
+  arena.Attach(shmem.shm_addr_);
+  uint64_t offset, size;
+  if (arena.Find("frame_buffer", offset, size))
+    uint8_t *data = static_cast<uint8_t*>(arena.GetAddr(offset));
+
+The block table is guarded by a process-shared robust mutex, so a process that
+dies while holding it does not wedge the arena.
+
+Each block records its owner (the process that allocated it) and the readers
+that attached to it. Reclaim() frees blocks whose owner and readers have all
+exited, so blocks left behind by crashed processes do not accumulate. The pages
+of a freed block are handed back to the OS.
+*/
+
+namespace mio{
+
+const size_t kShmArenaMaxBlock = 256;
+const size_t kShmArenaNameLen = 64;  // including the terminating null
+const size_t kShmArenaAlign = 64;
+const size_t kShmArenaMaxReader = 16;
+
+// A process is identified by its pid and start time, so a recycled pid is not
+// mistaken for the process that used it before. A pid of 0 is a process that
+// is never considered dead.
+struct ShmArenaProcess {
+  int32_t pid;
+  uint64_t start_time;  // clock ticks after boot
+};
+
+struct ShmArenaBlock {
+  char name[kShmArenaNameLen];
+  uint64_t offset;  // from the start of the arena
+  uint64_t size;
+  ShmArenaProcess owner;
+  ShmArenaProcess readers[kShmArenaMaxReader];
+  uint32_t num_reader;
+  int64_t create_time, last_access_time;  // ms since the epoch
+};
+
+struct ShmArenaBlockInfo {
+  std::string name;
+  uint64_t offset, size;
+  pid_t owner_pid;
+  bool owner_alive;
+  size_t num_reader;  // live readers
+  int64_t create_time, last_access_time;  // ms since the epoch
+};
+
+
+// Start time of a process from /proc/<pid>/stat, 0 if it is unknown
+inline uint64_t GetProcessStartTime(const pid_t pid) {
+  std::ifstream stat_file("/proc/" + std::to_string(pid) + "/stat");
+  std::string stat_str;
+  if (!std::getline(stat_file, stat_str))
+    return 0;
+  // The command name (field 2) may contain spaces, the fields after it do
+  // not. Step from the space before field 3 to the space before field 22,
+  // the start time.
+  const size_t name_end = stat_str.rfind(')');
+  EXP_CHK(name_end != std::string::npos, return 0)
+  size_t pos = name_end + 1;
+  for (int field = 3; field < 22 && pos != std::string::npos; ++field)
+    pos = stat_str.find(' ', pos + 1);
+  return (pos == std::string::npos) ? 0 : std::strtoull(stat_str.c_str() + pos + 1, nullptr, 10);
+}
+
+inline ShmArenaProcess MakeShmArenaProcess(const pid_t pid) {
+  ShmArenaProcess process;
+  process.pid = pid;
+  process.start_time = (pid > 0) ? GetProcessStartTime(pid) : 0;
+  return process;
+}
+
+inline bool IsProcessAlive(const ShmArenaProcess &process) {
+  if (process.pid == 0)
+    return true;
+  // EPERM means the process exists but belongs to another user
+  if (kill(process.pid, 0) == -1 && errno == ESRCH)
+    return false;
+  const uint64_t start_time = GetProcessStartTime(process.pid);
+  return start_time == 0 || process.start_time == 0 || start_time == process.start_time;
+}
+
+inline int64_t GetShmArenaTime() {
+  return std::chrono::duration_cast<std::chrono::milliseconds>(
+             std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+struct ShmArenaHeader {
+  uint64_t magic;
+  uint64_t arena_size;
+  pthread_mutex_t mtx;
+  uint32_t num_block;
+  ShmArenaBlock blocks[kShmArenaMaxBlock];  // sorted by offset
+};
+
+
+// Locks an arena mutex for the current scope, recovering it if its previous
+// owner died while holding it.
+class ShmArenaLock {
+  private:
+    pthread_mutex_t *mtx_;
+
+  public:
+    explicit ShmArenaLock(pthread_mutex_t *mtx) : mtx_(mtx) {
+      const int rv = pthread_mutex_lock(mtx_);
+      if (rv == EOWNERDEAD)
+        pthread_mutex_consistent(mtx_);
+    }
+
+    ~ShmArenaLock() {
+      pthread_mutex_unlock(mtx_);
+    }
+};
+
+
+class ShmArena {
+  private:
+    ShmArenaHeader *header_;
+    uint8_t *base_;
+
+    static uint64_t AlignUp(const uint64_t value) {
+      return (value + kShmArenaAlign - 1) / kShmArenaAlign * kShmArenaAlign;
+    }
+
+    // Index of the named block, or -1. Caller holds the lock.
+    int FindIndex(const std::string &name) const {
+      for (uint32_t i = 0; i < header_->num_block; ++i) {
+        if (name == header_->blocks[i].name)
+          return static_cast<int>(i);
+      }
+      return -1;
+    }
+
+    // Hand the whole pages inside a freed block back to the OS. Caller holds
+    // the lock.
+    void ReleasePages(const ShmArenaBlock &block) {
+      const uint64_t page_size = sysconf(_SC_PAGESIZE);
+      const uint64_t begin = (block.offset + page_size - 1) / page_size * page_size;
+      const uint64_t end = (block.offset + block.size) / page_size * page_size;
+      if (end > begin)
+        madvise(base_ + begin, end - begin, MADV_REMOVE);
+    }
+
+    // Caller holds the lock
+    void RemoveIndex(const uint32_t idx) {
+      ReleasePages(header_->blocks[idx]);
+      memmove(&header_->blocks[idx], &header_->blocks[idx + 1],
+              (header_->num_block - idx - 1) * sizeof(ShmArenaBlock));
+      --header_->num_block;
+    }
+
+    // Drop readers that exited. Caller holds the lock.
+    static void PruneReaders(ShmArenaBlock &block) {
+      uint32_t num_live = 0;
+      for (uint32_t i = 0; i < block.num_reader; ++i) {
+        if (IsProcessAlive(block.readers[i]))
+          block.readers[num_live++] = block.readers[i];
+      }
+      block.num_reader = num_live;
+    }
+
+  public:
+    static const uint64_t kMagic = 0x326e6572616f696d;  // "mioaren2"
+
+    ShmArena() : header_(nullptr), base_(nullptr) {}
+
+    // First usable offset in an arena
+    static uint64_t GetDataOffset() {
+      return AlignUp(sizeof(ShmArenaHeader));
+    }
+
+    // Lay out an empty arena at addr. Only the process that created the segment
+    // should call this, before anyone else attaches.
+    bool Format(void *addr, const size_t arena_size) {
+      EXP_CHK(addr != nullptr, return false)
+      EXP_CHK_M(arena_size > GetDataOffset(), return false, "arena is too small for its block table")
+      header_ = static_cast<ShmArenaHeader*>(addr);
+      base_ = static_cast<uint8_t*>(addr);
+      memset(header_, 0, sizeof(ShmArenaHeader));
+      pthread_mutexattr_t attr;
+      EXP_CHK(pthread_mutexattr_init(&attr) == 0, return false)
+      pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+      pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+      const int rv = pthread_mutex_init(&header_->mtx, &attr);
+      pthread_mutexattr_destroy(&attr);
+      EXP_CHK_M(rv == 0, return false, std::strerror(rv))
+      header_->arena_size = arena_size;
+      header_->magic = kMagic;
+      return true;
+    }
+
+    // Use an arena formatted by another process
+    bool Attach(void *addr) {
+      EXP_CHK(addr != nullptr, return false)
+      ShmArenaHeader *header = static_cast<ShmArenaHeader*>(addr);
+      EXP_CHK_M(header->magic == kMagic, return false, "memory does not hold a formatted arena")
+      header_ = header;
+      base_ = static_cast<uint8_t*>(addr);
+      return true;
+    }
+
+    bool IsInit() const {
+      return header_ != nullptr;
+    }
+
+    // First fit allocation. Fails if the name is taken or there is no gap
+    // large enough. owner_pid is the process the block belongs to, 0 for a
+    // block that is never reclaimed.
+    bool Allocate(const std::string &name, const size_t size, uint64_t &offset, const pid_t owner_pid = getpid()) {
+      EXP_CHK(IsInit(), return false)
+      EXP_CHK_M(!name.empty() && name.size() < kShmArenaNameLen, return false, "invalid block name: " + name)
+      EXP_CHK(size > 0, return false)
+      ShmArenaLock lock(&header_->mtx);
+      EXP_CHK_M(FindIndex(name) == -1, return false, "block exists: " + name)
+      if (header_->num_block == kShmArenaMaxBlock)
+        return false;
+      uint64_t gap_begin = GetDataOffset();
+      uint32_t idx = 0;
+      for (; idx <= header_->num_block; ++idx) {
+        const uint64_t gap_end = (idx < header_->num_block) ? header_->blocks[idx].offset : header_->arena_size;
+        if (gap_end >= gap_begin && gap_end - gap_begin >= size)
+          break;
+        if (idx < header_->num_block)
+          gap_begin = AlignUp(header_->blocks[idx].offset + header_->blocks[idx].size);
+      }
+      if (idx > header_->num_block)
+        return false;
+      memmove(&header_->blocks[idx + 1], &header_->blocks[idx], (header_->num_block - idx) * sizeof(ShmArenaBlock));
+      ShmArenaBlock &block = header_->blocks[idx];
+      memset(&block, 0, sizeof(ShmArenaBlock));
+      strncpy(block.name, name.c_str(), kShmArenaNameLen - 1);
+      block.offset = offset = gap_begin;
+      block.size = size;
+      block.owner = MakeShmArenaProcess(owner_pid);
+      block.create_time = block.last_access_time = GetShmArenaTime();
+      ++header_->num_block;
+      return true;
+    }
+
+    bool Find(const std::string &name, uint64_t &offset, uint64_t &size) {
+      EXP_CHK(IsInit(), return false)
+      ShmArenaLock lock(&header_->mtx);
+      const int idx = FindIndex(name);
+      if (idx == -1)
+        return false;
+      offset = header_->blocks[idx].offset;
+      size = header_->blocks[idx].size;
+      return true;
+    }
+
+    bool Free(const std::string &name) {
+      EXP_CHK(IsInit(), return false)
+      ShmArenaLock lock(&header_->mtx);
+      const int idx = FindIndex(name);
+      if (idx == -1)
+        return false;
+      RemoveIndex(idx);
+      return true;
+    }
+
+    // Record that another process uses the block. Fails if the block does not
+    // exist or it has kShmArenaMaxReader live readers.
+    bool AttachReader(const std::string &name, const pid_t pid = getpid()) {
+      EXP_CHK(IsInit(), return false)
+      ShmArenaLock lock(&header_->mtx);
+      const int idx = FindIndex(name);
+      if (idx == -1)
+        return false;
+      ShmArenaBlock &block = header_->blocks[idx];
+      block.last_access_time = GetShmArenaTime();
+      if (pid == block.owner.pid)
+        return true;
+      for (uint32_t i = 0; i < block.num_reader; ++i) {
+        if (block.readers[i].pid == pid)
+          return true;
+      }
+      if (block.num_reader == kShmArenaMaxReader)
+        PruneReaders(block);
+      EXP_CHK_M(block.num_reader < kShmArenaMaxReader, return false, "too many readers for block " + name)
+      block.readers[block.num_reader++] = MakeShmArenaProcess(pid);
+      return true;
+    }
+
+    bool DetachReader(const std::string &name, const pid_t pid = getpid()) {
+      EXP_CHK(IsInit(), return false)
+      ShmArenaLock lock(&header_->mtx);
+      const int idx = FindIndex(name);
+      if (idx == -1)
+        return false;
+      ShmArenaBlock &block = header_->blocks[idx];
+      for (uint32_t i = 0; i < block.num_reader; ++i) {
+        if (block.readers[i].pid == pid) {
+          block.readers[i] = block.readers[--block.num_reader];
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Update the last access time of a block
+    bool Touch(const std::string &name) {
+      EXP_CHK(IsInit(), return false)
+      ShmArenaLock lock(&header_->mtx);
+      const int idx = FindIndex(name);
+      if (idx == -1)
+        return false;
+      header_->blocks[idx].last_access_time = GetShmArenaTime();
+      return true;
+    }
+
+    // Free every block whose owner and readers have all exited. Returns the
+    // number of blocks freed and appends their names to reclaimed_names.
+    size_t Reclaim(std::vector<std::string> *reclaimed_names = nullptr) {
+      EXP_CHK(IsInit(), return 0)
+      ShmArenaLock lock(&header_->mtx);
+      size_t num_reclaimed = 0;
+      for (uint32_t i = 0; i < header_->num_block;) {
+        ShmArenaBlock &block = header_->blocks[i];
+        PruneReaders(block);
+        if (block.num_reader == 0 && !IsProcessAlive(block.owner)) {
+          if (reclaimed_names != nullptr)
+            reclaimed_names->push_back(block.name);
+          RemoveIndex(i);
+          ++num_reclaimed;
+        } else {
+          ++i;
+        }
+      }
+      return num_reclaimed;
+    }
+
+    // Appends a description of every block to block_info_vec
+    bool GetInventory(std::vector<ShmArenaBlockInfo> &block_info_vec) {
+      EXP_CHK(IsInit(), return false)
+      ShmArenaLock lock(&header_->mtx);
+      for (uint32_t i = 0; i < header_->num_block; ++i) {
+        ShmArenaBlock &block = header_->blocks[i];
+        PruneReaders(block);
+        ShmArenaBlockInfo info;
+        info.name = block.name;
+        info.offset = block.offset;
+        info.size = block.size;
+        info.owner_pid = block.owner.pid;
+        info.owner_alive = IsProcessAlive(block.owner);
+        info.num_reader = block.num_reader;
+        info.create_time = block.create_time;
+        info.last_access_time = block.last_access_time;
+        block_info_vec.push_back(info);
+      }
+      return true;
+    }
+
+    void *GetAddr(const uint64_t offset) const {
+      EXP_CHK(IsInit() && offset < header_->arena_size, return nullptr)
+      return base_ + offset;
+    }
+
+    size_t GetArenaSize() const {
+      return IsInit() ? header_->arena_size : 0;
+    }
+
+    size_t GetNumBlock() {
+      EXP_CHK(IsInit(), return 0)
+      ShmArenaLock lock(&header_->mtx);
+      return header_->num_block;
+    }
+
+    // Total free bytes, which may be split over several gaps
+    size_t GetFreeSize() {
+      EXP_CHK(IsInit(), return 0)
+      ShmArenaLock lock(&header_->mtx);
+      size_t used = GetDataOffset();
+      for (uint32_t i = 0; i < header_->num_block; ++i)
+        used += AlignUp(header_->blocks[i].size);
+      return (header_->arena_size > used) ? header_->arena_size - used : 0;
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_SHM_ARENA_H__
@@ -0,0 +1,78 @@
+#include "mio/ipc/shared_mem.h"
+#include "mio/ipc/shared_broadcast_ring.h"
+#include <chrono>
+#include <thread>
+
+struct Frame {
+  uint64_t frame_num;
+  uint8_t data[64*1024];
+};
+typedef mio::SharedBroadcastRing<Frame, 8> FrameRing;
+
+
+// The consumer holds every 16th frame for longer than the producer takes to
+// fill the ring, so it is lapped over and over. Every frame it releases intact
+// must be whole, and the frames it never saw must add up to its skip count.
+// Run the consumer (argv[1] == 1) first, then the producer (argv[1] == 0).
+int main(int argc, char *argv[]) {
+  EXP_CHK(argc == 2, return(-1))
+
+  const bool is_producer = (atoi(argv[1]) == 0);
+  // The consumer starts from an empty ring, left over segments are not zero filled
+  if (!is_producer)
+    mio::SharedMemory<FrameRing>::Unlink("/shared_broadcast_ring_test");
+  mio::SharedMemory<FrameRing> shmem;
+  EXP_CHK(shmem.Init("/shared_broadcast_ring_test", sizeof(FrameRing)), return -1);
+  FrameRing *ring = shmem.shm_addr_;
+
+  const uint64_t kNumFrame = 5000;
+  if (is_producer) {
+    // Producer
+    for (uint64_t i = 1; i <= kNumFrame; ++i) {
+      Frame *frame = ring->Reserve();
+      frame->frame_num = i;
+      frame->data[0] = frame->data[sizeof(frame->data) - 1] = static_cast<uint8_t>(i);
+      ring->Commit();
+      std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+    std::cout << "published " << ring->GetPublishCount() << " frames\n";
+  }
+  else {
+    // Consumer
+    const int reader_id = ring->AttachReader();
+    EXP_CHK(reader_id >= 0, return -1)
+    uint64_t last_frame_num = 0, num_intact = 0, num_missed = 0, num_overwritten = 0;
+    while (ring->GetPublishCount() < kNumFrame || ring->GetLag(reader_id) > 0) {
+      const Frame *frame = ring->Peek(reader_id);
+      if (frame == nullptr) {
+        std::this_thread::yield();
+        continue;
+      }
+      const uint64_t frame_num = frame->frame_num;
+      if (frame_num % 16 == 0)
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+      const bool is_whole = frame->data[0] == static_cast<uint8_t>(frame_num) &&
+                            frame->data[sizeof(frame->data) - 1] == static_cast<uint8_t>(frame_num);
+      if (!ring->Release(reader_id)) {
+        ++num_overwritten;
+        continue;
+      }
+      EXP_CHK(is_whole, return -1)
+      EXP_CHK(frame_num > last_frame_num, return -1)
+      num_missed += frame_num - last_frame_num - 1;
+      last_frame_num = frame_num;
+      ++num_intact;
+    }
+    num_missed += kNumFrame - last_frame_num;
+    const uint64_t num_read = ring->GetReadCount(reader_id), num_skipped = ring->GetSkipCount(reader_id);
+    std::cout << "read " << num_read << " frames, skipped " << num_skipped << " (" << num_overwritten
+              << " overwritten while held)\n";
+    EXP_CHK(num_read == num_intact && num_read + num_skipped == kNumFrame, return -1)
+    EXP_CHK(num_skipped == num_missed && num_skipped > 0, return -1)
+    ring->DetachReader(reader_id);
+  }
+
+  shmem.Uninit();
+
+  return 0;
+}
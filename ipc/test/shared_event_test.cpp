@@ -0,0 +1,57 @@
+#include "mio/ipc/shared_mem.h"
+#include "mio/ipc/shared_event.h"
+#include <chrono>
+#include <algorithm>
+#include <vector>
+
+typedef std::chrono::steady_clock std_sc_t;
+
+struct PingPong {
+  mio::SharedEvent ping, pong;
+  std_sc_t::time_point stamp;
+  int32_t count;
+};
+
+
+// Measures one-way wake up latency through a SharedEvent. Run the consumer
+// (argv[1] == 1) first, then the producer (argv[1] == 0).
+int main(int argc, char *argv[]) {
+  EXP_CHK(argc == 2, return(-1))
+
+  mio::SharedMemory<PingPong> shmem;
+  EXP_CHK(shmem.Init("/shared_event_test", sizeof(PingPong)), return -1);
+  PingPong *pp = shmem.shm_addr_;
+
+  const int kIterationCount = 10000;
+  if (atoi(argv[1]) == 0) {
+    // Producer
+    for (int i = 1; i <= kIterationCount; ++i) {
+      const uint32_t pong_seq = pp->pong.GetSeq();
+      pp->count = i;
+      pp->stamp = std_sc_t::now();
+      pp->ping.Notify();
+      EXP_CHK(pp->pong.WaitFor(pong_seq, std::chrono::seconds(1)), return -1)
+    }
+  }
+  else {
+    // Consumer
+    std::vector<int64_t> ns_vec;
+    ns_vec.reserve(kIterationCount);
+    uint32_t ping_seq = pp->ping.GetSeq();
+    for (int i = 1; i <= kIterationCount; ++i) {
+      pp->ping.Wait(ping_seq);
+      ping_seq = pp->ping.GetSeq();
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std_sc_t::now() - pp->stamp);
+      ns_vec.push_back(ns.count());
+      EXP_CHK(pp->count == i, return -1)
+      pp->pong.Notify();
+    }
+    std::sort(ns_vec.begin(), ns_vec.end());
+    std::cout << "wake up latency p50: " << ns_vec[ns_vec.size()/2] << " ns, p99: "
+              << ns_vec[ns_vec.size()*99/100] << " ns\n";
+  }
+
+  shmem.Uninit();
+
+  return 0;
+}
@@ -0,0 +1,73 @@
+#include "mio/ipc/shared_frame_pool.h"
+#include <chrono>
+#include <thread>
+
+const int kRows = 1080, kCols = 1920, kNumFrame = 300;
+const int kIdleMs = 1000;  // the reader stops after this long without a new frame
+
+
+// A frame is intact if every pixel still holds the value it was published with
+static bool FrameIntact(const cv::Mat &frame, const uint8_t value) {
+  for (int r = 0; r < frame.rows; ++r) {
+    const uint8_t *row_ptr = frame.ptr<uint8_t>(r);
+    for (int c = 0; c < frame.cols*frame.channels(); ++c)
+      if (row_ptr[c] != value)
+        return false;
+  }
+  return true;
+}
+
+
+// Start the reader first: shared_frame_pool_test 1, then the writer: shared_frame_pool_test 0
+// The reader holds each frame while the writer keeps publishing, and checks that
+// the frame was not overwritten underneath it. Frames are filled with the low
+// byte of their sequence number.
+int main(int argc, char *argv[]) {
+  EXP_CHK(argc == 2, return -1)
+  mio::SharedFramePool pool;
+  EXP_CHK(pool.Init("/shared_frame_pool_test", 4, kRows*kCols*3), return -1)
+
+  if (atoi(argv[1]) == 0) {
+    // Writer
+    cv::Mat img(kRows, kCols, CV_8UC3);
+    size_t num_dropped = 0;
+    for (int i = 1; i <= kNumFrame; ++i) {
+      mio::SharedFrameWriteLease frame = pool.AcquireWrite(kRows, kCols, CV_8UC3);
+      if (frame.Empty()) {
+        ++num_dropped;  // every slot is leased
+        continue;
+      }
+      // Single writer, so the frame gets the next sequence number
+      memset(frame.GetMat().data, (pool.GetLatestSeq() + 1) % 256, kRows*kCols*3);
+      frame.Commit();
+      std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    std::cout << "published " << kNumFrame - num_dropped << " frames, dropped " << num_dropped << "\n";
+  } else {
+    // Reader
+    uint64_t last_seq = 0;
+    size_t num_read = 0, num_bad = 0;
+    std::chrono::steady_clock::time_point last_time;
+    for (;;) {
+      mio::SharedFrameLease frame = pool.AcquireLatest(last_seq);
+      if (frame.Empty()) {
+        if (num_read > 0 && std::chrono::steady_clock::now() - last_time > std::chrono::milliseconds(kIdleMs))
+          break;  // the writer is done
+        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        continue;
+      }
+      last_seq = frame.GetSeq();
+      const uint8_t value = frame.GetMat().data[0];
+      // Hold the frame across several writer publishes
+      std::this_thread::sleep_for(std::chrono::milliseconds(5));
+      if (!FrameIntact(frame.GetMat(), value) || value != last_seq % 256)
+        ++num_bad;
+      ++num_read;
+      last_time = std::chrono::steady_clock::now();
+    }
+    std::cout << "read " << num_read << " frames, " << num_bad << " overwritten while leased\n";
+  }
+
+  pool.Uninit();
+  return 0;
+}
@@ -0,0 +1,66 @@
+#include "mio/ipc/shared_mem.h"
+#include "mio/ipc/shared_latest.h"
+#include <chrono>
+#include <thread>
+
+// Large enough that a Store() and a Load() overlap often
+struct State {
+  uint64_t version;
+  uint64_t val[511];
+};
+typedef mio::SharedLatest<State> StateSlot;
+
+
+// The producer stores as fast as it can, every field of value i set to i. The
+// consumer loads in a tight loop and counts the loads whose fields disagree
+// (a torn read) or whose version went backwards. Run the consumer
+// (argv[1] == 1) first, then the producer (argv[1] == 0).
+int main(int argc, char *argv[]) {
+  EXP_CHK(argc == 2, return(-1))
+
+  const bool is_producer = (atoi(argv[1]) == 0);
+  // The consumer starts from an empty slot, left over segments are not zero filled
+  if (!is_producer)
+    mio::SharedMemory<StateSlot>::Unlink("/shared_latest_test");
+  mio::SharedMemory<StateSlot> shmem;
+  EXP_CHK(shmem.Init("/shared_latest_test", sizeof(StateSlot)), return -1);
+  StateSlot *slot = shmem.shm_addr_;
+
+  const uint64_t kNumStore = 1000000;
+  if (is_producer) {
+    // Producer
+    State state;
+    for (uint64_t i = 1; i <= kNumStore; ++i) {
+      state.version = i;
+      for (uint64_t &val : state.val)
+        val = i;
+      slot->Store(state);
+    }
+    std::cout << "stored " << slot->GetVersion() << " values\n";
+  }
+  else {
+    // Consumer
+    State state;
+    uint64_t version = 0, last_version = 0, num_load = 0, num_version = 0, num_torn = 0;
+    while (version < kNumStore) {
+      if (!slot->Load(state, &version)) {
+        std::this_thread::yield();
+        continue;
+      }
+      ++num_load;
+      bool is_torn = (state.version != version);
+      for (const uint64_t val : state.val)
+        is_torn = is_torn || (val != version);
+      num_torn += is_torn ? 1 : 0;
+      EXP_CHK(version >= last_version, return -1)
+      num_version += (version != last_version) ? 1 : 0;
+      last_version = version;
+    }
+    std::cout << num_load << " loads saw " << num_version << " versions, " << num_torn << " torn\n";
+    EXP_CHK(num_torn == 0, return -1)
+  }
+
+  shmem.Uninit();
+
+  return 0;
+}
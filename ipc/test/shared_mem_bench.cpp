@@ -0,0 +1,86 @@
+#include "mio/ipc/shared_mem.h"
+#include <sys/resource.h>
+#include <chrono>
+#include <iomanip>
+#include <vector>
+
+typedef std::chrono::steady_clock std_sc_t;
+
+struct BenchMode {
+  const char *name;
+  mio::SharedMemoryOptions options;
+};
+
+
+static long GetPageFaults() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_minflt + usage.ru_majflt;
+}
+
+
+static double Seconds(const std_sc_t::time_point start) {
+  return std::chrono::duration<double>(std_sc_t::now() - start).count();
+}
+
+
+// Reports page faults and copy bandwidth of a SharedMemory segment for each
+// mapping mode. Usage: shared_mem_bench [segment size in MB] [numa node]
+// Huge page modes need reserved huge pages, eg. 'echo 128 > /proc/sys/vm/nr_hugepages'
+int main(int argc, char *argv[]) {
+  const size_t kShmSize = ((argc > 1) ? static_cast<size_t>(atol(argv[1])) : 200) * 1024 * 1024;
+  const int kNumaNode = (argc > 2) ? atoi(argv[2]) : 0;
+  const int kNumCopy = 10;
+
+  std::vector<BenchMode> modes(6);
+  modes[0].name = "default";
+  modes[1].name = "populate";
+  modes[1].options.populate = true;
+  modes[2].name = "populate+lock";
+  modes[2].options.populate = modes[2].options.lock = true;
+  modes[3].name = "populate+numa";
+  modes[3].options.populate = true;
+  modes[3].options.numa_node = kNumaNode;
+  modes[4].name = "huge";
+  modes[4].options.huge_pages = true;
+  modes[5].name = "huge+populate";
+  modes[5].options.huge_pages = modes[5].options.populate = true;
+
+  std::vector<uint8_t> src(kShmSize, 33);
+  std::cout << std::left << std::setw(16) << "mode" << std::right << std::setw(12) << "init ms"
+            << std::setw(14) << "init faults" << std::setw(14) << "touch faults" << std::setw(14) << "first GB/s"
+            << std::setw(14) << "steady GB/s\n";
+  for (const BenchMode &mode : modes) {
+    mio::SharedMemory<uint8_t> shmem;
+    long faults = GetPageFaults();
+    // A segment left behind by an aborted run would fail the create
+    mio::SharedMemory<uint8_t>::Unlink("/shared_mem_bench");
+    std_sc_t::time_point start = std_sc_t::now();
+    if (!shmem.Init("/shared_mem_bench", kShmSize, true, true, O_RDWR,
+                    S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH, mode.options)) {
+      std::cout << std::left << std::setw(16) << mode.name << "unavailable\n";
+      continue;
+    }
+    const double init_sec = Seconds(start);
+    const long init_faults = GetPageFaults() - faults;
+
+    // The first copy pays for any page that was not faulted in by Init()
+    faults = GetPageFaults();
+    start = std_sc_t::now();
+    memcpy(shmem.shm_addr_, src.data(), kShmSize);
+    const double first_sec = Seconds(start);
+    const long touch_faults = GetPageFaults() - faults;
+
+    start = std_sc_t::now();
+    for (int i = 0; i < kNumCopy; ++i)
+      memcpy(shmem.shm_addr_, src.data(), kShmSize);
+    const double steady_sec = Seconds(start) / kNumCopy;
+
+    std::cout << std::left << std::setw(16) << mode.name << std::right << std::fixed << std::setprecision(2)
+              << std::setw(12) << init_sec*1e3 << std::setw(14) << init_faults << std::setw(14) << touch_faults
+              << std::setw(14) << kShmSize/first_sec/1e9 << std::setw(13) << kShmSize/steady_sec/1e9 << "\n";
+    shmem.Uninit();
+  }
+
+  return 0;
+}
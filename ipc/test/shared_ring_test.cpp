@@ -0,0 +1,70 @@
+#include "mio/ipc/shared_mem.h"
+#include "mio/ipc/shared_ring.h"
+#include <chrono>
+#include <thread>
+
+typedef std::chrono::high_resolution_clock std_hrc_t;
+
+// 5 MP mono frame
+struct Frame {
+  uint64_t frame_num;
+  std_hrc_t::time_point stamp;
+  uint8_t data[2592*1944];
+};
+typedef mio::SharedRing<Frame, 4> FrameRing;
+
+
+// Run the consumer (argv[1] == 1) first, then the producer (argv[1] == 0).
+int main(int argc, char *argv[]) {
+  EXP_CHK(argc == 2, return(-1))
+
+  mio::SharedMemory<FrameRing> shmem;
+  EXP_CHK(shmem.Init("/shared_ring_test", sizeof(FrameRing)), return -1);
+  FrameRing *ring = shmem.shm_addr_;
+
+  const uint64_t kNumFrame = 1000;
+  if (atoi(argv[1]) == 0) {
+    // Producer
+    std_hrc_t::time_point start = std_hrc_t::now();
+    for (uint64_t i = 1; i <= kNumFrame;) {
+      Frame *frame = ring->Reserve();
+      if (frame == nullptr) {
+        std::this_thread::yield();
+        continue;
+      }
+      frame->frame_num = i;
+      frame->data[0] = frame->data[sizeof(frame->data) - 1] = static_cast<uint8_t>(i);
+      frame->stamp = std_hrc_t::now();
+      ring->Commit();
+      ++i;
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std_hrc_t::now() - start);
+    std::cout << "sent " << kNumFrame << " frames in " << ms.count() << " ms\n";
+    // Keep the segment mapped until the consumer drains the ring
+    while (!ring->Empty())
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  else {
+    // Consumer
+    uint64_t expected_frame_num = 1, total_ns = 0;
+    while (expected_frame_num <= kNumFrame) {
+      const Frame *frame = ring->Peek();
+      if (frame == nullptr) {
+        std::this_thread::yield();
+        continue;
+      }
+      auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std_hrc_t::now() - frame->stamp);
+      total_ns += ns.count();
+      EXP_CHK(frame->frame_num == expected_frame_num, return -1)
+      EXP_CHK(frame->data[0] == static_cast<uint8_t>(expected_frame_num), return -1)
+      EXP_CHK(frame->data[sizeof(frame->data) - 1] == static_cast<uint8_t>(expected_frame_num), return -1)
+      ring->Release();
+      ++expected_frame_num;
+    }
+    std::cout << "received " << kNumFrame << " frames, mean latency: " << total_ns/kNumFrame << " ns\n";
+  }
+
+  shmem.Uninit();
+
+  return 0;
+}
@@ -0,0 +1,289 @@
+#ifndef __MIO_LCM_DISPATCH_H__
+#define __MIO_LCM_DISPATCH_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <lcm/lcm.h>
+#include "mio/altro/error.h"
+#include "mio/lcm/lcm_type_traits.h"
+
+/*
+Runs LCM subscription handlers on a pool of worker threads instead of on the
+thread that calls lcm_handle(), so a slow handler does not hold up the other
+channels or let the UDP socket overflow, eg.
+
+  LCMHandlerThread lcm_thread(lcm);  // or mio::AddLcmToEventLoop()
+  mio::LcmDispatcher dispatcher(lcm, 4);
+  dispatcher.Subscribe<lcm_opencv_mat_t>("CAMERA_0", [](const lcm_opencv_mat_t &msg, const std::string &channel){
+    ...  // eg. RANSAC on the full frame
+  }, mio::LcmChannelPolicy::KeepLatest());
+  dispatcher.Subscribe<lcm_int_t>("STATUS", ...);
+  dispatcher.Start();
+  lcm_thread.Start();
+
+The receive thread only copies the encoded message into the channel's
+bounded queue, decoding happens on the worker. When the queue is full the
+channel either drops its oldest message or blocks the receive thread (which
+holds up every channel of that lcm_t) until a worker makes room. Handlers of
+an ordered channel run one at a time in arrival order, handlers of an
+unordered channel can run on several workers at once.
+
+Message types are decoded through LcmTypeTraits (see lcm_type_traits.h).
+*/
+
+
+namespace mio{
+
+struct LcmChannelPolicy{
+  enum Overflow{
+    kDropOldest = 0,
+    kBlock
+  };
+
+  size_t queue_capacity; // messages held for the workers before overflow applies
+  Overflow overflow;
+  bool ordered;
+
+  LcmChannelPolicy(const size_t queue_capacity_ = 16, const Overflow overflow_ = kDropOldest,
+                   const bool ordered_ = true) :
+      queue_capacity(queue_capacity_), overflow(overflow_), ordered(ordered_){}
+
+  // For video, where only the newest frame is worth handling
+  static LcmChannelPolicy KeepLatest(){
+    return LcmChannelPolicy(1, kDropOldest, true);
+  }
+};
+
+
+class LcmDispatcher{
+  struct RawMsg{
+    std::vector<uint8_t> data;
+    std::string channel;
+    int64_t recv_utime;
+  };
+
+  struct Channel{
+    LcmDispatcher *dispatcher;
+    std::string channel_name;
+    LcmChannelPolicy policy;
+    lcm_subscription_t *sub;
+    std::function<void(const RawMsg&)> run; // decodes and calls the typed handler
+    std::mutex mtx; // guards everything below
+    std::condition_variable not_full_cv;
+    std::deque<RawMsg> queue;
+    std::vector< std::vector<uint8_t> > spare_buf_vec; // recycled so steady state does not allocate
+    // Entries in the ready queue, at most one per queued message. An ordered
+    // channel has at most one, and it counts while its message is handled.
+    size_t num_scheduled;
+    uint64_t num_dropped, num_handled;
+  };
+
+  lcm_t *lcm_;
+  size_t num_thread_;
+  std::mutex channel_mtx_; // guards channel_vec_
+  std::vector< std::unique_ptr<Channel> > channel_vec_;
+  std::mutex ready_mtx_;
+  std::condition_variable ready_cv_;
+  std::deque<Channel*> ready_queue_; // bounded by the channels' queue capacities
+  std::atomic<bool> exit_flag_;
+  std::vector<std::thread> worker_vec_;
+
+  void Schedule(Channel *chan){
+    {
+      std::lock_guard<std::mutex> lock(ready_mtx_);
+      ready_queue_.push_back(chan);
+    }
+    ready_cv_.notify_one();
+  }
+
+  // Caller holds chan->mtx
+  static void Recycle(Channel *chan, std::vector<uint8_t> &buf){
+    if(chan->spare_buf_vec.size() < chan->policy.queue_capacity)
+      chan->spare_buf_vec.push_back(std::move(buf));
+  }
+
+  static void OnMessage(const lcm_recv_buf_t *rbuf, const char *channel, void *userdata){
+    Channel *chan = static_cast<Channel*>(userdata);
+    chan->dispatcher->Push(chan, rbuf, channel);
+  }
+
+  void Push(Channel *chan, const lcm_recv_buf_t *rbuf, const char *channel){
+    std::unique_lock<std::mutex> lock(chan->mtx);
+    if(chan->queue.size() >= chan->policy.queue_capacity){
+      if(chan->policy.overflow == LcmChannelPolicy::kBlock){
+        chan->not_full_cv.wait(lock, [&](){ return exit_flag_ || chan->queue.size() < chan->policy.queue_capacity; });
+        if(exit_flag_){
+          ++chan->num_dropped;
+          return;
+        }
+      }
+      else{
+        Recycle(chan, chan->queue.front().data);
+        chan->queue.pop_front();
+        ++chan->num_dropped;
+      }
+    }
+
+    RawMsg msg;
+    if( !chan->spare_buf_vec.empty() ){
+      msg.data = std::move(chan->spare_buf_vec.back());
+      chan->spare_buf_vec.pop_back();
+    }
+    const uint8_t *data = static_cast<const uint8_t*>(rbuf->data);
+    msg.data.assign(data, data + rbuf->data_size);
+    msg.channel = channel;
+    msg.recv_utime = rbuf->recv_utime;
+    chan->queue.push_back(std::move(msg));
+
+    // A dropped message leaves its entry for the newer one, so the ready
+    // queue stays bounded while the workers are stopped or behind
+    const bool schedule = chan->policy.ordered ? chan->num_scheduled == 0
+                                               : chan->num_scheduled < chan->queue.size();
+    if(schedule)
+      ++chan->num_scheduled;
+    lock.unlock();
+    if(schedule)
+      Schedule(chan);
+  }
+
+  void WorkerThread(){
+    for(;;){
+      Channel *chan;
+      {
+        std::unique_lock<std::mutex> lock(ready_mtx_);
+        ready_cv_.wait(lock, [this](){ return exit_flag_ || !ready_queue_.empty(); });
+        if(exit_flag_)
+          return;
+        chan = ready_queue_.front();
+        ready_queue_.pop_front();
+      }
+
+      RawMsg msg;
+      {
+        std::lock_guard<std::mutex> lock(chan->mtx);
+        if( chan->queue.empty() ){
+          --chan->num_scheduled;
+          continue;
+        }
+        msg = std::move(chan->queue.front());
+        chan->queue.pop_front();
+        if(!chan->policy.ordered)
+          --chan->num_scheduled;
+      }
+      chan->not_full_cv.notify_one();
+
+      chan->run(msg);
+
+      bool schedule = false;
+      {
+        std::lock_guard<std::mutex> lock(chan->mtx);
+        ++chan->num_handled;
+        Recycle(chan, msg.data);
+        if(chan->policy.ordered){
+          schedule = !chan->queue.empty();
+          chan->num_scheduled = schedule ? 1 : 0;
+        }
+      }
+      if(schedule)
+        Schedule(chan);
+    }
+  }
+
+  public:
+    // num_thread workers are shared by every channel
+    LcmDispatcher(lcm_t *lcm, const size_t num_thread = std::max(1u, std::thread::hardware_concurrency())) :
+        lcm_(lcm), num_thread_(num_thread), exit_flag_(false){}
+
+    ~LcmDispatcher(){
+      Stop();
+      std::lock_guard<std::mutex> lock(channel_mtx_);
+      for(auto &chan : channel_vec_)
+        lcm_unsubscribe(lcm_, chan->sub);
+    }
+
+    LcmDispatcher(const LcmDispatcher&) = delete;
+    LcmDispatcher &operator=(const LcmDispatcher&) = delete;
+
+    // channel is an LCM channel regex. Returns false on error.
+    template <typename MSG_T>
+    bool Subscribe(const std::string &channel,
+                   const std::function<void(const MSG_T &msg, const std::string &channel)> &handler,
+                   const LcmChannelPolicy &policy = LcmChannelPolicy()){
+      EXP_CHK(lcm_ != nullptr, return false)
+      EXP_CHK(handler, return false)
+      EXP_CHK_M(policy.queue_capacity > 0, return false, "channel " + channel)
+      std::unique_ptr<Channel> chan(new Channel);
+      chan->dispatcher = this;
+      chan->channel_name = channel;
+      chan->policy = policy;
+      chan->num_scheduled = 0;
+      chan->num_dropped = chan->num_handled = 0;
+      chan->run = [handler](const RawMsg &raw){
+        MSG_T msg;
+        if(LcmTypeTraits<MSG_T>::Decode(raw.data.data(), 0, raw.data.size(), &msg) < 0){
+          printf("LcmDispatcher - failed to decode a %s on %s\n", LcmTypeTraits<MSG_T>::GetName(), raw.channel.c_str());
+          return;
+        }
+        handler(msg, raw.channel);
+        LcmTypeTraits<MSG_T>::DecodeCleanup(&msg);
+      };
+      std::lock_guard<std::mutex> lock(channel_mtx_);
+      chan->sub = lcm_subscribe(lcm_, channel.c_str(), &OnMessage, chan.get());
+      EXP_CHK_M(chan->sub != nullptr, return false, "lcm_subscribe() error, channel " + channel)
+      channel_vec_.push_back(std::move(chan));
+      return true;
+    }
+
+    // Start the workers before the lcm_t is handled, a blocking channel
+    // otherwise stalls the receive thread until Start()
+    void Start(){
+      EXP_CHK(worker_vec_.empty(), return)
+      exit_flag_ = false;
+      for(size_t i = 0; i < num_thread_; ++i)
+        worker_vec_.push_back( std::thread(&LcmDispatcher::WorkerThread, this) );
+    }
+
+    // Waits for running handlers, queued messages are kept for the next Start()
+    void Stop(){
+      {
+        std::lock_guard<std::mutex> lock(ready_mtx_);
+        exit_flag_ = true;
+      }
+      ready_cv_.notify_all();
+      {
+        std::lock_guard<std::mutex> lock(channel_mtx_);
+        for(auto &chan : channel_vec_){
+          std::lock_guard<std::mutex> chan_lock(chan->mtx);
+          chan->not_full_cv.notify_all();
+        }
+      }
+      for(std::thread &worker : worker_vec_)
+        worker.join();
+      worker_vec_.clear();
+    }
+
+    // Messages of the channel that were dropped or handled so far
+    bool GetStats(const std::string &channel, uint64_t &num_dropped, uint64_t &num_handled){
+      std::lock_guard<std::mutex> lock(channel_mtx_);
+      for(auto &chan : channel_vec_)
+        if(chan->channel_name == channel){
+          std::lock_guard<std::mutex> chan_lock(chan->mtx);
+          num_dropped = chan->num_dropped;
+          num_handled = chan->num_handled;
+          return true;
+        }
+      return false;
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_LCM_DISPATCH_H__
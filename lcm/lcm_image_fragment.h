@@ -0,0 +1,229 @@
+#ifndef __MIO_LCM_IMAGE_FRAGMENT_H__
+#define __MIO_LCM_IMAGE_FRAGMENT_H__
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <vector>
+#include <lcm/lcm.h>
+#include "mio/altro/error.h"
+#include "mio/altro/token_bucket.h"
+#include "mio/lcm/lcm_opencv_mat_codec.h"
+
+/*
+Sends large images as a series of row band lcm_opencv_mat_t messages, each
+small enough for one UDP datagram, so a lost datagram costs one band instead
+of the whole frame. Every band is a valid image on its own (rows is the band
+height), and the frame layout rides in the remaining fields:
+
+  id           frame sequence number
+  index        (first row of the band << 16) | rows of the whole frame
+  bits_in_use  bits per pixel, with kLcmFragmentFlag set
+
+eg.
+
+  // Sender, paced to 40 MB/s with 256 KB bursts
+  mio::LcmImageFragmenter fragmenter(lcm, 60000, 40e6, 256*1024);
+  fragmenter.Publish("CAMERA_0", img);
+
+  // Receiver
+  mio::LcmImageReassembler reassembler([](const mio::LcmReassembledFrame &frame){
+    ...  // frame.img, rows where frame.row_mask is 0 did not arrive
+  });
+  lcm_subscribe(lcm, "CAMERA_0", &mio::LcmImageReassembler::LcmHandler, &reassembler);
+
+Bands are sent raw, the reassembler also takes bands and frames that were
+encoded with a codec (see LcmImageCodec). A frame is delivered as soon as all
+of its rows are in. An incomplete frame is delivered, with its row mask, once
+kMaxPendingFrame newer frames have started, once a newer frame completes or on
+Flush(), so frames always come out in id order. A message without
+kLcmFragmentFlag is delivered as a complete frame, so a reassembler also works
+with plain lcm_opencv_mat_t publishers.
+*/
+
+namespace mio{
+
+const int32_t kLcmFragmentFlag = 1 << 16;
+const int32_t kLcmBitsInUseMask = 0xff;
+
+
+class LcmImageFragmenter{
+  lcm_t *lcm_;
+  size_t max_chunk_size_;
+  TokenBucket pacer_;
+  int32_t next_frame_id_;
+  std::vector<uint8_t> encode_buf_;
+
+  public:
+    // max_chunk_size is the pixel bytes per message, keep it under the
+    // datagram size of the LCM provider. rate is in bytes per second, 0 sends
+    // as fast as possible.
+    LcmImageFragmenter(lcm_t *lcm, const size_t max_chunk_size = 60000, const double rate = 0,
+                       const double burst = 256*1024) :
+        lcm_(lcm), max_chunk_size_(max_chunk_size), pacer_(rate, burst), next_frame_id_(0){}
+
+    void SetRate(const double rate, const double burst){
+      pacer_.SetRate(rate, burst);
+    }
+
+    // Returns the number of messages sent, or -1. info.id and info.index are
+    // replaced by the frame layout.
+    int Publish(const std::string &channel, const cv::Mat &img, const LcmOpencvMatInfo &info = LcmOpencvMatInfo()){
+      EXP_CHK(lcm_ != NULL, return -1)
+      EXP_CHK(!img.empty(), return -1)
+      EXP_CHK_M(img.rows <= 0xffff, return -1, "frames are limited to 65535 rows")
+      EXP_CHK_M(ValidLcmOpencvMatSize(img.rows, img.cols, img.type()), return -1, "frame too large")
+      const size_t row_size = img.cols*img.elemSize();
+      EXP_CHK_M(row_size <= max_chunk_size_, return -1, "a single row is larger than max_chunk_size")
+      const int band_rows = max_chunk_size_ / row_size;
+
+      LcmOpencvMatInfo band_info = info;
+      band_info.id = next_frame_id_++;
+      band_info.bits_in_use = (info.bits_in_use & kLcmBitsInUseMask) | kLcmFragmentFlag;
+      int num_sent = 0;
+      for(int first_row = 0; first_row < img.rows; first_row += band_rows){
+        const cv::Mat band = img.rowRange(first_row, std::min(img.rows, first_row + band_rows));
+        band_info.index = (first_row << 16) | img.rows;
+        EXP_CHK(EncodeLcmOpencvMat(band, band_info, encode_buf_), return -1)
+        pacer_.Take(encode_buf_.size());
+        EXP_CHK(lcm_publish(lcm_, channel.c_str(), encode_buf_.data(), encode_buf_.size()) == 0, return -1)
+        ++num_sent;
+      }
+      return num_sent;
+    }
+};
+
+
+struct LcmReassembledFrame{
+  cv::Mat img;      // rows that did not arrive hold stale pixels
+  cv::Mat row_mask; // img.rows x 1 CV_8UC1, 255 for every row that arrived
+  int num_valid_row;
+  bool complete;
+  LcmOpencvMatInfo info; // id is the frame sequence number, bits_in_use without flags
+};
+
+
+class LcmImageReassembler{
+  std::function<void(const LcmReassembledFrame&)> callback_;
+  CvMatPool pool_;
+  std::deque<LcmReassembledFrame> pending_deque_; // ordered by frame id, oldest first
+  int32_t newest_delivered_id_;
+  bool delivered_any_;
+  size_t num_complete_, num_partial_;
+
+  // True if id a comes before id b, frame ids wrap around
+  static bool Before(const int32_t a, const int32_t b){
+    return static_cast<int32_t>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b)) < 0;
+  }
+
+  // Delivers the frame and, before it, every older pending frame as it is.
+  // Their remaining bands would be dropped as late once the newer frame is out.
+  void Deliver(std::deque<LcmReassembledFrame>::iterator frame_it){
+    const size_t num_frame = frame_it - pending_deque_.begin() + 1;
+    for(size_t i = 0; i < num_frame; ++i){
+      const LcmReassembledFrame frame = pending_deque_.front();
+      pending_deque_.pop_front();
+      if(!delivered_any_ || Before(newest_delivered_id_, frame.info.id))
+        newest_delivered_id_ = frame.info.id;
+      delivered_any_ = true;
+      if(frame.complete)
+        ++num_complete_;
+      else
+        ++num_partial_;
+      callback_(frame);
+    }
+  }
+
+  std::deque<LcmReassembledFrame>::iterator NewFrame(const LcmOpencvMatView &view, const int frame_rows){
+    LcmReassembledFrame frame;
+    frame.img = pool_.Acquire(frame_rows, view.cols, view.type);
+    frame.row_mask = pool_.Acquire(frame_rows, 1, CV_8UC1);
+    memset(frame.row_mask.data, 0, frame_rows);
+    frame.num_valid_row = 0;
+    frame.complete = false;
+    frame.info = view.info;
+    frame.info.bits_in_use &= kLcmBitsInUseMask;
+    frame.info.index = 0;
+    auto insert_it = pending_deque_.end();
+    while(insert_it != pending_deque_.begin() && Before(frame.info.id, std::prev(insert_it)->info.id))
+      --insert_it;
+    return pending_deque_.insert(insert_it, frame);
+  }
+
+  public:
+    static const size_t kMaxPendingFrame = 2;
+
+    LcmImageReassembler(const std::function<void(const LcmReassembledFrame&)> &callback) :
+        callback_(callback), pool_(2*kMaxPendingFrame + 4), newest_delivered_id_(0), delivered_any_(false),
+        num_complete_(0), num_partial_(0){}
+
+    // For lcm_subscribe(), with the reassembler as userdata
+    static void LcmHandler(const lcm_recv_buf_t *rbuf, const char*, void *userdata){
+      static_cast<LcmImageReassembler*>(userdata)->Feed(rbuf->data, rbuf->data_size);
+    }
+
+    // Takes one encoded lcm_opencv_mat_t, calls the callback for every frame it finishes
+    bool Feed(const void *buf, const size_t buf_size){
+      LcmOpencvMatView view;
+      EXP_CHK(ParseLcmOpencvMat(buf, buf_size, view), return false)
+      if(view.length == 0 || view.rows <= 0 || view.cols <= 0)
+        return true;
+
+      const bool fragment = (view.info.bits_in_use & kLcmFragmentFlag) != 0;
+      const int first_row = fragment ? static_cast<int>(static_cast<uint32_t>(view.info.index) >> 16) : 0;
+      const int frame_rows = fragment ? (view.info.index & 0xffff) : view.rows;
+      EXP_CHK_M(first_row + view.rows <= frame_rows, return false, "band outside of its frame")
+      EXP_CHK_M(ValidLcmOpencvMatSize(frame_rows, view.cols, view.type), return false, "frame too large")
+      if(fragment && delivered_any_ && !Before(newest_delivered_id_, view.info.id))
+        return true; // a late band of a frame that was already delivered
+
+      auto frame_it = pending_deque_.begin();
+      if(fragment)
+        while(frame_it != pending_deque_.end() && frame_it->info.id != view.info.id)
+          ++frame_it;
+      else
+        frame_it = pending_deque_.end();
+      if(frame_it != pending_deque_.end() &&
+         (frame_it->img.rows != frame_rows || frame_it->img.cols != view.cols || frame_it->img.type() != view.type)){
+        Deliver(frame_it); // the sender restarted its frame ids with another format
+        frame_it = pending_deque_.end();
+      }
+      if(frame_it == pending_deque_.end()){
+        // Frames that fall out of the window are delivered as they are
+        while(pending_deque_.size() >= kMaxPendingFrame)
+          Deliver( pending_deque_.begin() );
+        frame_it = NewFrame(view, frame_rows);
+      }
+
+      cv::Mat band = frame_it->img.rowRange(first_row, first_row + view.rows);
+      EXP_CHK(DecodeLcmOpencvMatPixels(view, band), return false)
+      for(int r = 0; r < view.rows; ++r){
+        uint8_t &valid = frame_it->row_mask.data[first_row + r];
+        if(!valid){
+          valid = 255;
+          ++frame_it->num_valid_row;
+        }
+      }
+      if(frame_it->num_valid_row == frame_rows){
+        frame_it->complete = true;
+        Deliver(frame_it);
+      }
+      return true;
+    }
+
+    // Delivers every pending frame, eg. when the sender went quiet
+    void Flush(){
+      while( !pending_deque_.empty() )
+        Deliver( pending_deque_.begin() );
+    }
+
+    void GetStats(size_t &num_complete, size_t &num_partial){
+      num_complete = num_complete_;
+      num_partial = num_partial_;
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_LCM_IMAGE_FRAGMENT_H__
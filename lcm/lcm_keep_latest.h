@@ -0,0 +1,158 @@
+#ifndef __MIO_LCM_KEEP_LATEST_H__
+#define __MIO_LCM_KEEP_LATEST_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <lcm/lcm.h>
+#include "mio/altro/error.h"
+#include "mio/lcm/lcm_type_traits.h"
+
+/*
+Subscriptions that only handle the newest message of each channel, for
+display and UI consumers that fall behind a video stream, eg.
+
+  mio::LcmKeepLatest keep_latest(lcm);
+  keep_latest.Subscribe("CAMERA_0", &NewFrame, this);  // lcm_subscribe() style handler
+  keep_latest.Subscribe<lcm_int_t>("STATUS", [](const lcm_int_t &msg){ ... });
+
+  // Instead of lcm_handle(), eg. in the QSocketNotifier slot
+  // (see QT_LCM_SOCKET_NOTIFIER_SLOT_KEEP_LATEST in qt_lcm_utils.h)
+  keep_latest.HandleAvailable();
+
+HandleAvailable() handles every message that is waiting on the lcm_t without
+blocking. A keep-latest channel only copies the encoded bytes of each message
+into one of two buffers per channel, replacing the previous message. The
+payload of a replaced message is never decoded. Once the socket is drained,
+each channel's handler runs once, with the newest message. Other
+subscriptions on the lcm_t are handled as usual while the socket drains.
+*/
+
+namespace mio{
+
+class LcmKeepLatest{
+  struct Channel{
+    std::string name;
+    lcm_subscription_t *sub;
+    std::function<void(const lcm_recv_buf_t*, const char*)> handler;
+    std::vector<uint8_t> newest_buf; // swapped with spare_buf, so the capacity is reused
+    std::vector<uint8_t> spare_buf;
+    std::string newest_channel; // the matched channel, name can be a regex
+    int64_t newest_recv_utime;
+    bool have_newest;
+    uint64_t num_handled, num_coalesced;
+  };
+
+  lcm_t *lcm_;
+  std::vector< std::unique_ptr<Channel> > channel_vec_;
+
+  static void OnMessage(const lcm_recv_buf_t *rbuf, const char *channel, void *userdata){
+    Channel *chan = static_cast<Channel*>(userdata);
+    if(chan->have_newest)
+      ++chan->num_coalesced;
+    const uint8_t *data = static_cast<const uint8_t*>(rbuf->data);
+    chan->spare_buf.assign(data, data + rbuf->data_size);
+    chan->newest_buf.swap(chan->spare_buf);
+    chan->newest_channel = channel;
+    chan->newest_recv_utime = rbuf->recv_utime;
+    chan->have_newest = true;
+  }
+
+  bool Add(const std::string &channel, const std::function<void(const lcm_recv_buf_t*, const char*)> &handler,
+           const int queue_capacity){
+    EXP_CHK(lcm_ != NULL, return false)
+    std::unique_ptr<Channel> chan(new Channel);
+    chan->name = channel;
+    chan->handler = handler;
+    chan->newest_recv_utime = 0;
+    chan->have_newest = false;
+    chan->num_handled = chan->num_coalesced = 0;
+    chan->sub = lcm_subscribe(lcm_, channel.c_str(), &OnMessage, chan.get());
+    EXP_CHK_M(chan->sub != NULL, return false, "lcm_subscribe() error, channel " + channel)
+    if(queue_capacity > 0)
+      lcm_subscription_set_queue_capacity(chan->sub, queue_capacity);
+    channel_vec_.push_back(std::move(chan));
+    return true;
+  }
+
+  public:
+    LcmKeepLatest(lcm_t *lcm) : lcm_(lcm){}
+
+    ~LcmKeepLatest(){
+      for(auto &chan : channel_vec_)
+        lcm_unsubscribe(lcm_, chan->sub);
+    }
+
+    LcmKeepLatest(const LcmKeepLatest&) = delete;
+    LcmKeepLatest &operator=(const LcmKeepLatest&) = delete;
+
+    // The handler gets the newest encoded message, as from lcm_subscribe().
+    // queue_capacity is LCM's subscription queue, 0 keeps its default.
+    bool Subscribe(const std::string &channel, lcm_msg_handler_t handler, void *userdata,
+                   const int queue_capacity = 0){
+      EXP_CHK(handler != NULL, return false)
+      return Add(channel, [handler, userdata](const lcm_recv_buf_t *rbuf, const char *channel){
+        handler(rbuf, channel, userdata);
+      }, queue_capacity);
+    }
+
+    // The handler gets the newest message decoded, it takes (const MSG_T&) or
+    // (const MSG_T&, const char *channel)
+    template <typename MSG_T, typename HANDLER_T>
+    bool Subscribe(const std::string &channel, HANDLER_T handler, const int queue_capacity = 0){
+      return Add(channel, [handler](const lcm_recv_buf_t *rbuf, const char *channel){
+        MSG_T msg;
+        if(LcmTypeTraits<MSG_T>::Decode(rbuf->data, 0, rbuf->data_size, &msg) < 0){
+          printf("LcmKeepLatest - failed to decode a %s on %s\n", LcmTypeTraits<MSG_T>::GetName(), channel);
+          return;
+        }
+        if constexpr(std::is_invocable<HANDLER_T&, const MSG_T&, const char*>::value)
+          handler(msg, channel);
+        else
+          handler(msg);
+        LcmTypeTraits<MSG_T>::DecodeCleanup(&msg);
+      }, queue_capacity);
+    }
+
+    // Handles up to max_num_msg waiting messages without blocking, then calls
+    // every keep-latest handler that has a new message. Returns the number of
+    // messages taken off the lcm_t, or -1 on error.
+    int HandleAvailable(const int max_num_msg = 1000){
+      EXP_CHK(lcm_ != NULL, return -1)
+      int num_msg = 0, status = 0;
+      while(num_msg < max_num_msg && (status = lcm_handle_timeout(lcm_, 0)) > 0)
+        ++num_msg;
+      for(auto &chan : channel_vec_)
+        if(chan->have_newest){
+          chan->have_newest = false;
+          ++chan->num_handled;
+          lcm_recv_buf_t rbuf;
+          rbuf.data = chan->newest_buf.data();
+          rbuf.data_size = chan->newest_buf.size();
+          rbuf.recv_utime = chan->newest_recv_utime;
+          rbuf.lcm = lcm_;
+          chan->handler(&rbuf, chan->newest_channel.c_str());
+        }
+      return status < 0 ? -1 : num_msg;
+    }
+
+    // Messages handed to the handler, and messages replaced by a newer one
+    // before the handler ran
+    bool GetStats(const std::string &channel, uint64_t &num_handled, uint64_t &num_coalesced) const{
+      for(const auto &chan : channel_vec_)
+        if(chan->name == channel){
+          num_handled = chan->num_handled;
+          num_coalesced = chan->num_coalesced;
+          return true;
+        }
+      return false;
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_LCM_KEEP_LATEST_H__
@@ -0,0 +1,327 @@
+#ifndef __MIO_LCM_LOCAL_BUS_H__
+#define __MIO_LCM_LOCAL_BUS_H__
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <typeindex>
+#include <vector>
+#include <unistd.h>
+#include <lcm/lcm.h>
+#include "mio/altro/error.h"
+#include "mio/lcm/lcm_type_traits.h"
+
+/*
+Publish/subscribe by channel name within one process, where messages are
+handed to the subscribers as shared pointers instead of going through UDP and
+an encode/decode, eg. a camera thread feeding a display:
+
+  mio::LcmLocalBus bus(lcm);  // lcm can be NULL for a process local bus
+
+  bus.Subscribe<lcm_opencv_mat_t>("CAMERA_0",
+      [](const std::shared_ptr<const lcm_opencv_mat_t> &msg, const std::string &channel){ ... });
+
+  // Publisher, the deleter keeps the cv::Mat that the message points into alive
+  cv::Mat img = ...;
+  std::shared_ptr<lcm_opencv_mat_t> msg(new lcm_opencv_mat_t, [img](lcm_opencv_mat_t *p){ delete p; });
+  CV_MAT_TO_LCM_FRAME(img, (*msg))
+  bus.Publish<lcm_opencv_mat_t>("CAMERA_0", msg);
+
+Local subscribers run on the publishing thread, in subscription order, and
+must not modify the message. With an lcm_t (which the caller handles, eg. with
+LCMHandlerThread), the bus also talks to other processes:
+
+  - Publish() encodes and sends a message on LCM only when a bus in another
+    process has a subscriber for the channel. Buses announce their channels on
+    kLcmBusChannel when their subscriptions change and when a new bus says
+    hello, so a channel nobody remote listens to never touches the network.
+  - A subscriber (remote = true) also gets the channel's messages from remote
+    publishers, decoded once and shared by the subscribers.
+
+A channel has one message type per bus. Use one bus per process: a process
+that publishes a channel drops the LCM copies of that channel, which are its
+own messages looped back. A crashed process leaves its announcement behind,
+the publisher then keeps sending on LCM, as it did without the bus.
+*/
+
+namespace mio{
+
+const char kLcmBusChannel[] = "MIO_LCM_BUS";
+
+
+class LcmLocalBus{
+  public:
+    typedef std::function<void(const std::shared_ptr<const void> &msg, const std::string &channel)> Handler;
+
+  private:
+    struct Subscriber{
+      int id;
+      bool remote;
+      Handler handler;
+    };
+    typedef std::vector< std::shared_ptr<const Subscriber> > SubscriberVec;
+
+    struct Channel{
+      LcmLocalBus *bus;
+      std::string name;
+      std::type_index type;
+      std::shared_ptr<const SubscriberVec> sub_vec; // copy on write, handlers are called without the lock
+      lcm_subscription_t *lcm_sub; // for remote publishers, while a subscriber wants them
+      std::function<std::shared_ptr<const void>(const lcm_recv_buf_t*)> decode; // set once, for type
+      bool published; // by this bus, LCM copies of the channel are our own
+
+      Channel(LcmLocalBus *bus_, const std::string &name_, const std::type_index type_) :
+          bus(bus_), name(name_), type(type_), sub_vec(std::make_shared<SubscriberVec>()), lcm_sub(NULL),
+          published(false){}
+    };
+
+    lcm_t *lcm_;
+    std::string bus_id_;
+    std::mutex join_mtx_; // serializes joining and leaving LCM channels, taken before mtx_
+    std::mutex mtx_; // guards everything below
+    std::map< std::string, std::unique_ptr<Channel> > channel_map_; // channels live as long as the bus
+    std::map< std::string, std::set<std::string> > remote_interest_map_; // channel -> remote bus ids
+    int next_sub_id_;
+    lcm_string_t_subscription_t *bus_sub_;
+    std::mutex encode_mtx_;
+    std::vector<uint8_t> encode_buf_;
+
+    // Caller holds mtx_. Returns NULL if the channel has another type.
+    template <typename MSG_T>
+    Channel *GetChannel(const std::string &channel){
+      auto chan_it = channel_map_.find(channel);
+      if(chan_it == channel_map_.end()){
+        std::unique_ptr<Channel> new_chan(new Channel(this, channel, std::type_index(typeid(MSG_T))));
+        new_chan->decode = [](const lcm_recv_buf_t *rbuf) -> std::shared_ptr<const void>{
+          MSG_T *msg = new MSG_T;
+          if(LcmTypeTraits<MSG_T>::Decode(rbuf->data, 0, rbuf->data_size, msg) < 0){
+            delete msg;
+            return nullptr;
+          }
+          return std::shared_ptr<const MSG_T>(msg, [](MSG_T *p){
+            LcmTypeTraits<MSG_T>::DecodeCleanup(p);
+            delete p;
+          });
+        };
+        chan_it = channel_map_.emplace(channel, std::move(new_chan)).first;
+      }
+      Channel *chan = chan_it->second.get();
+      EXP_CHK_M(chan->type == std::type_index(typeid(MSG_T)), return NULL,
+                "channel " + channel + " carries another type than " + LcmTypeTraits<MSG_T>::GetName())
+      return chan;
+    }
+
+    // "<bus id> <hello|subscribed> <channel> ...", the channels this bus wants from remote publishers
+    void Announce(const bool hello){
+      std::string str = bus_id_ + (hello ? " hello" : " subscribed");
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for(const auto &chan : channel_map_)
+          if(chan.second->lcm_sub != NULL)
+            str += " " + chan.first;
+      }
+      lcm_string_t msg;
+      msg.str = &str[0];
+      lcm_string_t_publish(lcm_, kLcmBusChannel, &msg);
+    }
+
+    static void OnAnnounce(const lcm_recv_buf_t*, const char*, const lcm_string_t *msg, void *userdata){
+      LcmLocalBus *bus = static_cast<LcmLocalBus*>(userdata);
+      std::istringstream iss(msg->str);
+      std::string bus_id, kind, chan_name;
+      if(!(iss >> bus_id >> kind) || bus_id == bus->bus_id_)
+        return;
+      {
+        std::lock_guard<std::mutex> lock(bus->mtx_);
+        for(auto interest_it = bus->remote_interest_map_.begin(); interest_it != bus->remote_interest_map_.end();){
+          interest_it->second.erase(bus_id);
+          if( interest_it->second.empty() )
+            interest_it = bus->remote_interest_map_.erase(interest_it);
+          else
+            ++interest_it;
+        }
+        while(iss >> chan_name)
+          bus->remote_interest_map_[chan_name].insert(bus_id);
+      }
+      if(kind == "hello")
+        bus->Announce(false);
+    }
+
+    static void OnLcmMessage(const lcm_recv_buf_t *rbuf, const char *channel, void *userdata){
+      Channel *chan = static_cast<Channel*>(userdata);
+      std::shared_ptr<const SubscriberVec> sub_vec;
+      {
+        std::lock_guard<std::mutex> lock(chan->bus->mtx_);
+        if(chan->published || chan->lcm_sub == NULL)
+          return;
+        sub_vec = chan->sub_vec;
+      }
+      const std::shared_ptr<const void> msg = chan->decode(rbuf);
+      if(!msg){
+        printf("LcmLocalBus - failed to decode a message on %s\n", channel);
+        return;
+      }
+      for(const auto &sub : *sub_vec)
+        if(sub->remote)
+          sub->handler(msg, chan->name);
+    }
+
+    template <typename MSG_T>
+    bool PublishRemote(const std::string &channel, const MSG_T &msg){
+      std::lock_guard<std::mutex> lock(encode_mtx_);
+      const int size = LcmTypeTraits<MSG_T>::GetEncodedSize(&msg);
+      EXP_CHK(size >= 0, return false)
+      if(encode_buf_.size() < static_cast<size_t>(size))
+        encode_buf_.resize(size);
+      EXP_CHK(LcmTypeTraits<MSG_T>::Encode(encode_buf_.data(), 0, size, &msg) == size, return false)
+      return lcm_publish(lcm_, channel.c_str(), encode_buf_.data(), size) == 0;
+    }
+
+  public:
+    LcmLocalBus(lcm_t *lcm = NULL) : lcm_(lcm), next_sub_id_(0), bus_sub_(NULL){
+      char host_name[256] = "";
+      gethostname(host_name, sizeof(host_name) - 1);
+      std::ostringstream oss;
+      oss << host_name << ":" << getpid() << ":" << static_cast<const void*>(this);
+      bus_id_ = oss.str();
+      if(lcm_ != NULL){
+        bus_sub_ = lcm_string_t_subscribe(lcm_, kLcmBusChannel, &OnAnnounce, this);
+        Announce(true);
+      }
+    }
+
+    // Stop handling the lcm_t first, its handlers point into the bus
+    ~LcmLocalBus(){
+      if(lcm_ == NULL)
+        return;
+      std::vector<lcm_subscription_t*> lcm_sub_vec;
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for(auto &chan : channel_map_)
+          if(chan.second->lcm_sub != NULL){
+            lcm_sub_vec.push_back(chan.second->lcm_sub);
+            chan.second->lcm_sub = NULL;
+          }
+      }
+      for(lcm_subscription_t *lcm_sub : lcm_sub_vec)
+        lcm_unsubscribe(lcm_, lcm_sub);
+      Announce(false); // no channels left
+      lcm_string_t_unsubscribe(lcm_, bus_sub_);
+    }
+
+    LcmLocalBus(const LcmLocalBus&) = delete;
+    LcmLocalBus &operator=(const LcmLocalBus&) = delete;
+
+    // handler is called with (const std::shared_ptr<const MSG_T>&, const std::string &channel).
+    // remote subscribers also get the messages of other processes. Returns
+    // the subscription id, or -1.
+    template <typename MSG_T, typename HANDLER_T>
+    int Subscribe(const std::string &channel, HANDLER_T handler, const bool remote = true){
+      std::shared_ptr<Subscriber> sub = std::make_shared<Subscriber>();
+      sub->remote = remote && lcm_ != NULL;
+      sub->handler = [handler](const std::shared_ptr<const void> &msg, const std::string &channel){
+        handler(std::static_pointer_cast<const MSG_T>(msg), channel);
+      };
+      // Held until lcm_subscribe() returned, so a second subscriber does not join the channel again
+      std::lock_guard<std::mutex> join_lock(join_mtx_);
+      Channel *chan;
+      bool join_lcm = false;
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        EXP_CHK((chan = GetChannel<MSG_T>(channel)) != NULL, return -1)
+        sub->id = next_sub_id_++;
+        std::shared_ptr<SubscriberVec> sub_vec = std::make_shared<SubscriberVec>(*chan->sub_vec);
+        sub_vec->push_back(sub);
+        chan->sub_vec = sub_vec;
+        join_lcm = sub->remote && chan->lcm_sub == NULL;
+      }
+      if(join_lcm){
+        lcm_subscription_t *lcm_sub = lcm_subscribe(lcm_, channel.c_str(), &OnLcmMessage, chan);
+        EXP_CHK_M(lcm_sub != NULL, return sub->id, "lcm_subscribe() error, channel " + channel + ", local only")
+        {
+          std::lock_guard<std::mutex> lock(mtx_);
+          chan->lcm_sub = lcm_sub;
+        }
+        Announce(false);
+      }
+      return sub->id;
+    }
+
+    bool Unsubscribe(const int sub_id){
+      std::lock_guard<std::mutex> join_lock(join_mtx_);
+      lcm_subscription_t *leave_lcm = NULL;
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        Channel *chan = NULL;
+        std::shared_ptr<SubscriberVec> sub_vec;
+        for(auto &chan_item : channel_map_){
+          const SubscriberVec &cur_vec = *chan_item.second->sub_vec;
+          auto sub_it = std::find_if(cur_vec.begin(), cur_vec.end(),
+                                     [sub_id](const std::shared_ptr<const Subscriber> &sub){ return sub->id == sub_id; });
+          if(sub_it != cur_vec.end()){
+            chan = chan_item.second.get();
+            sub_vec = std::make_shared<SubscriberVec>(cur_vec);
+            sub_vec->erase(sub_vec->begin() + (sub_it - cur_vec.begin()));
+            break;
+          }
+        }
+        EXP_CHK_M(chan != NULL, return false, "no subscription " + std::to_string(sub_id))
+        chan->sub_vec = sub_vec;
+        const bool any_remote = std::any_of(sub_vec->begin(), sub_vec->end(),
+                                            [](const std::shared_ptr<const Subscriber> &sub){ return sub->remote; });
+        if(!any_remote && chan->lcm_sub != NULL){
+          leave_lcm = chan->lcm_sub;
+          chan->lcm_sub = NULL;
+        }
+      }
+      if(leave_lcm != NULL){
+        lcm_unsubscribe(lcm_, leave_lcm);
+        Announce(false);
+      }
+      return true;
+    }
+
+    // Hands msg to the local subscribers, then sends it on LCM if a remote bus
+    // subscribed to the channel. Returns the number of local subscribers, or -1.
+    template <typename MSG_T>
+    int Publish(const std::string &channel, const std::shared_ptr<const MSG_T> &msg){
+      EXP_CHK(msg, return -1)
+      std::shared_ptr<const SubscriberVec> sub_vec;
+      bool remote;
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        Channel *chan;
+        EXP_CHK((chan = GetChannel<MSG_T>(channel)) != NULL, return -1)
+        sub_vec = chan->sub_vec;
+        remote = lcm_ != NULL && remote_interest_map_.count(channel) > 0;
+        chan->published = chan->published || remote;
+      }
+      const std::shared_ptr<const void> void_msg = msg;
+      for(const auto &sub : *sub_vec)
+        sub->handler(void_msg, channel);
+      if(remote){
+        EXP_CHK(PublishRemote(channel, *msg), return -1)
+      }
+      return sub_vec->size();
+    }
+
+    // True if a bus in another process subscribed to the channel
+    bool HasRemoteSubscriber(const std::string &channel){
+      std::lock_guard<std::mutex> lock(mtx_);
+      return remote_interest_map_.count(channel) > 0;
+    }
+
+    const std::string &GetBusId() const{
+      return bus_id_;
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_LCM_LOCAL_BUS_H__
@@ -0,0 +1,614 @@
+#ifndef __MIO_LCM_LOG_H__
+#define __MIO_LCM_LOG_H__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <lcm/lcm.h>
+#include "mio/altro/error.h"
+
+/*
+Records LCM traffic (any type: lcm_opencv_mat_t, lcm_double_t, ipcs_*, ...) to
+an indexed log file and replays it at 1x, Nx or as fast as possible, eg.
+
+  // Record every channel of an lcm_t until Close()
+  mio::LcmLogRecorder recorder;
+  recorder.Open("/data/run_42.miolog", lcm);
+
+  // Replay the camera and the status channels at twice the recorded rate,
+  // starting 10 s into the log
+  mio::LcmLogReplayer replayer;
+  replayer.Open("/data/run_42.miolog");
+  replayer.Seek(replayer.GetStartUtime() + 10000000);
+  replayer.Play(lcm, 2.0, "CAMERA_.*|STATUS");
+
+The recorder copies each message into a memory mapped window of the file,
+so the LCM thread never waits on write(). Close() appends the index: every
+event's time and file offset plus each channel's list of events. The replayer
+maps the whole file, so an event is handed out without a copy, and Seek() and
+FindEvent() are binary searches over the index. A thread walks ahead of the
+replay position and asks the kernel to read the next kPrefetchSize bytes in
+(madvise(MADV_WILLNEED)), and releases what is behind, so a capture much
+larger than RAM replays at disk speed.
+
+A log whose recorder died before Close() has no index; the replayer then
+rebuilds it by scanning the records. Integers are in host byte order.
+*/
+
+namespace mio{
+
+namespace lcm_log{
+
+const char kMagic[8] = {'M', 'I', 'O', 'L', 'C', 'M', 'L', 'G'};
+const uint32_t kVersion = 1;
+const uint32_t kRecordSync = 0xEDA1DA01;
+const uint32_t kChannelSync = 0xEDA1DA02; // names a channel id, written before its first message
+
+struct FileHeader{
+  char magic[8];
+  uint32_t version, reserved;
+  uint64_t index_offset; // 0 until the recorder closed the log
+};
+
+// Every record starts 8 byte aligned, the message data follows the header
+struct RecordHeader{
+  uint32_t sync;
+  uint32_t channel_id;
+  int64_t utime;
+  uint64_t data_size;
+};
+
+struct IndexEntry{
+  int64_t utime;
+  uint64_t offset; // of the RecordHeader
+};
+
+inline uint64_t Align8(const uint64_t size){
+  return (size + 7) & ~uint64_t(7);
+}
+
+} //namespace lcm_log
+
+
+// An event of the log, data points into the mapped file and stays valid until
+// the replayer is closed
+struct LcmLogEvent{
+  uint64_t event_num;
+  int64_t utime;
+  const std::string *channel;
+  const uint8_t *data;
+  uint64_t data_size;
+};
+
+
+class LcmLogRecorder{
+  static const uint64_t kWindowSize = 64*1024*1024; // file grows and is mapped this much at a time
+
+  std::mutex mtx_;
+  int fd_;
+  uint8_t *window_;
+  uint64_t window_offset_, window_size_, file_size_, write_offset_;
+  std::map<std::string, uint32_t> channel_map_;
+  std::vector<std::string> channel_vec_;
+  std::vector<lcm_log::IndexEntry> event_vec_;
+  std::vector< std::vector<uint64_t> > channel_event_vec_; // event numbers of each channel
+  lcm_t *lcm_;
+  lcm_subscription_t *sub_;
+
+  static void OnMessage(const lcm_recv_buf_t *rbuf, const char *channel, void *userdata){
+    static_cast<LcmLogRecorder*>(userdata)->Write(channel, rbuf->recv_utime, rbuf->data, rbuf->data_size);
+  }
+
+  // Caller holds mtx_. Maps the window that holds [offset, offset + size),
+  // a message larger than kWindowSize gets a window of its own size. The
+  // window's blocks are allocated up front: a store to a page of a sparse file
+  // raises SIGBUS once the disk is full, a failed allocation only fails Write().
+  bool MapWindow(const uint64_t offset, const uint64_t size){
+    if(window_ != NULL && offset >= window_offset_ && offset + size <= window_offset_ + window_size_)
+      return true;
+    if(window_ != NULL){
+      munmap(window_, window_size_);
+      window_ = NULL;
+    }
+    const uint64_t page_size = sysconf(_SC_PAGESIZE);
+    window_offset_ = offset / page_size * page_size;
+    window_size_ = std::max(kWindowSize, offset + size - window_offset_);
+    if(window_offset_ + window_size_ > file_size_){
+      const int err = posix_fallocate(fd_, file_size_, window_offset_ + window_size_ - file_size_);
+      EXP_CHK_M(err == 0, return false, std::string("posix_fallocate() error, ") + strerror(err))
+      file_size_ = window_offset_ + window_size_;
+    }
+    void *addr;
+    EXP_CHK_ERRNO((addr = mmap(NULL, window_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, window_offset_)) != MAP_FAILED,
+                  return false)
+    window_ = static_cast<uint8_t*>(addr);
+    return true;
+  }
+
+  // Caller holds mtx_
+  bool AppendRecord(const uint32_t sync, const uint32_t channel_id, const int64_t utime, const void *data,
+                    const uint64_t data_size){
+    const uint64_t record_size = lcm_log::Align8(sizeof(lcm_log::RecordHeader) + data_size);
+    EXP_CHK(MapWindow(write_offset_, record_size), return false)
+    uint8_t *ptr = window_ + (write_offset_ - window_offset_);
+    lcm_log::RecordHeader header;
+    header.sync = sync;
+    header.channel_id = channel_id;
+    header.utime = utime;
+    header.data_size = data_size;
+    memcpy(ptr, &header, sizeof(header));
+    memcpy(ptr + sizeof(header), data, data_size);
+    write_offset_ += record_size;
+    return true;
+  }
+
+  public:
+    LcmLogRecorder() : fd_(-1), window_(NULL), window_offset_(0), window_size_(0), file_size_(0), write_offset_(0),
+        lcm_(NULL), sub_(NULL){}
+
+    ~LcmLogRecorder(){
+      Close();
+    }
+
+    LcmLogRecorder(const LcmLogRecorder&) = delete;
+    LcmLogRecorder &operator=(const LcmLogRecorder&) = delete;
+
+    // Creates (or truncates) the log. With an lcm_t, the channels that match
+    // channel_regex are recorded as they arrive, otherwise use Write().
+    bool Open(const std::string &path, lcm_t *lcm = NULL, const std::string &channel_regex = ".*"){
+      EXP_CHK_M(fd_ == -1, return false, "log already open")
+      EXP_CHK_ERRNO_M((fd_ = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644)) != -1, return false, path)
+      {
+        std::lock_guard<std::mutex> lock(mtx_);
+        lcm_log::FileHeader header;
+        memset(&header, 0, sizeof(header));
+        memcpy(header.magic, lcm_log::kMagic, sizeof(header.magic));
+        header.version = lcm_log::kVersion;
+        EXP_CHK(MapWindow(0, sizeof(header)), close(fd_); fd_ = -1; return false)
+        memcpy(window_, &header, sizeof(header));
+        write_offset_ = lcm_log::Align8(sizeof(header));
+      }
+      if(lcm != NULL){
+        lcm_ = lcm;
+        EXP_CHK_M((sub_ = lcm_subscribe(lcm_, channel_regex.c_str(), &OnMessage, this)) != NULL, Close(); return false,
+                  "lcm_subscribe() error, channel " + channel_regex)
+      }
+      return true;
+    }
+
+    bool IsOpen(){
+      return fd_ != -1;
+    }
+
+    // Appends one message, utime is the receive time in microseconds. Returns
+    // false if the file can not grow (eg. ENOSPC), what was written before
+    // stays readable after Close().
+    bool Write(const std::string &channel, const int64_t utime, const void *data, const uint64_t data_size){
+      std::lock_guard<std::mutex> lock(mtx_);
+      EXP_CHK(fd_ != -1, return false)
+      auto channel_it = channel_map_.find(channel);
+      if(channel_it == channel_map_.end()){
+        const uint32_t channel_id = channel_vec_.size();
+        EXP_CHK(AppendRecord(lcm_log::kChannelSync, channel_id, utime, channel.data(), channel.size()), return false)
+        channel_it = channel_map_.insert( std::make_pair(channel, channel_id) ).first;
+        channel_vec_.push_back(channel);
+        channel_event_vec_.push_back( std::vector<uint64_t>() );
+      }
+      const uint64_t offset = write_offset_;
+      EXP_CHK(AppendRecord(lcm_log::kRecordSync, channel_it->second, utime, data, data_size), return false)
+      channel_event_vec_[channel_it->second].push_back( event_vec_.size() );
+      event_vec_.push_back( lcm_log::IndexEntry{utime, offset} );
+      return true;
+    }
+
+    uint64_t GetNumEvent(){
+      std::lock_guard<std::mutex> lock(mtx_);
+      return event_vec_.size();
+    }
+
+    // Stops recording and writes the index. Returns false if the index could
+    // not be written, the records are still there for the replayer to scan.
+    bool Close(){
+      if(sub_ != NULL){
+        lcm_unsubscribe(lcm_, sub_);
+        sub_ = NULL;
+      }
+      std::lock_guard<std::mutex> lock(mtx_);
+      if(fd_ == -1)
+        return true;
+      if(window_ != NULL){
+        munmap(window_, window_size_);
+        window_ = NULL;
+      }
+
+      // Index: event count, channel count, event index, then per channel its
+      // name and event numbers
+      std::vector<uint8_t> index;
+      auto put = [&index](const void *data, const size_t size){
+        const uint8_t *ptr = static_cast<const uint8_t*>(data);
+        index.insert(index.end(), ptr, ptr + size);
+        index.resize( lcm_log::Align8(index.size()) );
+      };
+      const uint64_t num_event = event_vec_.size(), num_channel = channel_vec_.size();
+      put(&num_event, sizeof(num_event));
+      put(&num_channel, sizeof(num_channel));
+      put(event_vec_.data(), event_vec_.size()*sizeof(lcm_log::IndexEntry));
+      for(size_t i = 0; i < channel_vec_.size(); ++i){
+        const uint64_t name_size = channel_vec_[i].size(), channel_num_event = channel_event_vec_[i].size();
+        put(&name_size, sizeof(name_size));
+        put(channel_vec_[i].data(), name_size);
+        put(&channel_num_event, sizeof(channel_num_event));
+        put(channel_event_vec_[i].data(), channel_num_event*sizeof(uint64_t));
+      }
+
+      bool success = true;
+      const uint64_t index_offset = write_offset_;
+      EXP_CHK_ERRNO(ftruncate(fd_, index_offset + index.size()) == 0, success = false)
+      if(success){
+        EXP_CHK_ERRNO(pwrite(fd_, index.data(), index.size(), index_offset) == static_cast<ssize_t>(index.size()),
+                      success = false)
+      }
+      if(success){
+        fdatasync(fd_); // the index must not point at records that are not on disk yet
+        EXP_CHK_ERRNO(pwrite(fd_, &index_offset, sizeof(index_offset), offsetof(lcm_log::FileHeader, index_offset)) ==
+                      sizeof(index_offset), success = false)
+      }
+      close(fd_);
+      fd_ = -1;
+      file_size_ = 0;
+      channel_map_.clear();
+      channel_vec_.clear();
+      event_vec_.clear();
+      channel_event_vec_.clear();
+      return success;
+    }
+};
+
+class LcmLogReplayer{
+  static const uint64_t kPrefetchSize = 256*1024*1024; // read ahead of the replay position
+  static const uint64_t kPrefetchStep = 32*1024*1024;  // madvise() granularity
+
+  int fd_;
+  const uint8_t *map_;
+  uint64_t map_size_, data_end_; // records end at data_end_
+  std::vector<std::string> channel_vec_;
+  // Point into the mapped index, or into the vectors below when it was rebuilt
+  const lcm_log::IndexEntry *event_;
+  uint64_t num_event_;
+  std::vector<const uint64_t*> channel_event_vec_;
+  std::vector<uint64_t> channel_num_event_vec_;
+  std::vector<lcm_log::IndexEntry> rebuilt_event_vec_;
+  std::vector< std::vector<uint64_t> > rebuilt_channel_event_vec_;
+
+  uint64_t next_event_;
+  std::atomic<bool> stop_play_;
+  // Prefetch thread
+  std::mutex prefetch_mtx_;
+  std::condition_variable prefetch_cv_;
+  uint64_t read_offset_, prefetch_begin_, prefetch_end_;
+  bool exit_prefetch_;
+  std::thread prefetch_thread_;
+
+  // Keeps [read offset, read offset + kPrefetchSize) on its way into the page
+  // cache and drops what is more than kPrefetchSize behind
+  void PrefetchThread(){
+    const uint64_t page_size = sysconf(_SC_PAGESIZE);
+    std::unique_lock<std::mutex> lock(prefetch_mtx_);
+    for(;;){
+      prefetch_cv_.wait(lock, [this](){
+        return exit_prefetch_ || read_offset_ < prefetch_begin_ ||
+               (prefetch_end_ < map_size_ && read_offset_ + kPrefetchSize > prefetch_end_) ||
+               read_offset_ >= prefetch_begin_ + 2*kPrefetchSize;
+      });
+      if(exit_prefetch_)
+        return;
+      const uint64_t read_page = read_offset_ / page_size * page_size;
+      if(read_offset_ < prefetch_begin_ || read_page > prefetch_end_){ // seeked, start over from there
+        prefetch_begin_ = prefetch_end_ = read_page;
+        continue;
+      }
+      const uint64_t willneed_begin = prefetch_end_, release_begin = prefetch_begin_;
+      uint64_t willneed_end = willneed_begin, release_end = release_begin;
+      if(read_offset_ + kPrefetchSize > prefetch_end_)
+        willneed_end = prefetch_end_ = std::min(map_size_, prefetch_end_ + kPrefetchStep);
+      if(read_offset_ >= prefetch_begin_ + 2*kPrefetchSize)
+        release_end = prefetch_begin_ = (read_offset_ - kPrefetchSize) / page_size * page_size;
+      lock.unlock();
+      uint8_t *map = const_cast<uint8_t*>(map_);
+      if(willneed_end > willneed_begin)
+        madvise(map + willneed_begin, willneed_end - willneed_begin, MADV_WILLNEED);
+      if(release_end > release_begin){
+        madvise(map + release_begin, release_end - release_begin, MADV_DONTNEED);
+        posix_fadvise(fd_, release_begin, release_end - release_begin, POSIX_FADV_DONTNEED);
+      }
+      lock.lock();
+    }
+  }
+
+  void SetReadOffset(const uint64_t offset){
+    std::lock_guard<std::mutex> lock(prefetch_mtx_);
+    read_offset_ = offset;
+    prefetch_cv_.notify_one();
+  }
+
+  const lcm_log::RecordHeader *GetRecord(const uint64_t offset) const{
+    return reinterpret_cast<const lcm_log::RecordHeader*>(map_ + offset);
+  }
+
+  bool LoadIndex(const uint64_t index_offset){
+    const uint8_t *ptr = map_ + index_offset, *const end = map_ + map_size_;
+    auto get = [&ptr, end](const size_t size) -> const uint8_t*{
+      if(size > static_cast<size_t>(end - ptr))
+        return NULL;
+      const uint8_t *item = ptr;
+      ptr += lcm_log::Align8(size);
+      ptr = std::min(ptr, end);
+      return item;
+    };
+    const uint8_t *item;
+    EXP_CHK_M((item = get(2*sizeof(uint64_t))) != NULL, return false, "truncated log index")
+    uint64_t num_channel;
+    memcpy(&num_event_, item, sizeof(num_event_));
+    memcpy(&num_channel, item + sizeof(uint64_t), sizeof(num_channel));
+    EXP_CHK_M(num_event_ <= map_size_ / sizeof(lcm_log::IndexEntry), return false, "corrupt log index")
+    EXP_CHK_M((item = get(num_event_*sizeof(lcm_log::IndexEntry))) != NULL, return false, "truncated log index")
+    event_ = reinterpret_cast<const lcm_log::IndexEntry*>(item);
+    for(uint64_t i = 0; i < num_channel; ++i){
+      uint64_t name_size, channel_num_event;
+      EXP_CHK_M((item = get(sizeof(name_size))) != NULL, return false, "truncated log index")
+      memcpy(&name_size, item, sizeof(name_size));
+      EXP_CHK_M((item = get(name_size)) != NULL, return false, "truncated log index")
+      channel_vec_.push_back( std::string(reinterpret_cast<const char*>(item), name_size) );
+      EXP_CHK_M((item = get(sizeof(channel_num_event))) != NULL, return false, "truncated log index")
+      memcpy(&channel_num_event, item, sizeof(channel_num_event));
+      EXP_CHK_M(channel_num_event <= num_event_, return false, "corrupt log index")
+      EXP_CHK_M((item = get(channel_num_event*sizeof(uint64_t))) != NULL, return false, "truncated log index")
+      channel_event_vec_.push_back( reinterpret_cast<const uint64_t*>(item) );
+      channel_num_event_vec_.push_back(channel_num_event);
+    }
+    // The records themselves are checked as they are read, touching them all
+    // here would read the whole log
+    for(uint64_t i = 0; i < num_event_; ++i)
+      EXP_CHK_M(event_[i].offset + sizeof(lcm_log::RecordHeader) <= index_offset, return false, "corrupt log index")
+    for(size_t i = 0; i < channel_event_vec_.size(); ++i)
+      for(uint64_t j = 0; j < channel_num_event_vec_[i]; ++j)
+        EXP_CHK_M(channel_event_vec_[i][j] < num_event_, return false, "corrupt log index")
+    data_end_ = index_offset;
+    return true;
+  }
+
+  // For a log without index, reads every record header up to the first gap
+  void RebuildIndex(){
+    uint64_t offset = lcm_log::Align8(sizeof(lcm_log::FileHeader));
+    while(offset + sizeof(lcm_log::RecordHeader) <= map_size_){
+      const lcm_log::RecordHeader *record = GetRecord(offset);
+      if((record->sync != lcm_log::kRecordSync && record->sync != lcm_log::kChannelSync) ||
+         record->data_size > map_size_ - offset - sizeof(lcm_log::RecordHeader) ||
+         record->channel_id > channel_vec_.size())
+        break;
+      if(record->channel_id == channel_vec_.size()){
+        if(record->sync != lcm_log::kChannelSync)
+          break;
+        channel_vec_.push_back( std::string(reinterpret_cast<const char*>(record + 1), record->data_size) );
+        rebuilt_channel_event_vec_.push_back( std::vector<uint64_t>() );
+      }
+      else if(record->sync == lcm_log::kRecordSync){
+        rebuilt_channel_event_vec_[record->channel_id].push_back( rebuilt_event_vec_.size() );
+        rebuilt_event_vec_.push_back( lcm_log::IndexEntry{record->utime, offset} );
+      }
+      offset += lcm_log::Align8(sizeof(lcm_log::RecordHeader) + record->data_size);
+    }
+    data_end_ = offset;
+    event_ = rebuilt_event_vec_.data();
+    num_event_ = rebuilt_event_vec_.size();
+    for(auto &channel_event : rebuilt_channel_event_vec_){
+      channel_event_vec_.push_back( channel_event.data() );
+      channel_num_event_vec_.push_back( channel_event.size() );
+    }
+    printf("%s - log has no index, recovered %lu events\n", CURRENT_FUNC, static_cast<unsigned long>(num_event_));
+  }
+
+  public:
+    LcmLogReplayer() : fd_(-1), map_(NULL), map_size_(0), data_end_(0), event_(NULL), num_event_(0), next_event_(0),
+        stop_play_(false), read_offset_(0), prefetch_begin_(0), prefetch_end_(0), exit_prefetch_(false){}
+
+    ~LcmLogReplayer(){
+      Close();
+    }
+
+    LcmLogReplayer(const LcmLogReplayer&) = delete;
+    LcmLogReplayer &operator=(const LcmLogReplayer&) = delete;
+
+    bool Open(const std::string &path){
+      EXP_CHK_M(fd_ == -1, return false, "log already open")
+      EXP_CHK_ERRNO_M((fd_ = open(path.c_str(), O_RDONLY | O_CLOEXEC)) != -1, return false, path)
+      struct stat file_stat;
+      EXP_CHK_ERRNO(fstat(fd_, &file_stat) == 0, Close(); return false)
+      map_size_ = file_stat.st_size;
+      EXP_CHK_M(map_size_ >= sizeof(lcm_log::FileHeader), Close(); return false, path + " is not an LCM log")
+      void *addr;
+      EXP_CHK_ERRNO((addr = mmap(NULL, map_size_, PROT_READ, MAP_SHARED, fd_, 0)) != MAP_FAILED,
+                    map_size_ = 0; Close(); return false)
+      map_ = static_cast<const uint8_t*>(addr);
+      madvise(addr, map_size_, MADV_SEQUENTIAL);
+
+      lcm_log::FileHeader header;
+      memcpy(&header, map_, sizeof(header));
+      EXP_CHK_M(memcmp(header.magic, lcm_log::kMagic, sizeof(header.magic)) == 0 && header.version == lcm_log::kVersion,
+                Close(); return false, path + " is not an LCM log of this version")
+      if(header.index_offset == 0)
+        RebuildIndex();
+      else
+        EXP_CHK(header.index_offset <= map_size_ && LoadIndex(header.index_offset), Close(); return false)
+
+      next_event_ = 0;
+      exit_prefetch_ = false;
+      read_offset_ = prefetch_begin_ = prefetch_end_ = 0;
+      prefetch_thread_ = std::thread(&LcmLogReplayer::PrefetchThread, this);
+      return true;
+    }
+
+    void Close(){
+      if( prefetch_thread_.joinable() ){
+        {
+          std::lock_guard<std::mutex> lock(prefetch_mtx_);
+          exit_prefetch_ = true;
+        }
+        prefetch_cv_.notify_one();
+        prefetch_thread_.join();
+      }
+      if(map_ != NULL){
+        munmap(const_cast<uint8_t*>(map_), map_size_);
+        map_ = NULL;
+      }
+      if(fd_ != -1){
+        close(fd_);
+        fd_ = -1;
+      }
+      map_size_ = data_end_ = 0;
+      event_ = NULL;
+      num_event_ = next_event_ = 0;
+      channel_vec_.clear();
+      channel_event_vec_.clear();
+      channel_num_event_vec_.clear();
+      rebuilt_event_vec_.clear();
+      rebuilt_channel_event_vec_.clear();
+    }
+
+    uint64_t GetNumEvent() const{
+      return num_event_;
+    }
+
+    int64_t GetStartUtime() const{
+      return num_event_ > 0 ? event_[0].utime : 0;
+    }
+
+    int64_t GetEndUtime() const{
+      return num_event_ > 0 ? event_[num_event_ - 1].utime : 0;
+    }
+
+    const std::vector<std::string> &GetChannels() const{
+      return channel_vec_;
+    }
+
+    // Number of the first event at or after utime, or GetNumEvent() if there
+    // is none. With a channel, only that channel's events count.
+    uint64_t FindEvent(const int64_t utime, const std::string &channel = "") const{
+      if( channel.empty() )
+        return std::lower_bound(event_, event_ + num_event_, utime, [](const lcm_log::IndexEntry &entry, const int64_t t){
+                 return entry.utime < t;
+               }) - event_;
+      const auto channel_it = std::find(channel_vec_.begin(), channel_vec_.end(), channel);
+      if(channel_it == channel_vec_.end())
+        return num_event_;
+      const size_t channel_id = channel_it - channel_vec_.begin();
+      const uint64_t *channel_event = channel_event_vec_[channel_id];
+      const uint64_t *found = std::lower_bound(channel_event, channel_event + channel_num_event_vec_[channel_id], utime,
+                                               [this](const uint64_t event_num, const int64_t t){
+                                                 return event_[event_num].utime < t;
+                                               });
+      return found == channel_event + channel_num_event_vec_[channel_id] ? num_event_ : *found;
+    }
+
+    // Moves the replay position to the first event at or after utime
+    void Seek(const int64_t utime, const std::string &channel = ""){
+      SeekEvent( FindEvent(utime, channel) );
+    }
+
+    void SeekEvent(const uint64_t event_num){
+      next_event_ = std::min(event_num, num_event_);
+      if(next_event_ < num_event_)
+        SetReadOffset(event_[next_event_].offset);
+    }
+
+    // The event at the replay position, advances the position. Returns false
+    // at the end of the log.
+    bool Next(LcmLogEvent &event){
+      if(next_event_ >= num_event_)
+        return false;
+      const uint64_t offset = event_[next_event_].offset;
+      const lcm_log::RecordHeader *record = GetRecord(offset);
+      EXP_CHK_M(record->sync == lcm_log::kRecordSync && record->channel_id < channel_vec_.size() &&
+                record->data_size <= data_end_ - offset - sizeof(lcm_log::RecordHeader),
+                return false, "corrupt record, event " + std::to_string(next_event_))
+      event.event_num = next_event_++;
+      event.utime = record->utime;
+      event.channel = &channel_vec_[record->channel_id];
+      event.data = map_ + offset + sizeof(lcm_log::RecordHeader);
+      event.data_size = record->data_size;
+      if(offset >= read_offset_ + kPrefetchStep || offset < read_offset_)
+        SetReadOffset(offset);
+      return true;
+    }
+
+    // Calls callback for every event from the replay position on, spaced as
+    // recorded divided by speed, or back to back for a speed of 0. Only the
+    // channels that match channel_regex are replayed. Returns once the log
+    // ends or after Stop() from another thread.
+    bool Play(const std::function<void(const LcmLogEvent&)> &callback, const double speed = 1.0,
+              const std::string &channel_regex = ".*"){
+      EXP_CHK(map_ != NULL && callback, return false)
+      std::vector<bool> channel_match_vec;
+      try{
+        const std::regex re(channel_regex);
+        for(const std::string &channel : channel_vec_)
+          channel_match_vec.push_back( std::regex_match(channel, re) );
+      }
+      catch(const std::regex_error &e){
+        EXP_CHK_M(false, return false, "invalid channel regex " + channel_regex)
+      }
+
+      typedef std::chrono::steady_clock std_sc_t;
+      stop_play_ = false;
+      bool first = true;
+      int64_t start_utime = 0;
+      std_sc_t::time_point start_time;
+      LcmLogEvent event;
+      while(!stop_play_ && Next(event)){
+        if( !channel_match_vec[event.channel - channel_vec_.data()] )
+          continue;
+        if(speed > 0){
+          if(first){
+            start_utime = event.utime;
+            start_time = std_sc_t::now();
+            first = false;
+          }
+          else
+            std::this_thread::sleep_until( start_time + std::chrono::microseconds(
+                static_cast<int64_t>((event.utime - start_utime) / speed)) );
+        }
+        callback(event);
+      }
+      return true;
+    }
+
+    // Publishes the events on lcm under their recorded channel names
+    bool Play(lcm_t *lcm, const double speed = 1.0, const std::string &channel_regex = ".*"){
+      EXP_CHK(lcm != NULL, return false)
+      return Play([lcm](const LcmLogEvent &event){
+        lcm_publish(lcm, event.channel->c_str(), event.data, event.data_size);
+      }, speed, channel_regex);
+    }
+
+    void Stop(){
+      stop_play_ = true;
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_LCM_LOG_H__
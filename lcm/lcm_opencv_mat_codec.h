@@ -0,0 +1,469 @@
+#ifndef __MIO_LCM_OPENCV_MAT_CODEC_H__
+#define __MIO_LCM_OPENCV_MAT_CODEC_H__
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <lcm/lcm.h>
+#include "mio/altro/compress.h"
+#include "mio/altro/error.h"
+#include "mio/altro/opencv.h"
+#include "mio/lcm/lcm_opencv_mat_t.h"
+
+/*
+Hand written codec for lcm_opencv_mat_t that moves pixels straight between the
+LCM buffer and a cv::Mat. The generated lcm_opencv_mat_t_decode() mallocs the
+pixel array of every frame and lcm_opencv_mat_t_publish() mallocs the encode
+buffer; here decoding goes into a CvMatPool buffer and encoding into a caller
+owned std::vector that keeps its capacity, so a steady stream of same sized
+frames allocates nothing, eg.
+
+  // Subscriber, the raw lcm_subscribe() skips the generated decode
+  static void NewFrame(const lcm_recv_buf_t *rbuf, const char *channel, void *userdata){
+    cv::Mat img;
+    if( mio::DecodeLcmOpencvMat(rbuf->data, rbuf->data_size, pool, img) )
+      ...  // keep img as long as needed, its buffer returns to the pool once released
+  }
+  lcm_subscribe(lcm, "CAMERA_0", &NewFrame, NULL);
+
+  // Publisher
+  std::vector<uint8_t> encode_buf;
+  mio::PublishLcmOpencvMat(lcm, "CAMERA_0", img, mio::LcmOpencvMatInfo(), encode_buf);
+
+The wire format is the one lcm-gen produces, so either side can still use the
+generated functions on raw frames. A publisher can also pick a codec per frame,
+eg. for a 16 bit thermal stream
+
+  mio::PublishLcmOpencvMat(lcm, "THERMAL_0", img, mio::LcmOpencvMatInfo(), encode_buf,
+                           mio::LcmImageEncoding(mio::kLcmImageDeltaLz4));
+
+The codec is stored in the message, DecodeLcmOpencvMat() handles every codec,
+so subscribers like AdvImageDisplay need no change. Subscribers that use the
+generated decode and LCM_FRAME_TO_CV_MAT only understand raw frames.
+*/
+
+namespace mio{
+
+// Recycles cv::Mat buffers by size and type. A buffer goes back into use once
+// every cv::Mat that shared it has been released, so handing out a pooled Mat
+// (eg. to SetImage() without a clone) is safe.
+class CvMatPool{
+  std::mutex mtx_;
+  std::vector<cv::Mat> mat_vec_;
+  size_t max_num_mat_;
+  size_t num_alloc_;
+
+  // True when a cv::Mat other than the pool's own still refers to the buffer
+  static bool InUse(const cv::Mat &mat){
+#if CV_MAJOR_VERSION < 3
+    return mat.refcount != NULL && *mat.refcount > 1;
+#else
+    return mat.u != NULL && mat.u->refcount > 1;
+#endif
+  }
+
+  public:
+    CvMatPool(const size_t max_num_mat = 8) : max_num_mat_(max_num_mat), num_alloc_(0){}
+
+    cv::Mat Acquire(const int rows, const int cols, const int type){
+      std::lock_guard<std::mutex> lock(mtx_);
+      for(cv::Mat &mat : mat_vec_)
+        if(mat.rows == rows && mat.cols == cols && mat.type() == type && !InUse(mat))
+          return mat;
+
+      cv::Mat mat(rows, cols, type);
+      ++num_alloc_;
+      if(mat_vec_.size() < max_num_mat_)
+        mat_vec_.push_back(mat);
+      else{
+        // Evict an idle buffer, likely of a size that is no longer used
+        for(cv::Mat &pool_mat : mat_vec_)
+          if( !InUse(pool_mat) ){
+            pool_mat = mat;
+            break;
+          }
+      }
+      return mat;
+    }
+
+    // Number of buffers allocated so far, stops growing once the pool is warm
+    size_t GetNumAlloc(){
+      std::lock_guard<std::mutex> lock(mtx_);
+      return num_alloc_;
+    }
+};
+
+
+// The lcm_opencv_mat_t fields other than the image itself
+struct LcmOpencvMatInfo{
+  int32_t bits_in_use;
+  bool error;
+  int32_t id, index;
+
+  LcmOpencvMatInfo() : bits_in_use(0), error(false), id(0), index(0){}
+};
+
+
+// How the pixels are stored in lcm_opencv_mat_t::data. The codec rides in the
+// top byte of bits_in_use, rows, cols, channels and openCvType always describe
+// the decoded image and length is the size of the encoded pixels.
+enum LcmImageCodec{
+  kLcmImageRaw = 0,
+  kLcmImageDeltaLz4, // lossless, for 8 and 16 bit images (eg. thermal)
+  kLcmImagePackBits, // lossless run length coding, for masks
+  kLcmImageJpeg,     // lossy, 8 bit 1 or 3 channel, for preview channels
+  kLcmImageNumCodec
+};
+
+struct LcmImageEncoding{
+  LcmImageCodec codec;
+  int jpeg_quality; // 0 to 100
+
+  LcmImageEncoding(const LcmImageCodec codec_ = kLcmImageRaw, const int jpeg_quality_ = 90) :
+      codec(codec_), jpeg_quality(jpeg_quality_){}
+};
+
+
+namespace lcm_opencv_mat_codec{
+
+// LCM encodes integers big endian
+inline void PutInt32(uint8_t *&ptr, const int32_t value){
+  const uint32_t v = static_cast<uint32_t>(value);
+  ptr[0] = v >> 24;
+  ptr[1] = v >> 16;
+  ptr[2] = v >> 8;
+  ptr[3] = v;
+  ptr += 4;
+}
+
+inline int32_t GetInt32(const uint8_t *&ptr){
+  const uint32_t v = (static_cast<uint32_t>(ptr[0]) << 24) | (static_cast<uint32_t>(ptr[1]) << 16) |
+                     (static_cast<uint32_t>(ptr[2]) << 8) | ptr[3];
+  ptr += 4;
+  return static_cast<int32_t>(v);
+}
+
+// hash, rows, cols, channels, openCvType and length precede the pixels
+const size_t kHeaderSize = 8 + 5*4;
+// bits_in_use, error, id and index follow them
+const size_t kTrailerSize = 4 + 1 + 4 + 4;
+// The pixels of a message, length is an int32_t
+const size_t kMaxLength = INT32_MAX - kHeaderSize - kTrailerSize;
+
+const int kCodecShift = 24;
+const int32_t kBitsInUseMask = (1 << kCodecShift) - 1;
+
+// Per thread scratch space, so steady state encoding and decoding do not allocate
+inline std::vector<uint8_t> &ScratchBuf(){
+  static thread_local std::vector<uint8_t> buf;
+  return buf;
+}
+
+/*
+DeltaLz4 predicts every sample from the one to its left (the first column from
+the row above), zigzag codes the residual so small errors of either sign have
+zero high bits, and splits the samples into byte planes so LZ4 sees long runs
+of zero high bytes. Samples wider than 16 bits are only split into planes.
+*/
+template <typename T>
+inline void DeltaToPlanes(const cv::Mat &img, uint8_t *planes){
+  const size_t cn = img.channels(), row_num_sample = img.cols*cn, num_sample = img.rows*row_num_sample;
+  uint8_t *dst = planes;
+  for(int r = 0; r < img.rows; ++r, dst += row_num_sample){
+    const T *row = img.ptr<T>(r);
+    for(size_t c = 0; c < cn; ++c){
+      T pred = r > 0 ? img.ptr<T>(r - 1)[c] : 0;
+      for(size_t i = c; i < row_num_sample; i += cn){
+        const T diff = row[i] - pred;
+        const T zigzag = (diff << 1) ^ -(diff >> (8*sizeof(T) - 1));
+        dst[i] = zigzag;
+        if(sizeof(T) == 2)
+          dst[num_sample + i] = zigzag >> 8;
+        pred = row[i];
+      }
+    }
+  }
+}
+
+template <typename T>
+inline void PlanesToDelta(const uint8_t *planes, cv::Mat &img){
+  const size_t cn = img.channels(), row_num_sample = img.cols*cn, num_sample = img.rows*row_num_sample;
+  const uint8_t *src = planes;
+  for(int r = 0; r < img.rows; ++r, src += row_num_sample){
+    T *row = img.ptr<T>(r);
+    for(size_t c = 0; c < cn; ++c){
+      T pred = r > 0 ? img.ptr<T>(r - 1)[c] : 0;
+      for(size_t i = c; i < row_num_sample; i += cn){
+        T zigzag = src[i];
+        if(sizeof(T) == 2)
+          zigzag |= static_cast<T>(src[num_sample + i]) << 8;
+        pred += static_cast<T>((zigzag >> 1) ^ -(zigzag & 1));
+        row[i] = pred;
+      }
+    }
+  }
+}
+
+inline void ToPlanes(const cv::Mat &img, uint8_t *planes){
+  const size_t depth_size = img.elemSize1();
+  if(depth_size == 1)
+    DeltaToPlanes<uint8_t>(img, planes);
+  else if(depth_size == 2)
+    DeltaToPlanes<uint16_t>(img, planes);
+  else{
+    const size_t row_size = img.cols*img.elemSize(), num_sample = img.total()*img.channels();
+    size_t i = 0;
+    for(int r = 0; r < img.rows; ++r)
+      for(const uint8_t *ptr = img.ptr(r), *end = ptr + row_size; ptr != end; ++i)
+        for(size_t b = 0; b < depth_size; ++b)
+          planes[b*num_sample + i] = *ptr++;
+  }
+}
+
+inline void FromPlanes(const uint8_t *planes, cv::Mat &img){
+  const size_t depth_size = img.elemSize1();
+  if(depth_size == 1)
+    PlanesToDelta<uint8_t>(planes, img);
+  else if(depth_size == 2)
+    PlanesToDelta<uint16_t>(planes, img);
+  else{
+    const size_t row_size = img.cols*img.elemSize(), num_sample = img.total()*img.channels();
+    size_t i = 0;
+    for(int r = 0; r < img.rows; ++r)
+      for(uint8_t *ptr = img.ptr(r), *end = ptr + row_size; ptr != end; ++i)
+        for(size_t b = 0; b < depth_size; ++b)
+          *ptr++ = planes[b*num_sample + i];
+  }
+}
+
+// Encodes the pixels of img at buf[offset], growing buf as needed. Returns the
+// encoded size, or -1.
+inline int64_t EncodePixels(const cv::Mat &img, const LcmImageEncoding &encoding, std::vector<uint8_t> &buf,
+                            const size_t offset){
+  const size_t row_size = img.cols*img.elemSize();
+  const size_t length = img.rows*row_size;
+  if(length == 0)
+    return 0;
+  switch(encoding.codec){
+    case kLcmImageRaw:
+      buf.resize(offset + length);
+      if( img.isContinuous() )
+        memcpy(&buf[offset], img.data, length);
+      else
+        for(int r = 0; r < img.rows; ++r)
+          memcpy(&buf[offset + r*row_size], img.ptr(r), row_size);
+      return length;
+    case kLcmImageDeltaLz4:{
+      std::vector<uint8_t> &planes = ScratchBuf();
+      planes.resize(length);
+      ToPlanes(img, planes.data());
+      buf.resize(offset + Lz4CompressBound(length));
+      const size_t size = Lz4Compress(planes.data(), length, &buf[offset], buf.size() - offset);
+      EXP_CHK(size > 0, return -1)
+      return size;
+    }
+    case kLcmImagePackBits:{
+      const uint8_t *src = img.data;
+      if( !img.isContinuous() ){
+        std::vector<uint8_t> &scratch = ScratchBuf();
+        scratch.resize(length);
+        for(int r = 0; r < img.rows; ++r)
+          memcpy(&scratch[r*row_size], img.ptr(r), row_size);
+        src = scratch.data();
+      }
+      buf.resize(offset + PackBitsBound(length));
+      const size_t size = PackBitsEncode(src, length, &buf[offset], buf.size() - offset);
+      EXP_CHK(size > 0, return -1)
+      return size;
+    }
+    case kLcmImageJpeg:{
+      EXP_CHK_M(img.depth() == CV_8U && (img.channels() == 1 || img.channels() == 3), return -1,
+                "jpeg needs an 8 bit, 1 or 3 channel image")
+#if CV_MAJOR_VERSION < 3
+      const std::vector<int> param = {CV_IMWRITE_JPEG_QUALITY, encoding.jpeg_quality};
+#else
+      const std::vector<int> param = {cv::IMWRITE_JPEG_QUALITY, encoding.jpeg_quality};
+#endif
+      std::vector<uint8_t> jpeg_buf;
+      EXP_CHK(cv::imencode(".jpg", img, jpeg_buf, param), return -1)
+      buf.resize(offset + jpeg_buf.size());
+      memcpy(&buf[offset], jpeg_buf.data(), jpeg_buf.size());
+      return jpeg_buf.size();
+    }
+    default:
+      EXP_CHK_M(false, return -1, "unknown codec " + std::to_string(encoding.codec))
+  }
+}
+
+} //namespace lcm_opencv_mat_codec
+
+
+// The fields of an encoded lcm_opencv_mat_t, data points into the encoded
+// buffer. info.bits_in_use is without the codec.
+struct LcmOpencvMatView{
+  int32_t rows, cols, channels, type, length;
+  LcmImageCodec codec;
+  const uint8_t *data;
+  LcmOpencvMatInfo info;
+};
+
+
+// True if type is a cv::Mat type of a known depth and a rows x cols image of
+// it fits in one message. Checked before anything is allocated for a received
+// header, so a corrupt one can not ask for gigabytes or make cv::Mat throw.
+inline bool ValidLcmOpencvMatSize(const int32_t rows, const int32_t cols, const int32_t type){
+#ifdef CV_16F
+  const int max_depth = CV_16F;
+#else
+  const int max_depth = CV_64F;
+#endif
+  if(rows <= 0 || cols <= 0 || (type & ~CV_MAT_TYPE_MASK) != 0 || CV_MAT_DEPTH(type) > max_depth)
+    return false;
+  return static_cast<uint64_t>(rows)*cols <= lcm_opencv_mat_codec::kMaxLength / CV_ELEM_SIZE(type);
+}
+
+
+// Checks the type hash and the sizes without copying the pixels
+inline bool ParseLcmOpencvMat(const void *buf, const size_t buf_size, LcmOpencvMatView &view){
+  using namespace lcm_opencv_mat_codec;
+  EXP_CHK(buf != NULL, return false)
+  EXP_CHK_M(buf_size >= kHeaderSize + kTrailerSize, return false, "truncated lcm_opencv_mat_t")
+  const uint8_t *ptr = static_cast<const uint8_t*>(buf);
+  const uint32_t hash_high = GetInt32(ptr);
+  const int64_t hash = (static_cast<uint64_t>(hash_high) << 32) | static_cast<uint32_t>(GetInt32(ptr));
+  EXP_CHK_M(hash == __lcm_opencv_mat_t_get_hash(), return false, "not an lcm_opencv_mat_t")
+  view.rows = GetInt32(ptr);
+  view.cols = GetInt32(ptr);
+  view.channels = GetInt32(ptr);
+  view.type = GetInt32(ptr);
+  view.length = GetInt32(ptr);
+  EXP_CHK_M(view.length >= 0 && buf_size == kHeaderSize + view.length + kTrailerSize, return false,
+            "lcm_opencv_mat_t length does not match the message size")
+  view.data = ptr;
+  ptr += view.length;
+  const int32_t bits_in_use = GetInt32(ptr);
+  view.codec = static_cast<LcmImageCodec>(static_cast<uint32_t>(bits_in_use) >> kCodecShift);
+  view.info.bits_in_use = bits_in_use & kBitsInUseMask;
+  view.info.error = (*ptr++ != 0);
+  view.info.id = GetInt32(ptr);
+  view.info.index = GetInt32(ptr);
+
+  EXP_CHK_M(view.codec < kLcmImageNumCodec, return false, "unknown codec " + std::to_string(view.codec))
+  if(view.length > 0){
+    EXP_CHK_M(ValidLcmOpencvMatSize(view.rows, view.cols, view.type), return false,
+              "lcm_opencv_mat_t has an unknown type or is too large")
+    EXP_CHK_M(CV_MAT_CN(view.type) == view.channels, return false, "lcm_opencv_mat_t size does not match its type")
+    EXP_CHK_M(view.codec != kLcmImageRaw ||
+              static_cast<size_t>(view.length) == static_cast<size_t>(view.rows)*view.cols*CV_ELEM_SIZE(view.type),
+              return false, "lcm_opencv_mat_t size does not match its type")
+  }
+  return true;
+}
+
+
+// Decodes the pixels of view into img, which must already be view.rows x
+// view.cols of view.type and continuous (eg. from a CvMatPool)
+inline bool DecodeLcmOpencvMatPixels(const LcmOpencvMatView &view, cv::Mat &img){
+  using namespace lcm_opencv_mat_codec;
+  EXP_CHK(img.rows == view.rows && img.cols == view.cols && img.type() == view.type && img.isContinuous(),
+          return false)
+  const size_t length = img.total()*img.elemSize();
+  switch(view.codec){
+    case kLcmImageRaw:
+      memcpy(img.data, view.data, length);
+      return true;
+    case kLcmImageDeltaLz4:{
+      std::vector<uint8_t> &planes = ScratchBuf();
+      planes.resize(length);
+      EXP_CHK_M(Lz4Decompress(view.data, view.length, planes.data(), length), return false, "corrupt lz4 data")
+      FromPlanes(planes.data(), img);
+      return true;
+    }
+    case kLcmImagePackBits:
+      EXP_CHK_M(PackBitsDecode(view.data, view.length, img.data, length), return false, "corrupt packbits data")
+      return true;
+    case kLcmImageJpeg:{
+      cv::Mat decoded = img;
+#if CV_MAJOR_VERSION < 3
+      const int flags = CV_LOAD_IMAGE_UNCHANGED;
+#else
+      const int flags = cv::IMREAD_UNCHANGED;
+#endif
+      cv::imdecode(cv::Mat(1, view.length, CV_8UC1, const_cast<uint8_t*>(view.data)), flags, &decoded);
+      EXP_CHK_M(decoded.rows == img.rows && decoded.cols == img.cols && decoded.type() == img.type(), return false,
+                "corrupt jpeg data")
+      if(decoded.data != img.data)
+        decoded.copyTo(img);
+      return true;
+    }
+    default:
+      return false;
+  }
+}
+
+
+// Decodes an encoded lcm_opencv_mat_t of any codec, eg. rbuf->data of a raw
+// lcm_subscribe() handler. img is taken from pool, and is empty for a frame
+// without pixels.
+inline bool DecodeLcmOpencvMat(const void *buf, const size_t buf_size, CvMatPool &pool, cv::Mat &img,
+                               LcmOpencvMatInfo *info = NULL){
+  LcmOpencvMatView view;
+  EXP_CHK(ParseLcmOpencvMat(buf, buf_size, view), return false)
+  if(view.length == 0 || view.rows <= 0 || view.cols <= 0)
+    img = cv::Mat();
+  else{
+    img = pool.Acquire(view.rows, view.cols, view.type);
+    EXP_CHK(DecodeLcmOpencvMatPixels(view, img), img = cv::Mat(); return false)
+  }
+  if(info != NULL)
+    *info = view.info;
+  return true;
+}
+
+
+// Encodes img into buf, which is resized to the message and keeps its capacity
+// for the next call. img need not be continuous. The top byte of
+// info.bits_in_use is replaced by the codec.
+inline bool EncodeLcmOpencvMat(const cv::Mat &img, const LcmOpencvMatInfo &info, std::vector<uint8_t> &buf,
+                               const LcmImageEncoding &encoding = LcmImageEncoding()){
+  using namespace lcm_opencv_mat_codec;
+  const size_t raw_length = img.total()*img.elemSize();
+  EXP_CHK_M(raw_length <= kMaxLength, return false, "image too large for lcm_opencv_mat_t")
+  const int64_t length = EncodePixels(img, encoding, buf, kHeaderSize);
+  EXP_CHK(length >= 0 && length <= static_cast<int64_t>(kMaxLength), return false)
+  buf.resize(kHeaderSize + length + kTrailerSize);
+
+  uint8_t *ptr = buf.data();
+  const int64_t hash = __lcm_opencv_mat_t_get_hash();
+  PutInt32(ptr, static_cast<int32_t>(hash >> 32));
+  PutInt32(ptr, static_cast<int32_t>(hash));
+  PutInt32(ptr, img.rows);
+  PutInt32(ptr, img.cols);
+  PutInt32(ptr, img.channels());
+  PutInt32(ptr, img.type());
+  PutInt32(ptr, length);
+  ptr += length;
+  const int32_t codec = length > 0 ? encoding.codec : kLcmImageRaw;
+  PutInt32(ptr, (info.bits_in_use & kBitsInUseMask) | (codec << kCodecShift));
+  *ptr++ = info.error ? 1 : 0;
+  PutInt32(ptr, info.id);
+  PutInt32(ptr, info.index);
+  return true;
+}
+
+
+// Same as lcm_opencv_mat_t_publish() on a CV_MAT_TO_LCM_FRAME frame, without
+// the per message encode buffer. Returns lcm_publish()'s result, or -1.
+inline int PublishLcmOpencvMat(lcm_t *lcm, const std::string &channel, const cv::Mat &img,
+                               const LcmOpencvMatInfo &info, std::vector<uint8_t> &encode_buf,
+                               const LcmImageEncoding &encoding = LcmImageEncoding()){
+  EXP_CHK(lcm != NULL, return -1)
+  EXP_CHK(EncodeLcmOpencvMat(img, info, encode_buf, encoding), return -1)
+  return lcm_publish(lcm, channel.c_str(), encode_buf.data(), encode_buf.size());
+}
+
+} //namespace mio
+
+#endif //__MIO_LCM_OPENCV_MAT_CODEC_H__
@@ -0,0 +1,47 @@
+#ifndef __MIO_LCM_TYPE_TRAITS_H__
+#define __MIO_LCM_TYPE_TRAITS_H__
+
+#include <lcm/lcm.h>
+#include "mio/lcm/lcm_types.h"
+
+/*
+Generic access to the lcm-gen functions of a message type, for templates that
+work with any LCM type (LcmDispatcher, LcmStats, LcmSubscribe(), ...). The mio
+LCM types are declared below, declare others once, at global scope, with
+
+  MIO_LCM_TYPE_TRAITS(lcm_create_shm_t)
+*/
+
+namespace mio{
+
+template <typename MSG_T>
+struct LcmTypeTraits;
+
+} //namespace mio
+
+#define MIO_LCM_TYPE_TRAITS(type)                                                \
+template <> struct mio::LcmTypeTraits<type> {                                    \
+  static int Decode(const void *buf, const int offset, const int maxlen, type *msg){ \
+    return type##_decode(buf, offset, maxlen, msg);                              \
+  }                                                                              \
+  static int DecodeCleanup(type *msg){                                           \
+    return type##_decode_cleanup(msg);                                           \
+  }                                                                              \
+  static int Encode(void *buf, const int offset, const int maxlen, const type *msg){ \
+    return type##_encode(buf, offset, maxlen, msg);                              \
+  }                                                                              \
+  static int GetEncodedSize(const type *msg){                                    \
+    return type##_encoded_size(msg);                                             \
+  }                                                                              \
+  static const char *GetName(){                                                  \
+    return #type;                                                                \
+  }                                                                              \
+};
+
+MIO_LCM_TYPE_TRAITS(lcm_boolean_t)
+MIO_LCM_TYPE_TRAITS(lcm_double_t)
+MIO_LCM_TYPE_TRAITS(lcm_int_t)
+MIO_LCM_TYPE_TRAITS(lcm_opencv_mat_t)
+MIO_LCM_TYPE_TRAITS(lcm_string_t)
+
+#endif //__MIO_LCM_TYPE_TRAITS_H__
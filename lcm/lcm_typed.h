@@ -0,0 +1,202 @@
+#ifndef __MIO_LCM_TYPED_H__
+#define __MIO_LCM_TYPED_H__
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <lcm/lcm.h>
+#include "mio/altro/error.h"
+#include "mio/lcm/lcm_type_traits.h"
+
+/*
+Typed LCM publish and subscribe without a hand written static callback per
+type, eg.
+
+  // Anything callable with (const MSG_T&) or (const MSG_T&, const char *channel)
+  std::unique_ptr<mio::LcmSubscription> depth_sub =
+      mio::LcmSubscribe<lcm_double_t>(lcm, "DEPTH", [&](const lcm_double_t &msg){ ... });
+  // A member function, void Display::NewDepth(const lcm_double_t &msg)
+  depth_sub = mio::LcmSubscribe<&Display::NewDepth>(lcm, "DEPTH", this);
+  depth_sub.reset(); // unsubscribes
+
+  mio::LcmPublisher<lcm_double_t> depth_pub(lcm, "DEPTH");
+  depth_pub.Publish(msg);
+  depth_pub.Publish(msg_vec.data(), msg_vec.size());
+
+The handler type is a template parameter of the subscription, so the LCM
+callback calls it directly, without a std::function or a virtual call in
+between. A subscription decodes every message into the same MSG_T and a
+publisher encodes into the same buffer, so fixed size types (lcm_double_t,
+lcm_int_t, ...) do not touch the heap per message, where the generated
+<type>_publish() mallocs an encode buffer every call. Variable length fields
+are still allocated by the generated decode; for images use DecodeLcmOpencvMat()
+with a CvMatPool instead (see lcm_opencv_mat_codec.h).
+
+Handlers run on the thread that handles the lcm_t. For small messages within
+one process, lcm_create("memq://") skips the network entirely.
+*/
+
+namespace mio{
+
+// Owns an LCM subscription, destroying it unsubscribes
+class LcmSubscription{
+  protected:
+    lcm_t *lcm_;
+    lcm_subscription_t *sub_;
+
+    LcmSubscription(lcm_t *lcm) : lcm_(lcm), sub_(NULL){}
+
+    void Unsubscribe(){
+      if(sub_ != NULL){
+        lcm_unsubscribe(lcm_, sub_);
+        sub_ = NULL;
+      }
+    }
+
+  public:
+    virtual ~LcmSubscription(){}
+
+    LcmSubscription(const LcmSubscription&) = delete;
+    LcmSubscription &operator=(const LcmSubscription&) = delete;
+
+    lcm_subscription_t *GetSubscription() const{
+      return sub_;
+    }
+
+    // Messages LCM queues for the subscription before it drops new ones
+    bool SetQueueCapacity(const int num_message){
+      EXP_CHK(sub_ != NULL, return false)
+      return lcm_subscription_set_queue_capacity(sub_, num_message) == 0;
+    }
+};
+
+
+template <typename MSG_T, typename HANDLER_T>
+class LcmTypedSubscription : public LcmSubscription{
+  HANDLER_T handler_;
+  MSG_T msg_; // decoded into for every message
+
+  static void Handle(const lcm_recv_buf_t *rbuf, const char *channel, void *userdata){
+    LcmTypedSubscription *self = static_cast<LcmTypedSubscription*>(userdata);
+    if(LcmTypeTraits<MSG_T>::Decode(rbuf->data, 0, rbuf->data_size, &self->msg_) < 0){
+      printf("LcmSubscribe - failed to decode a %s on %s\n", LcmTypeTraits<MSG_T>::GetName(), channel);
+      return;
+    }
+    if constexpr(std::is_invocable<HANDLER_T&, const MSG_T&, const char*>::value)
+      self->handler_(self->msg_, channel);
+    else
+      self->handler_(self->msg_);
+    LcmTypeTraits<MSG_T>::DecodeCleanup(&self->msg_);
+  }
+
+  public:
+    static_assert(std::is_invocable<HANDLER_T&, const MSG_T&, const char*>::value ||
+                  std::is_invocable<HANDLER_T&, const MSG_T&>::value,
+                  "the handler takes (const MSG_T&) or (const MSG_T&, const char *channel)");
+
+    template <typename H_T>
+    LcmTypedSubscription(lcm_t *lcm, const std::string &channel, H_T &&handler) :
+        LcmSubscription(lcm), handler_(std::forward<H_T>(handler)){
+      sub_ = lcm_subscribe(lcm, channel.c_str(), &Handle, this);
+    }
+
+    ~LcmTypedSubscription(){
+      Unsubscribe(); // before handler_ goes away
+    }
+};
+
+
+// Calls METHOD on an object, for LcmSubscribe<&CLASS::METHOD>()
+template <auto METHOD, typename OBJ_T>
+struct LcmMethodHandler{
+  OBJ_T *obj;
+
+  template <typename... ARG_T>
+  auto operator()(ARG_T&&... arg) const -> decltype((obj->*METHOD)(std::forward<ARG_T>(arg)...)){
+    return (obj->*METHOD)(std::forward<ARG_T>(arg)...);
+  }
+};
+
+template <typename METHOD_T>
+struct LcmMethodMsg;
+
+template <typename CLASS_T, typename MSG_T>
+struct LcmMethodMsg<void (CLASS_T::*)(const MSG_T&)>{
+  typedef MSG_T type;
+};
+
+template <typename CLASS_T, typename MSG_T>
+struct LcmMethodMsg<void (CLASS_T::*)(const MSG_T&, const char*)>{
+  typedef MSG_T type;
+};
+
+
+// Returns the subscription, or nullptr. queue_capacity 0 keeps LCM's default.
+template <typename MSG_T, typename HANDLER_T>
+std::unique_ptr<LcmSubscription> LcmSubscribe(lcm_t *lcm, const std::string &channel, HANDLER_T &&handler,
+                                              const int queue_capacity = 0){
+  EXP_CHK(lcm != NULL, return nullptr)
+  typedef LcmTypedSubscription<MSG_T, typename std::decay<HANDLER_T>::type> sub_t;
+  std::unique_ptr<LcmSubscription> sub(new sub_t(lcm, channel, std::forward<HANDLER_T>(handler)));
+  EXP_CHK_M(sub->GetSubscription() != NULL, return nullptr, "lcm_subscribe() error, channel " + channel)
+  if(queue_capacity > 0)
+    sub->SetQueueCapacity(queue_capacity);
+  return sub;
+}
+
+// Same, with a member function of obj as the handler
+template <auto METHOD, typename OBJ_T>
+std::unique_ptr<LcmSubscription> LcmSubscribe(lcm_t *lcm, const std::string &channel, OBJ_T *obj,
+                                              const int queue_capacity = 0){
+  EXP_CHK(obj != NULL, return nullptr)
+  typedef typename LcmMethodMsg<decltype(METHOD)>::type msg_t;
+  return LcmSubscribe<msg_t>(lcm, channel, LcmMethodHandler<METHOD, OBJ_T>{obj}, queue_capacity);
+}
+
+
+template <typename MSG_T>
+class LcmPublisher{
+  lcm_t *lcm_;
+  std::string channel_;
+  std::vector<uint8_t> encode_buf_; // grows to the largest message, then stays
+
+  public:
+    LcmPublisher(lcm_t *lcm, const std::string &channel) : lcm_(lcm), channel_(channel){}
+
+    const std::string &GetChannel() const{
+      return channel_;
+    }
+
+    // Returns lcm_publish()'s result, or -1
+    int Publish(const MSG_T &msg){
+      EXP_CHK(lcm_ != NULL, return -1)
+      const int size = LcmTypeTraits<MSG_T>::GetEncodedSize(&msg);
+      EXP_CHK(size >= 0, return -1)
+      if(encode_buf_.size() < static_cast<size_t>(size))
+        encode_buf_.resize(size);
+      EXP_CHK(LcmTypeTraits<MSG_T>::Encode(encode_buf_.data(), 0, size, &msg) == size, return -1)
+      return lcm_publish(lcm_, channel_.c_str(), encode_buf_.data(), size);
+    }
+
+    // Publishes the messages in order, stops at the first error. Returns the
+    // number of messages published.
+    size_t Publish(const MSG_T *msg, const size_t num_msg){
+      size_t i = 0;
+      for(; i < num_msg; ++i)
+        if(Publish(msg[i]) != 0)
+          break;
+      return i;
+    }
+
+    size_t Publish(const std::vector<MSG_T> &msg_vec){
+      return Publish(msg_vec.data(), msg_vec.size());
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_LCM_TYPED_H__
@@ -1,9 +1,22 @@
 #ifndef __MIO_LCM_UTIL_H__
 #define __MIO_LCM_UTIL_H__
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <sys/select.h>
 #include <lcm/lcm.h>
-#include <thread>
 #include "mio/altro/error.h"
+#include "mio/altro/event_loop.h"
+#include "mio/altro/exception.h"
+#include "mio/lcm/lcm_type_traits.h"
 
 
 #define CV_MAT_TO_LCM_FRAME(mat, frame)          \
@@ -31,48 +44,367 @@ inline bool lcm_handle_to(lcm_t *lcm, int lcm_fd, long int tv_sec_, long int tv_
     lcm_handle(lcm); //event(s) ready to be processed
     return true;
   }
+  return false; // select() error
 }
 
 
+namespace mio{
+
+// Dispatches the lcm_t's messages from event_loop's thread. Any number of
+// lcm_t instances can share one loop and one thread.
+inline bool AddLcmToEventLoop(EventLoop &event_loop, lcm_t *lcm){
+  EXP_CHK(lcm != nullptr, return false)
+  return event_loop.AddFd(lcm_get_fileno(lcm), [lcm](uint32_t){ lcm_handle(lcm); });
+}
+
+inline bool RemoveLcmFromEventLoop(EventLoop &event_loop, lcm_t *lcm){
+  EXP_CHK(lcm != nullptr, return false)
+  return event_loop.RemoveFd( lcm_get_fileno(lcm) );
+}
+
+
+inline int64_t GetLcmUtime(){
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+
+// Times in power of two buckets, bucket i holds [2^(i-1), 2^i) microseconds
+struct LcmTimeHistogram{
+  static const int kNumBucket = 28; // the last bucket holds everything from ~67 s on
+
+  uint64_t bucket[kNumBucket];
+  uint64_t count;
+  int64_t max_us;
+
+  LcmTimeHistogram() : count(0), max_us(0){
+    std::fill(bucket, bucket + kNumBucket, 0);
+  }
+
+  static int GetBucket(const int64_t us){
+    int idx = 0;
+    for(uint64_t v = us > 0 ? us : 0; v > 0 && idx < kNumBucket - 1; v >>= 1)
+      ++idx;
+    return idx;
+  }
+
+  // Upper bound of the bucket that holds the p-th fraction (0 to 1) of the times
+  int64_t GetPercentile(const double p) const{
+    if(count == 0)
+      return 0;
+    const uint64_t rank = std::max<uint64_t>(1, std::ceil(p * count));
+    uint64_t sum = 0;
+    for(int i = 0; i < kNumBucket; ++i)
+      if((sum += bucket[i]) >= rank)
+        return std::min<int64_t>(max_us, i == 0 ? 0 : int64_t(1) << i);
+    return max_us;
+  }
+};
+
+
+// What LcmStats reports per subscription
+struct LcmChannelStats{
+  std::string channel; // as subscribed, a regex
+  uint64_t num_msg, num_byte;
+  uint64_t num_dropped;    // gaps in the message sequence, when the subscription has one
+  uint64_t num_queue_full; // messages handled while the subscription queue was full, LCM drops arrivals then
+  uint64_t num_decode_error;
+  double msg_rate, byte_rate; // per second since the previous GetStats()
+  LcmTimeHistogram handler_time;    // handler run time
+  LcmTimeHistogram queue_latency;   // receive to handler start
+  LcmTimeHistogram publish_latency; // publisher's timestamp to handler start, when the subscription has one
+};
+
+
+// Optional per message fields that LcmStats can use, eg. for lcm_opencv_mat_t
+//   stamp.seq = [](const lcm_opencv_mat_t &msg){ return msg.id; };
+template <typename MSG_T>
+struct LcmStamp{
+  std::function<int64_t(const MSG_T&)> seq;           // consecutive numbers, gaps count as drops
+  std::function<int64_t(const MSG_T&)> publish_utime; // publisher's GetLcmUtime() (gettimeofday) time
+};
+
+
+/*
+Wraps LCM subscriptions to count, per subscription, messages and bytes, handler
+run times, the time messages waited in the LCM queue, the publish to handle
+latency and dropped messages, eg.
+
+  mio::LcmStats lcm_stats;
+  sub = lcm_stats.Subscribe(lcm, "ipcs_destroy_shm", &DestroyShm, this, 3);  // instead of lcm_destroy_shm_t_subscribe()
+  ...
+  lcm_stats.Unsubscribe(lcm, sub);
+
+  std::vector<mio::LcmChannelStats> stats_vec;
+  lcm_stats.GetStats(stats_vec);                         // poll, or
+  lcm_stats.StartPublish(event_loop, lcm, "LCM_STATS");  // publish FormatStats() as lcm_string_t every second
+
+LCM drops messages without telling anyone once a subscription queue is full.
+The queue is checked at every message (num_queue_full), and a subscription
+whose messages carry a sequence number counts the exact gaps (num_dropped).
+Recording takes a few relaxed atomic increments per message, the handler
+does not take a lock.
+*/
+class LcmStats{
+  struct AtomicHistogram{
+    std::atomic<uint64_t> bucket[LcmTimeHistogram::kNumBucket];
+    std::atomic<int64_t> max_us;
+
+    AtomicHistogram() : max_us(0){
+      for(auto &b : bucket)
+        b = 0;
+    }
+
+    void Add(const int64_t us){
+      bucket[LcmTimeHistogram::GetBucket(us)].fetch_add(1, std::memory_order_relaxed);
+      int64_t max = max_us.load(std::memory_order_relaxed);
+      while(us > max && !max_us.compare_exchange_weak(max, us, std::memory_order_relaxed)){}
+    }
+
+    void Get(LcmTimeHistogram &hist) const{
+      hist.count = 0;
+      for(int i = 0; i < LcmTimeHistogram::kNumBucket; ++i)
+        hist.count += (hist.bucket[i] = bucket[i].load(std::memory_order_relaxed));
+      hist.max_us = max_us.load(std::memory_order_relaxed);
+    }
+  };
+
+  struct Subscription{
+    std::string channel;
+    int queue_capacity;
+    lcm_subscription_t *sub;
+    std::function<void(const lcm_recv_buf_t*, const char*, Subscription*)> handle; // decodes and calls the handler
+    std::atomic<uint64_t> num_msg, num_byte, num_dropped, num_queue_full, num_decode_error;
+    AtomicHistogram handler_time, queue_latency, publish_latency;
+    int64_t last_seq; // handler thread only
+    bool have_seq;
+    // Poll state, guarded by mtx_
+    std::chrono::steady_clock::time_point poll_time;
+    uint64_t poll_num_msg, poll_num_byte;
+
+    Subscription() : num_msg(0), num_byte(0), num_dropped(0), num_queue_full(0), num_decode_error(0),
+        have_seq(false), poll_time(std::chrono::steady_clock::now()), poll_num_msg(0), poll_num_byte(0){}
+
+    void AddSeq(const int64_t seq){
+      if(have_seq && seq > last_seq + 1)
+        num_dropped.fetch_add(seq - last_seq - 1, std::memory_order_relaxed);
+      last_seq = seq;
+      have_seq = true;
+    }
+  };
+
+  std::mutex mtx_; // guards sub_vec_ and the poll state
+  std::vector< std::unique_ptr<Subscription> > sub_vec_;
+  EventLoop *publish_event_loop_;
+  int publish_timer_id_;
+
+  static void OnMessage(const lcm_recv_buf_t *rbuf, const char *channel, void *userdata){
+    Subscription *sub = static_cast<Subscription*>(userdata);
+    const int64_t start_utime = GetLcmUtime();
+    sub->num_msg.fetch_add(1, std::memory_order_relaxed);
+    sub->num_byte.fetch_add(rbuf->data_size, std::memory_order_relaxed);
+    sub->queue_latency.Add(start_utime - rbuf->recv_utime);
+    if(sub->queue_capacity > 0 && lcm_subscription_get_queue_size(sub->sub) >= sub->queue_capacity)
+      sub->num_queue_full.fetch_add(1, std::memory_order_relaxed);
+    const auto start = std::chrono::steady_clock::now();
+    sub->handle(rbuf, channel, sub);
+    sub->handler_time.Add( std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count() );
+  }
+
+  lcm_subscription_t *Add(lcm_t *lcm, std::unique_ptr<Subscription> sub){
+    EXP_CHK(lcm != NULL, return NULL)
+    sub->sub = lcm_subscribe(lcm, sub->channel.c_str(), &OnMessage, sub.get());
+    EXP_CHK_M(sub->sub != NULL, return NULL, "lcm_subscribe() error, channel " + sub->channel)
+    if(sub->queue_capacity > 0)
+      lcm_subscription_set_queue_capacity(sub->sub, sub->queue_capacity);
+    lcm_subscription_t *lcm_sub = sub->sub;
+    std::lock_guard<std::mutex> lock(mtx_);
+    sub_vec_.push_back(std::move(sub));
+    return lcm_sub;
+  }
+
+  public:
+    LcmStats() : publish_event_loop_(NULL), publish_timer_id_(-1){}
+
+    // Unsubscribe before the LcmStats goes away, LCM keeps pointers into it
+    ~LcmStats(){
+      StopPublish();
+    }
+
+    LcmStats(const LcmStats&) = delete;
+    LcmStats &operator=(const LcmStats&) = delete;
+
+    // Same as the generated <type>_subscribe(), plus the subscription queue
+    // capacity (0 keeps LCM's default). Unsubscribe with Unsubscribe().
+    template <typename MSG_T>
+    lcm_subscription_t *Subscribe(lcm_t *lcm, const std::string &channel,
+                                  void (*handler)(const lcm_recv_buf_t*, const char*, const MSG_T*, void*),
+                                  void *userdata, const int queue_capacity = 0,
+                                  const LcmStamp<MSG_T> &stamp = LcmStamp<MSG_T>()){
+      EXP_CHK(handler != NULL, return NULL)
+      std::unique_ptr<Subscription> sub(new Subscription);
+      sub->channel = channel;
+      sub->queue_capacity = queue_capacity;
+      sub->handle = [handler, userdata, stamp](const lcm_recv_buf_t *rbuf, const char *channel, Subscription *sub){
+        MSG_T msg;
+        if(LcmTypeTraits<MSG_T>::Decode(rbuf->data, 0, rbuf->data_size, &msg) < 0){
+          sub->num_decode_error.fetch_add(1, std::memory_order_relaxed);
+          return;
+        }
+        if(stamp.seq)
+          sub->AddSeq( stamp.seq(msg) );
+        if(stamp.publish_utime)
+          sub->publish_latency.Add( GetLcmUtime() - stamp.publish_utime(msg) );
+        handler(rbuf, channel, &msg, userdata);
+        LcmTypeTraits<MSG_T>::DecodeCleanup(&msg);
+      };
+      return Add(lcm, std::move(sub));
+    }
+
+    // Same as lcm_subscribe(), for handlers that decode themselves
+    lcm_subscription_t *SubscribeRaw(lcm_t *lcm, const std::string &channel, lcm_msg_handler_t handler,
+                                     void *userdata, const int queue_capacity = 0){
+      EXP_CHK(handler != NULL, return NULL)
+      std::unique_ptr<Subscription> sub(new Subscription);
+      sub->channel = channel;
+      sub->queue_capacity = queue_capacity;
+      sub->handle = [handler, userdata](const lcm_recv_buf_t *rbuf, const char *channel, Subscription*){
+        handler(rbuf, channel, userdata);
+      };
+      return Add(lcm, std::move(sub));
+    }
+
+    bool Unsubscribe(lcm_t *lcm, lcm_subscription_t *lcm_sub){
+      EXP_CHK(lcm != NULL && lcm_sub != NULL, return false)
+      EXP_CHK(lcm_unsubscribe(lcm, lcm_sub) == 0, return false)
+      std::lock_guard<std::mutex> lock(mtx_);
+      for(auto sub_it = sub_vec_.begin(); sub_it != sub_vec_.end(); ++sub_it)
+        if((*sub_it)->sub == lcm_sub){
+          sub_vec_.erase(sub_it);
+          break;
+        }
+      return true;
+    }
+
+    // One entry per subscription. The rates cover the time since the previous call.
+    void GetStats(std::vector<LcmChannelStats> &stats_vec){
+      std::lock_guard<std::mutex> lock(mtx_);
+      const auto now = std::chrono::steady_clock::now();
+      stats_vec.resize( sub_vec_.size() );
+      for(size_t i = 0; i < sub_vec_.size(); ++i){
+        Subscription &sub = *sub_vec_[i];
+        LcmChannelStats &stats = stats_vec[i];
+        stats.channel = sub.channel;
+        stats.num_msg = sub.num_msg.load(std::memory_order_relaxed);
+        stats.num_byte = sub.num_byte.load(std::memory_order_relaxed);
+        stats.num_dropped = sub.num_dropped.load(std::memory_order_relaxed);
+        stats.num_queue_full = sub.num_queue_full.load(std::memory_order_relaxed);
+        stats.num_decode_error = sub.num_decode_error.load(std::memory_order_relaxed);
+        const double elapsed = std::chrono::duration<double>(now - sub.poll_time).count();
+        stats.msg_rate = elapsed > 0 ? (stats.num_msg - sub.poll_num_msg) / elapsed : 0;
+        stats.byte_rate = elapsed > 0 ? (stats.num_byte - sub.poll_num_byte) / elapsed : 0;
+        sub.poll_time = now;
+        sub.poll_num_msg = stats.num_msg;
+        sub.poll_num_byte = stats.num_byte;
+        sub.handler_time.Get(stats.handler_time);
+        sub.queue_latency.Get(stats.queue_latency);
+        sub.publish_latency.Get(stats.publish_latency);
+      }
+    }
+
+    // One line per subscription, times are p50/p99/max in microseconds
+    static std::string FormatStats(const std::vector<LcmChannelStats> &stats_vec){
+      std::string str;
+      char line[512];
+      for(const LcmChannelStats &stats : stats_vec){
+        snprintf(line, sizeof(line), "%s: %.1f msg/s, %.3f MB/s, %lu msgs, %lu dropped, %lu queue full, "
+                 "handler %ld/%ld/%ld us, queued %ld/%ld/%ld us", stats.channel.c_str(), stats.msg_rate,
+                 stats.byte_rate/1e6, static_cast<unsigned long>(stats.num_msg),
+                 static_cast<unsigned long>(stats.num_dropped), static_cast<unsigned long>(stats.num_queue_full),
+                 static_cast<long>(stats.handler_time.GetPercentile(0.5)),
+                 static_cast<long>(stats.handler_time.GetPercentile(0.99)), static_cast<long>(stats.handler_time.max_us),
+                 static_cast<long>(stats.queue_latency.GetPercentile(0.5)),
+                 static_cast<long>(stats.queue_latency.GetPercentile(0.99)), static_cast<long>(stats.queue_latency.max_us));
+        str += line;
+        if(stats.publish_latency.count > 0){
+          snprintf(line, sizeof(line), ", published %ld/%ld/%ld us",
+                   static_cast<long>(stats.publish_latency.GetPercentile(0.5)),
+                   static_cast<long>(stats.publish_latency.GetPercentile(0.99)),
+                   static_cast<long>(stats.publish_latency.max_us));
+          str += line;
+        }
+        str += "\n";
+      }
+      return str;
+    }
+
+    // Publishes FormatStats() as an lcm_string_t on channel every period, from
+    // event_loop's thread. The publish rates cover one period.
+    bool StartPublish(EventLoop &event_loop, lcm_t *lcm, const std::string &channel = "LCM_STATS",
+                      const std::chrono::milliseconds period = std::chrono::milliseconds(1000)){
+      EXP_CHK(lcm != NULL && publish_timer_id_ == -1, return false)
+      publish_event_loop_ = &event_loop;
+      publish_timer_id_ = event_loop.AddTimer([this, lcm, channel](){
+        std::vector<LcmChannelStats> stats_vec;
+        GetStats(stats_vec);
+        std::string str = FormatStats(stats_vec);
+        lcm_string_t msg;
+        msg.str = &str[0];
+        lcm_string_t_publish(lcm, channel.c_str(), &msg);
+      }, period, period);
+      return publish_timer_id_ != -1;
+    }
+
+    void StopPublish(){
+      if(publish_timer_id_ != -1){
+        publish_event_loop_->RemoveTimer(publish_timer_id_);
+        publish_timer_id_ = -1;
+      }
+    }
+};
+
+} //namespace mio
+
+
+// Handles one lcm_t on a thread of its own. To handle several lcm_t instances,
+// sockets or timers on one thread, add them to a shared mio::EventLoop instead.
 class LCMHandlerThread{
   public:
-    bool exit_thread_, started_;
-    std::thread thread_;
+    bool started_;
     lcm_t *lcm_;
+    mio::EventLoop event_loop_;
 
-    LCMHandlerThread() : exit_thread_(false), started_(false){}
+    LCMHandlerThread() : started_(false), lcm_(nullptr){}
 
-    LCMHandlerThread(lcm_t *lcm) : exit_thread_(false), started_(false){
+    LCMHandlerThread(lcm_t *lcm) : started_(false){
       STD_INVALID_ARG_E(lcm != nullptr)
       lcm_ = lcm;
     }
 
+    ~LCMHandlerThread(){
+      if(started_)
+        Stop();
+    }
+
     void SetLCM(lcm_t *lcm){
       STD_INVALID_ARG_E(lcm != nullptr)
+      EXP_CHK(started_ == false, return)
       lcm_ = lcm;
     }
 
-    void Thread(){
-      int lcm_fd = lcm_get_fileno(lcm_);
-      for(;;){
-        if(exit_thread_)
-          break;
-        lcm_handle_to(lcm_, lcm_fd, 1);
-      }
-    }
-
     void Start(){
       EXP_CHK(started_ == false, return)
-      exit_thread_ = false;
-      thread_ = std::thread(&LCMHandlerThread::Thread, this);
+      EXP_CHK(mio::AddLcmToEventLoop(event_loop_, lcm_), return)
+      event_loop_.Start();
       printf("%s - started\n", CURRENT_FUNC);
       started_ = true;
     }
 
     void Stop(){
       EXP_CHK(started_ == true, return)
-      exit_thread_ = true;
-      thread_.join();
+      event_loop_.Stop();
+      mio::RemoveLcmFromEventLoop(event_loop_, lcm_);
       printf("%s - stopped\n", CURRENT_FUNC);
       started_ = false;
     }
@@ -10,6 +10,11 @@
 
 #define QT_LCM_SOCKET_NOTIFIER_SLOT(class, lcm_object) void DataReady(int fd){ lcm_handle(class::lcm_object); }
 
+// Same, for a mio::LcmKeepLatest (see mio/lcm/lcm_keep_latest.h): drains the socket and hands
+// each keep-latest channel only its newest message, so a UI that fell behind skips stale frames
+#define QT_LCM_SOCKET_NOTIFIER_SLOT_KEEP_LATEST(class, keep_latest_object) \
+void DataReady(int fd){ class::keep_latest_object->HandleAvailable(); }
+
 
 // 1. A Qt socket notifier watches the lcm file descriptor
 // 2. When something changes in the file descriptor, the socket notifier calls DataReady(int)
@@ -0,0 +1,140 @@
+#include "mio/lcm/lcm_dispatch.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock std_sc_t;
+
+const char kUrl[] = "memq://";
+
+
+// Publishes the values on channel and has lcm_handle() pass each one to the dispatcher
+static bool PublishAndHandle(lcm_t *lcm, const std::string &channel, const int first_val, const int num_msg) {
+  lcm_int_t msg;
+  for (int i = 0; i < num_msg; ++i) {
+    msg.val = first_val + i;
+    EXP_CHK(lcm_int_t_publish(lcm, channel.c_str(), &msg) == 0, return false)
+    EXP_CHK(lcm_handle(lcm) == 0, return false)
+  }
+  return true;
+}
+
+
+// Waits up to 2 seconds for the channel to have handled num_handled messages
+static bool WaitHandled(mio::LcmDispatcher &dispatcher, const std::string &channel, const uint64_t num_handled) {
+  const std_sc_t::time_point give_up_time = std_sc_t::now() + std::chrono::seconds(2);
+  uint64_t num_dropped, cur_num_handled = 0;
+  while (std_sc_t::now() < give_up_time) {
+    EXP_CHK(dispatcher.GetStats(channel, num_dropped, cur_num_handled), return false)
+    if (cur_num_handled >= num_handled)
+      return cur_num_handled == num_handled;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return false;
+}
+
+
+// Handled values, in the order the handlers ran, and the most handlers that ran at once
+struct Recorder {
+  std::mutex mtx;
+  std::vector<int> val_vec;
+  int num_active = 0, max_active = 0;
+
+  std::function<void(const lcm_int_t&, const std::string&)> Handler(const std::chrono::milliseconds delay) {
+    return [this, delay](const lcm_int_t &msg, const std::string&) {
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        max_active = std::max(max_active, ++num_active);
+      }
+      std::this_thread::sleep_for(delay);
+      std::lock_guard<std::mutex> lock(mtx);
+      --num_active;
+      val_vec.push_back(msg.val);
+    };
+  }
+};
+
+
+// With the workers stopped, a full queue keeps the newest queue_capacity messages
+static bool TestDropOldest(lcm_t *lcm, const bool ordered) {
+  const std::string channel = ordered ? "DROP_ORDERED" : "DROP_UNORDERED";
+  mio::LcmDispatcher dispatcher(lcm, 4);
+  Recorder recorder;
+  EXP_CHK(dispatcher.Subscribe<lcm_int_t>(channel, recorder.Handler(std::chrono::milliseconds(0)),
+                                          mio::LcmChannelPolicy(4, mio::LcmChannelPolicy::kDropOldest, ordered)),
+          return false)
+  EXP_CHK(PublishAndHandle(lcm, channel, 0, 100), return false)
+  uint64_t num_dropped, num_handled;
+  EXP_CHK(dispatcher.GetStats(channel, num_dropped, num_handled), return false)
+  EXP_CHK(num_dropped == 96 && num_handled == 0, return false)
+
+  dispatcher.Start();
+  EXP_CHK(WaitHandled(dispatcher, channel, 4), return false)
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));  // nothing else may run
+  dispatcher.Stop();
+  EXP_CHK(dispatcher.GetStats(channel, num_dropped, num_handled) && num_handled == 4, return false)
+  std::sort(recorder.val_vec.begin(), recorder.val_vec.end());
+  EXP_CHK(recorder.val_vec == std::vector<int>({96, 97, 98, 99}), return false)
+  return true;
+}
+
+
+// A full queue holds up lcm_handle() until a worker makes room, nothing is dropped
+static bool TestBlock(lcm_t *lcm) {
+  const std::string channel = "BLOCK";
+  mio::LcmDispatcher dispatcher(lcm, 2);
+  Recorder recorder;
+  EXP_CHK(dispatcher.Subscribe<lcm_int_t>(channel, recorder.Handler(std::chrono::milliseconds(2)),
+                                          mio::LcmChannelPolicy(2, mio::LcmChannelPolicy::kBlock)), return false)
+  dispatcher.Start();
+  EXP_CHK(PublishAndHandle(lcm, channel, 0, 20), return false)
+  EXP_CHK(WaitHandled(dispatcher, channel, 20), return false)
+  dispatcher.Stop();
+  uint64_t num_dropped, num_handled;
+  EXP_CHK(dispatcher.GetStats(channel, num_dropped, num_handled) && num_dropped == 0, return false)
+  for (int i = 0; i < 20; ++i)
+    EXP_CHK(recorder.val_vec[i] == i, return false)
+  return true;
+}
+
+
+// An ordered channel runs one handler at a time in arrival order, an unordered one spreads over the workers
+static bool TestOrdered(lcm_t *lcm) {
+  const int kNumMsg = 8;
+  mio::LcmDispatcher dispatcher(lcm, 4);
+  Recorder ordered_recorder, unordered_recorder;
+  EXP_CHK(dispatcher.Subscribe<lcm_int_t>("ORDERED", ordered_recorder.Handler(std::chrono::milliseconds(5)),
+                                          mio::LcmChannelPolicy(kNumMsg, mio::LcmChannelPolicy::kBlock, true)),
+          return false)
+  EXP_CHK(dispatcher.Subscribe<lcm_int_t>("UNORDERED", unordered_recorder.Handler(std::chrono::milliseconds(20)),
+                                          mio::LcmChannelPolicy(kNumMsg, mio::LcmChannelPolicy::kBlock, false)),
+          return false)
+  dispatcher.Start();
+  EXP_CHK(PublishAndHandle(lcm, "ORDERED", 0, kNumMsg), return false)
+  EXP_CHK(PublishAndHandle(lcm, "UNORDERED", 0, kNumMsg), return false)
+  EXP_CHK(WaitHandled(dispatcher, "ORDERED", kNumMsg), return false)
+  EXP_CHK(WaitHandled(dispatcher, "UNORDERED", kNumMsg), return false)
+  dispatcher.Stop();
+
+  EXP_CHK(ordered_recorder.max_active == 1, return false)
+  for (int i = 0; i < kNumMsg; ++i)
+    EXP_CHK(ordered_recorder.val_vec[i] == i, return false)
+  EXP_CHK(unordered_recorder.max_active > 1, return false)
+  return true;
+}
+
+
+int main() {
+  lcm_t *lcm = lcm_create(kUrl);
+  EXP_CHK_M(lcm != NULL, return -1, std::string("lcm_create() error, ") + kUrl)
+  EXP_CHK_M(TestDropOldest(lcm, true), return -1, "drop oldest, ordered")
+  EXP_CHK_M(TestDropOldest(lcm, false), return -1, "drop oldest, unordered")
+  EXP_CHK_M(TestBlock(lcm), return -1, "block")
+  EXP_CHK_M(TestOrdered(lcm), return -1, "ordered")
+  lcm_destroy(lcm);
+  std::cout << "passed\n";
+  return 0;
+}
@@ -0,0 +1,119 @@
+#include "mio/lcm/lcm_log.h"
+#include <csignal>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+const char kLogPath[] = "/tmp/lcm_log_test.miolog";
+const char *const kChannel[3] = {"CAMERA_0", "CAMERA_1", "STATUS"};
+const int kNumEvent = 300;
+
+
+// Event i is on channel i % 3, at 1 ms steps, and its bytes are a pattern of
+// i. The camera messages are large enough that the log spans several windows.
+static std::vector<uint8_t> EventData(const int i) {
+  std::vector<uint8_t> data((i % 3 == 2) ? 100 + i : 512*1024 + 8*i);
+  for (size_t j = 0; j < data.size(); ++j)
+    data[j] = static_cast<uint8_t>(i + j/4096);
+  return data;
+}
+
+
+static bool WriteEvents(mio::LcmLogRecorder &recorder, const int num_event) {
+  for (int i = 0; i < num_event; ++i) {
+    const std::vector<uint8_t> data = EventData(i);
+    EXP_CHK(recorder.Write(kChannel[i % 3], 1000*i, data.data(), data.size()), return false)
+  }
+  return true;
+}
+
+
+// Reads the log back through Next() and the per channel index
+static bool CheckLog(const int num_event) {
+  mio::LcmLogReplayer replayer;
+  EXP_CHK(replayer.Open(kLogPath), return false)
+  EXP_CHK(replayer.GetNumEvent() == static_cast<uint64_t>(num_event), return false)
+  EXP_CHK(replayer.GetChannels().size() == 3, return false)
+  EXP_CHK(replayer.GetStartUtime() == 0 && replayer.GetEndUtime() == 1000*(num_event - 1), return false)
+  mio::LcmLogEvent event;
+  for (int i = 0; i < num_event; ++i) {
+    EXP_CHK(replayer.Next(event), return false)
+    const std::vector<uint8_t> data = EventData(i);
+    EXP_CHK(event.event_num == static_cast<uint64_t>(i) && event.utime == 1000*i, return false)
+    EXP_CHK(*event.channel == kChannel[i % 3], return false)
+    EXP_CHK(event.data_size == data.size() && memcmp(event.data, data.data(), data.size()) == 0, return false)
+  }
+  EXP_CHK(!replayer.Next(event), return false)
+
+  // The first STATUS event at or after 100 ms is event 101, the first event is 100
+  EXP_CHK(replayer.FindEvent(100000, "STATUS") == 101 && replayer.FindEvent(100000) == 100, return false)
+  EXP_CHK(replayer.FindEvent(1000*num_event) == static_cast<uint64_t>(num_event), return false)
+  replayer.Seek(100000, "STATUS");
+  EXP_CHK(replayer.Next(event) && event.event_num == 101 && *event.channel == "STATUS", return false)
+  return true;
+}
+
+
+// Write, Close() and read back through the index
+static bool TestRoundTrip() {
+  mio::LcmLogRecorder recorder;
+  EXP_CHK(recorder.Open(kLogPath), return false)
+  EXP_CHK(WriteEvents(recorder, kNumEvent), return false)
+  EXP_CHK(recorder.GetNumEvent() == kNumEvent, return false)
+  EXP_CHK(recorder.Close(), return false)
+  return CheckLog(kNumEvent);
+}
+
+
+// A recorder that exits without Close() leaves a log without index, the
+// replayer rebuilds it from the records
+static bool TestNoIndex() {
+  const pid_t pid = fork();
+  EXP_CHK_ERRNO(pid != -1, return false)
+  if (pid == 0) {
+    mio::LcmLogRecorder recorder;
+    _exit((recorder.Open(kLogPath) && WriteEvents(recorder, kNumEvent)) ? 0 : 1);
+  }
+  int status;
+  EXP_CHK_ERRNO(waitpid(pid, &status, 0) == pid, return false)
+  EXP_CHK(WIFEXITED(status) && WEXITSTATUS(status) == 0, return false)
+  return CheckLog(kNumEvent);
+}
+
+
+// A file that can not grow past the first window (RLIMIT_FSIZE stands in for
+// a full disk) fails Write(), and the events written so far are kept
+static bool TestFull() {
+  struct rlimit limit, old_limit;
+  EXP_CHK_ERRNO(getrlimit(RLIMIT_FSIZE, &old_limit) == 0, return false)
+  signal(SIGXFSZ, SIG_IGN);
+  limit = old_limit;
+  limit.rlim_cur = 100*1024*1024;
+  EXP_CHK_ERRNO(setrlimit(RLIMIT_FSIZE, &limit) == 0, return false)
+
+  mio::LcmLogRecorder recorder;
+  EXP_CHK(recorder.Open(kLogPath), setrlimit(RLIMIT_FSIZE, &old_limit); return false)
+  int num_written = 0;
+  for (; num_written < kNumEvent; ++num_written) {
+    const std::vector<uint8_t> data = EventData(num_written);
+    if (!recorder.Write(kChannel[num_written % 3], 1000*num_written, data.data(), data.size()))
+      break;
+  }
+  const bool closed = recorder.Close();
+  setrlimit(RLIMIT_FSIZE, &old_limit);
+  signal(SIGXFSZ, SIG_DFL);
+  EXP_CHK(num_written > 0 && num_written < kNumEvent && closed, return false)
+  return CheckLog(num_written);
+}
+
+
+int main() {
+  EXP_CHK_M(TestRoundTrip(), return -1, "round trip")
+  EXP_CHK_M(TestNoIndex(), return -1, "no index")
+  EXP_CHK_M(TestFull(), return -1, "full")
+  unlink(kLogPath);
+  std::cout << "passed\n";
+  return 0;
+}
@@ -26,6 +26,7 @@ AdvImageDisplay::~AdvImageDisplay(){
   if(lcm_is_init_){
     disconnect(AdvImageDisplay::socket_notifier_, SIGNAL(activated(int)), this, SLOT(DataReady(int)));
     delete AdvImageDisplay::socket_notifier_;
+    lcm_keep_latest_.reset();
     lcm_destroy(AdvImageDisplay::lcm_);
   }
 #endif
@@ -862,20 +863,23 @@ void AdvImageDisplay::SetupLcm(const std::string kNewFrameLcmChanNamePrefix){
   connect(AdvImageDisplay::socket_notifier_, SIGNAL(activated(int)), this, SLOT(DataReady(int)));
 
   std::string new_frame_lcm_chan_name = kNewFrameLcmChanNamePrefix + "_" + std::to_string(id_);
-  new_frame_lcm_sub_ = lcm_opencv_mat_t_subscribe(AdvImageDisplay::lcm_, new_frame_lcm_chan_name.c_str(),
-                                                  &NewFrameLCM, static_cast<void*>(this));
-  lcm_opencv_mat_t_subscription_set_queue_capacity(new_frame_lcm_sub_, 2);
+  // Raw subscription, NewFrameLCM() decodes straight into lcm_frame_pool_. Frames that queued up
+  // while the UI was busy are coalesced, only the newest one is decoded.
+  lcm_keep_latest_.reset( new LcmKeepLatest(AdvImageDisplay::lcm_) );
+  EXP_CHK(lcm_keep_latest_->Subscribe(new_frame_lcm_chan_name, &NewFrameLCM, static_cast<void*>(this), 2), return)
   lcm_is_init_ = true;
 #endif
 }
 
 
 #ifdef HAVE_LCM
-void AdvImageDisplay::NewFrameLCM(const lcm_recv_buf_t *rbuf, const char *channel, 
-                                  const lcm_opencv_mat_t *msg, void *userdata){
+void AdvImageDisplay::NewFrameLCM(const lcm_recv_buf_t *rbuf, const char *channel, void *userdata){
   AdvImageDisplay *w = static_cast<AdvImageDisplay*>(userdata);
-  const cv::Mat kImg(msg->rows, msg->cols, msg->openCvType, msg->data);
-  w->SetImage(kImg, true);
+  cv::Mat img;
+  EXP_CHK(DecodeLcmOpencvMat(rbuf->data, rbuf->data_size, w->lcm_frame_pool_, img), return)
+  // img is a pool buffer nobody else writes to, it goes back to the pool once src_img_ moves on
+  if( !img.empty() )
+    w->SetImage(img, false);
 }
 #endif
 
@@ -19,6 +19,8 @@
 #include "mio/qt/cv_mat_to_qimage.h"
 #ifdef HAVE_LCM
 #include "mio/lcm/lcm_types.h"
+#include "mio/lcm/lcm_opencv_mat_codec.h"
+#include "mio/lcm/lcm_keep_latest.h"
 #endif
 
 #if CV_MAJOR_VERSION < 3
@@ -112,7 +114,8 @@ class AdvImageDisplay : public QWidget{
     cv::Point2d mouse_button_press_init_pos_, mouse_drag_;
 #ifdef HAVE_LCM
     lcm_t *lcm_;
-    lcm_opencv_mat_t_subscription_t *new_frame_lcm_sub_;
+    std::unique_ptr<LcmKeepLatest> lcm_keep_latest_; // renders only the newest of the queued frames
+    CvMatPool lcm_frame_pool_; // frames are decoded into it, so no clone is needed
     QSocketNotifier *socket_notifier_;
     int lcm_fd_;
     bool lcm_is_init_;
@@ -145,14 +148,13 @@ class AdvImageDisplay : public QWidget{
     void UpdateZoom();
     void ResetZoom();
 #ifdef HAVE_LCM
-    static void NewFrameLCM(const lcm_recv_buf_t *rbuf, const char * channel, 
-                            const lcm_opencv_mat_t * msg, void * userdata);
+    static void NewFrameLCM(const lcm_recv_buf_t *rbuf, const char * channel, void * userdata);
 #endif
 
   private slots:
     void UpdateDisplay();
 #ifdef HAVE_LCM
-    void DataReady(int fd){ lcm_handle(AdvImageDisplay::lcm_); }
+    void DataReady(int fd){ lcm_keep_latest_->HandleAvailable(); }
 #endif
 
   signals:
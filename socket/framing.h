@@ -0,0 +1,248 @@
+#ifndef __MIO_FRAMING_H__
+#define __MIO_FRAMING_H__
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <sys/socket.h>
+#include "mio/altro/error.h"
+
+/*
+Length-prefixed message framing for stream sockets. Every frame is a 24 byte
+header followed by length bytes of payload:
+
+  offset  size  field
+  0       2     magic (kFrameMagic), a stream that lost sync fails on it
+  2       2     type, application defined
+  4       4     length of the payload
+  8       4     sequence, counted per sender by FrameEncoder
+  12      4     reserved, 0
+  16      8     utime, send time in microseconds since the epoch
+
+Fields are little-endian. A sender fills the header with a FrameEncoder and
+sends it with the payload in one sendmsg() (see mio::SendFrame() in
+socket.h). The receiver recv()s into a FrameDecoder, which takes every
+complete frame out of one read, eg.
+
+  mio::FrameDecoder decoder;
+  while(decoder.Recv(sock_fd) > 0){
+    mio::FrameView frame;
+    while(decoder.Next(frame))
+      Handle(frame.header.type, frame.payload, frame.header.length);
+    EXP_CHK(!decoder.IsCorrupt(), break)
+  }
+
+A FrameView points into the decoder's buffer and is valid until the next
+Recv()/Feed(). The buffer is used like a ring: frames are read from the front
+and the unread bytes, at most one partial frame, are moved back to the start
+when the end is reached, so a frame is always contiguous. It only grows when
+a frame does not fit.
+*/
+
+namespace mio{
+
+const uint16_t kFrameMagic = 0x4d46; // "FM" on the wire
+const size_t kFrameHeaderSize = 24;
+
+struct FrameHeader{
+  uint16_t type;
+  uint32_t length;
+  uint32_t sequence;
+  int64_t utime;
+};
+
+struct FrameView{
+  FrameHeader header;
+  const uint8_t *payload;
+};
+
+
+inline void PutLe(uint8_t *dst, const uint64_t value, const size_t num_byte){
+  for(size_t i = 0; i < num_byte; ++i)
+    dst[i] = static_cast<uint8_t>(value >> (8*i));
+}
+
+inline uint64_t GetLe(const uint8_t *src, const size_t num_byte){
+  uint64_t value = 0;
+  for(size_t i = 0; i < num_byte; ++i)
+    value |= static_cast<uint64_t>(src[i]) << (8*i);
+  return value;
+}
+
+
+inline void EncodeFrameHeader(const FrameHeader &header, uint8_t *dst){
+  PutLe(dst, kFrameMagic, 2);
+  PutLe(dst + 2, header.type, 2);
+  PutLe(dst + 4, header.length, 4);
+  PutLe(dst + 8, header.sequence, 4);
+  PutLe(dst + 12, 0, 4);
+  PutLe(dst + 16, static_cast<uint64_t>(header.utime), 8);
+}
+
+// Returns false if src is not a frame header
+inline bool DecodeFrameHeader(const uint8_t *src, FrameHeader &header){
+  if(GetLe(src, 2) != kFrameMagic)
+    return false;
+  header.type = static_cast<uint16_t>(GetLe(src + 2, 2));
+  header.length = static_cast<uint32_t>(GetLe(src + 4, 4));
+  header.sequence = static_cast<uint32_t>(GetLe(src + 8, 4));
+  header.utime = static_cast<int64_t>(GetLe(src + 16, 8));
+  return true;
+}
+
+
+class FrameEncoder{
+  uint32_t next_sequence_;
+
+  public:
+    FrameEncoder() : next_sequence_(0){}
+
+    // Writes the kFrameHeaderSize header of the next frame to dst
+    void EncodeHeader(const uint16_t type, const size_t payload_size, uint8_t *dst){
+      FrameHeader header;
+      header.type = type;
+      header.length = static_cast<uint32_t>(payload_size);
+      header.sequence = next_sequence_++;
+      header.utime = std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::system_clock::now().time_since_epoch()).count();
+      EncodeFrameHeader(header, dst);
+    }
+
+    uint32_t GetNextSequence() const{
+      return next_sequence_;
+    }
+};
+
+
+/*
+Hands every complete frame in data to handler(const FrameView&), in place, and
+returns the number of bytes used. The rest is the start of a frame that is
+still coming in. This fits TcpServer's on_data callback:
+
+  callbacks.on_data = [](const mio::TcpConnectionPtr &conn, const uint8_t *data, const size_t size) -> size_t {
+    bool corrupt;
+    const size_t num_used = mio::DecodeFrames(data, size, corrupt, [](const mio::FrameView &frame){ ... });
+    if(corrupt)
+      conn->Close();
+    return num_used;
+  };
+*/
+template <typename HANDLER_T>
+size_t DecodeFrames(const uint8_t *data, const size_t size, bool &corrupt, HANDLER_T handler,
+                    const size_t max_frame_size = 64*1024*1024){
+  corrupt = false;
+  size_t pos = 0;
+  while(size - pos >= kFrameHeaderSize){
+    FrameView frame;
+    if(!DecodeFrameHeader(data + pos, frame.header) || frame.header.length > max_frame_size){
+      corrupt = true;
+      break;
+    }
+    if(size - pos - kFrameHeaderSize < frame.header.length)
+      break;
+    frame.payload = data + pos + kFrameHeaderSize;
+    pos += kFrameHeaderSize + frame.header.length;
+    handler(static_cast<const FrameView&>(frame));
+  }
+  return pos;
+}
+
+
+class FrameDecoder{
+  std::vector<uint8_t> buf_;
+  size_t read_pos_, write_pos_; // [read_pos_, write_pos_) is buffered and not handed out yet
+  size_t max_frame_size_;
+  bool corrupt_;
+
+  // Free bytes wanted after the buffered data: the rest of the current frame, or at least min_recv_size
+  size_t GetWantedSize(const size_t min_recv_size) const{
+    const size_t num_buffered = write_pos_ - read_pos_;
+    FrameHeader header;
+    if(num_buffered >= kFrameHeaderSize && DecodeFrameHeader(buf_.data() + read_pos_, header) &&
+       header.length <= max_frame_size_)
+      return std::max(min_recv_size, kFrameHeaderSize + header.length - std::min<size_t>(num_buffered,
+                                                                        kFrameHeaderSize + header.length));
+    return min_recv_size;
+  }
+
+  public:
+    // The buffer is allocated on the first Recv()/Feed() unless initial_capacity is given
+    FrameDecoder(const size_t max_frame_size = 64*1024*1024, const size_t initial_capacity = 0) :
+        buf_(initial_capacity), read_pos_(0), write_pos_(0), max_frame_size_(max_frame_size), corrupt_(false){}
+
+    // Returns room for at least min_size more bytes, in size, for reading into directly. Call Commit() with the
+    // number of bytes written. Invalidates the views handed out so far.
+    uint8_t *Reserve(const size_t min_size, size_t &size){
+      if(buf_.size() - write_pos_ < min_size){
+        if(read_pos_ > 0){
+          memmove(buf_.data(), buf_.data() + read_pos_, write_pos_ - read_pos_);
+          write_pos_ -= read_pos_;
+          read_pos_ = 0;
+        }
+        if(buf_.size() - write_pos_ < min_size)
+          buf_.resize(std::max(2*buf_.size(), write_pos_ + min_size));
+      }
+      size = buf_.size() - write_pos_;
+      return buf_.data() + write_pos_;
+    }
+
+    void Commit(const size_t num_byte){
+      write_pos_ = std::min(write_pos_ + num_byte, buf_.size());
+    }
+
+    void Feed(const void *data, const size_t size){
+      size_t free_size;
+      memcpy(Reserve(size, free_size), data, size);
+      Commit(size);
+    }
+
+    // One recv() into the buffer, with room for the whole frame under way. Returns what recv() does.
+    ssize_t Recv(const int sock_fd, const int flags = 0, const size_t min_recv_size = 64*1024){
+      size_t free_size;
+      uint8_t *dst = Reserve(GetWantedSize(min_recv_size), free_size);
+      const ssize_t num_byte = recv(sock_fd, dst, free_size, flags);
+      if(num_byte > 0)
+        write_pos_ += num_byte;
+      return num_byte;
+    }
+
+    // Takes the next complete frame, returns false when there is none (yet) or the stream is corrupt
+    bool Next(FrameView &frame){
+      if(corrupt_)
+        return false;
+      const size_t num_buffered = write_pos_ - read_pos_;
+      if(num_buffered < kFrameHeaderSize)
+        return false;
+      if(!DecodeFrameHeader(buf_.data() + read_pos_, frame.header) || frame.header.length > max_frame_size_){
+        corrupt_ = true;
+        return false;
+      }
+      if(num_buffered - kFrameHeaderSize < frame.header.length)
+        return false;
+      frame.payload = buf_.data() + read_pos_ + kFrameHeaderSize;
+      read_pos_ += kFrameHeaderSize + frame.header.length;
+      if(read_pos_ == write_pos_) // empty, the next read starts at the front; the view stays intact until then
+        read_pos_ = write_pos_ = 0;
+      return true;
+    }
+
+    // A bad magic or a frame above max_frame_size, the connection has to be reset
+    bool IsCorrupt() const{
+      return corrupt_;
+    }
+
+    size_t GetNumBuffered() const{
+      return write_pos_ - read_pos_;
+    }
+
+    void Clear(){
+      read_pos_ = write_pos_ = 0;
+      corrupt_ = false;
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_FRAMING_H__
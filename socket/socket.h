@@ -1,18 +1,79 @@
 #ifndef __MIO_SOCKET_H__
 #define __MIO_SOCKET_H__
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits> //IOV_MAX
+#include <cstdint>
 #include <cstdio>
 #include <cstring>
+#include <functional>
+#include <vector>
 #include <unistd.h>
+#include <poll.h>
 #include <arpa/inet.h>
 #include <netdb.h> //gethostbyname()
 #include <netinet/in.h> //INET_ADDRSTRLEN
+#include <netinet/tcp.h> //TCP_CORK
+#include <sys/socket.h>
+#include <sys/uio.h> //struct iovec
+#include <linux/errqueue.h> //struct sock_extended_err
 #include <thread>
 #include "mio/altro/error.h"
+#include "mio/socket/framing.h"
+
+// Older libc headers lack the MSG_ZEROCOPY (Linux 4.14) definitions
+#ifndef SO_ZEROCOPY
+#define SO_ZEROCOPY 60
+#endif
+#ifndef MSG_ZEROCOPY
+#define MSG_ZEROCOPY 0x4000000
+#endif
+#ifndef SO_EE_ORIGIN_ZEROCOPY
+#define SO_EE_ORIGIN_ZEROCOPY 5
+#endif
+#ifndef SO_EE_CODE_ZEROCOPY_COPIED
+#define SO_EE_CODE_ZEROCOPY_COPIED 1
+#endif
 
 
 namespace mio{
 
+// Waits in select() periods of timeout_len_sec until sock_fd is writable (or readable), num_timeout counts the
+// periods that ran out. Returns 1 once the socket is ready, 0 when the timeouts are used up and
+// suppress_timeout_error is set, -3 when they are used up otherwise, -1 on error.
+inline int WaitSockFd(const int sock_fd, const bool wait_writable, const unsigned int timeout_len_sec,
+                      const unsigned int num_timeout_limit, const bool suppress_timeout_error,
+                      unsigned int &num_timeout, const char *func_name){
+  for(;;){
+    fd_set fds;
+    FD_ZERO(&fds); // select() clears the set on a timeout, so it is set up again for every call
+    FD_SET(sock_fd, &fds);
+    struct timeval tv;
+    tv.tv_sec = timeout_len_sec;
+    tv.tv_usec = 0;
+    const int num_active_fd = select(sock_fd + 1, wait_writable ? NULL : &fds, wait_writable ? &fds : NULL, NULL, &tv);
+    if(num_active_fd == -1 && errno == EINTR)
+      continue;
+    EXP_CHK_ERRNO(num_active_fd != -1, return(-1))
+    if(num_active_fd > 0)
+      return 1;
+    num_timeout++;
+    if(!suppress_timeout_error){
+      printf("%s - timeout occurence %d\n", func_name, num_timeout);
+      EXP_CHK(num_timeout < num_timeout_limit, return(-3))
+    }
+    else if(num_timeout >= num_timeout_limit)
+      return 0;
+  }
+}
+
+
+// The send/recv functions below try the socket first with MSG_DONTWAIT and only select() on it once it would
+// block, so a socket that keeps up costs one system call per packet.
+
 //For connect mode sockets (eg. TCP sockets), dest_addr and dest_addr_len are ignored, therefore, not needed
 inline int SendTo(const int sock_fd, const void *data_buf, const size_t data_buf_len, const size_t packet_size = 0,
                   const int flags = 0, const struct sockaddr *dest_addr = NULL, socklen_t dest_addr_len = 0,
@@ -22,38 +83,25 @@ inline int SendTo(const int sock_fd, const void *data_buf, const size_t data_buf
   EXP_CHK(data_buf != nullptr, return(-1))
   EXP_CHK(data_buf_len > 0, return(0))
             
-  int num_byte_sent, num_active_fd;
+  int num_byte_sent;
   unsigned int num_timeout = 0, total_num_byte_sent = 0;
-  fd_set writefds;
-  struct timeval tv, tv_temp;
-  FD_ZERO(&writefds);
-  FD_SET(sock_fd, &writefds);
-  tv.tv_sec = timeout_len_sec;
-  tv.tv_usec = 0;
-
   while(data_buf_len > total_num_byte_sent){
-    do{
-      tv_temp = tv; // Select may be modifying tv_temp so reset
-      num_active_fd = select(sock_fd + 1, NULL, &writefds, NULL, &tv_temp); //getdtablesize()
-      EXP_CHK_ERRNO(num_active_fd != -1, return(-1));
-      if(num_active_fd == 0){
-        num_timeout++;
-        if(!suppress_timeout_error){
-          printf("%s - timeout occurence %d\n", CURRENT_FUNC, num_timeout);
-          EXP_CHK(num_timeout < num_timeout_limit, return(-3));
-        }
-        else if(num_timeout >= num_timeout_limit)
-          return 0;
-      }
-      else{
-        const size_t num_bytes_to_send = (packet_size == 0) ? (data_buf_len-total_num_byte_sent) :
-                                                              std::min(data_buf_len-total_num_byte_sent, packet_size);
-        EXP_CHK_ERRNO(( num_byte_sent = sendto(sock_fd, (uint8_t *)data_buf + total_num_byte_sent, 
-                    num_bytes_to_send, flags, dest_addr, dest_addr_len) ) != -1, return(-1))
-        EXP_CHK_M(!(num_byte_sent == 0 && num_active_fd == 1), return(-1), "connection was lost");
-        //printf("sent out %d bytes\n", num_byte_sent);
-      }
-    } while(num_active_fd == 0); // Loop for timeout check instances
+    const size_t num_bytes_to_send = (packet_size == 0) ? (data_buf_len-total_num_byte_sent) :
+                                                          std::min(data_buf_len-total_num_byte_sent, packet_size);
+    num_byte_sent = sendto(sock_fd, (uint8_t *)data_buf + total_num_byte_sent, num_bytes_to_send,
+                           flags | MSG_DONTWAIT, dest_addr, dest_addr_len);
+    if(num_byte_sent == -1 && errno == EINTR)
+      continue;
+    if(num_byte_sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+      const int status = WaitSockFd(sock_fd, true, timeout_len_sec, num_timeout_limit, suppress_timeout_error,
+                                    num_timeout, CURRENT_FUNC);
+      if(status != 1)
+        return status;
+      continue;
+    }
+    EXP_CHK_ERRNO(num_byte_sent != -1, return(-1))
+    EXP_CHK_M(num_byte_sent != 0, return(-1), "connection was lost");
+    //printf("sent out %d bytes\n", num_byte_sent);
     total_num_byte_sent += num_byte_sent;
   }
 
@@ -70,45 +118,361 @@ inline int RecvFrom(const int sock_fd, void *data_buf, const size_t data_buf_len
   EXP_CHK(data_buf != nullptr, return(-1))
   EXP_CHK(data_buf_len > 0, return(0))
   
-  int num_byte_recv, num_active_fd;
+  int num_byte_recv;
   unsigned int num_timeout = 0, total_num_byte_recv = 0;
-  fd_set readfds;
-  struct timeval tv, tv_temp;
-  FD_ZERO(&readfds);
-  FD_SET(sock_fd, &readfds);
-  tv.tv_sec = timeout_len_sec;
-  tv.tv_usec = 0;
-  
   while(data_buf_len > total_num_byte_recv){
-    do{
-      tv_temp = tv; //select may be modifying tv_temp so reset
-      num_active_fd = select(sock_fd + 1, &readfds, NULL, NULL, &tv_temp); //getdtablesize()
-      EXP_CHK_ERRNO(num_active_fd != -1, return(-1));
-      if(num_active_fd == 0){
-        num_timeout++;
-        if(!suppress_timeout_error){
-          printf("%s - timeout occurence %d\n", CURRENT_FUNC, num_timeout);
-          EXP_CHK(num_timeout < num_timeout_limit, return(-3));
-        }
-        else if(num_timeout >= num_timeout_limit)
-          return 0;
-      }
-      else{
-        const size_t num_bytes_to_get = (packet_size == 0) ? (data_buf_len-total_num_byte_recv) :
-                                                             std::min(data_buf_len-total_num_byte_recv, packet_size);
-        EXP_CHK_ERRNO(( num_byte_recv = recvfrom(sock_fd, (uint8_t *)data_buf + total_num_byte_recv, 
-                    num_bytes_to_get, flags, src_addr, src_addr_len) ) != -1, return(-1))
-        EXP_CHK_M(!(num_byte_recv == 0 && num_active_fd == 1), return(-1), "connection was lost");
-        //printf("read in %d bytes\n", num_byte_recv);
-      }
-    } while(num_active_fd == 0); //loop for timeout check instances
+    const size_t num_bytes_to_get = (packet_size == 0) ? (data_buf_len-total_num_byte_recv) :
+                                                         std::min(data_buf_len-total_num_byte_recv, packet_size);
+    num_byte_recv = recvfrom(sock_fd, (uint8_t *)data_buf + total_num_byte_recv, num_bytes_to_get,
+                             flags | MSG_DONTWAIT, src_addr, src_addr_len);
+    if(num_byte_recv == -1 && errno == EINTR)
+      continue;
+    if(num_byte_recv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+      const int status = WaitSockFd(sock_fd, false, timeout_len_sec, num_timeout_limit, suppress_timeout_error,
+                                    num_timeout, CURRENT_FUNC);
+      if(status != 1)
+        return status;
+      continue;
+    }
+    EXP_CHK_ERRNO(num_byte_recv != -1, return(-1))
+    EXP_CHK_M(num_byte_recv != 0, return(-1), "connection was lost");
+    //printf("read in %d bytes\n", num_byte_recv);
     total_num_byte_recv += num_byte_recv;
   }
   
-  return num_byte_recv;
+  return total_num_byte_recv;
+}
+
+
+// Skips num_byte of the io vector, to go on after a partial sendmsg()/recvmsg()
+inline void AdvanceIov(struct iovec *&iov, size_t &iov_cnt, size_t num_byte){
+  while(iov_cnt > 0 && num_byte >= iov->iov_len){
+    num_byte -= iov->iov_len;
+    ++iov;
+    --iov_cnt;
+  }
+  if(num_byte > 0){
+    iov->iov_base = (uint8_t *)iov->iov_base + num_byte;
+    iov->iov_len -= num_byte;
+  }
+}
+
+
+inline size_t GetIovSize(const struct iovec *iov, const size_t iov_cnt){
+  size_t size = 0;
+  for(size_t i = 0; i < iov_cnt; ++i)
+    size += iov[i].iov_len;
+  return size;
+}
+
+
+/*
+Vectored SendTo(), sends several buffers with sendmsg() as one, eg. a header
+and a cv::Mat without copying them together first:
+
+  struct iovec iov[2] = {{&header, sizeof(header)}, {mat.data, mat.total()*mat.elemSize()}};
+  mio::SendV(sock_fd, iov, 2);
+
+On a TCP socket, flags can hold MSG_MORE when more data follows right away,
+the last partial segment is then held back as with SetTcpCork(). The iov
+array itself is left as is. num_call, when provided, is incremented for every
+sendmsg() that sent data (see ZeroCopySender). Returns the number of bytes
+sent, 0 when the timeouts are used up and suppressed, -3 on a timeout error
+and -1 on error.
+*/
+inline ssize_t SendV(const int sock_fd, const struct iovec *iov, const size_t iov_cnt, const int flags = 0,
+                     const struct sockaddr *dest_addr = NULL, socklen_t dest_addr_len = 0,
+                     const unsigned int timeout_len_sec = 2, const unsigned int num_timeout_limit = 3,
+                     const bool suppress_timeout_error = false, uint64_t *num_call = NULL){
+  EXP_CHK(sock_fd > 0, return(-1))
+  EXP_CHK(iov != nullptr || iov_cnt == 0, return(-1))
+  const size_t total_size = GetIovSize(iov, iov_cnt);
+  EXP_CHK(total_size > 0, return(0))
+
+  // sendmsg() doesn't touch the iovec array, it is only copied once a send comes up short
+  std::vector<struct iovec> iov_vec;
+  struct iovec *cur_iov = const_cast<struct iovec *>(iov);
+  size_t cur_iov_cnt = iov_cnt, total_num_byte_sent = 0;
+  unsigned int num_timeout = 0;
+  while(total_num_byte_sent < total_size){
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = const_cast<struct sockaddr *>(dest_addr);
+    msg.msg_namelen = dest_addr_len;
+    msg.msg_iov = cur_iov;
+    msg.msg_iovlen = std::min<size_t>(cur_iov_cnt, IOV_MAX);
+    const ssize_t num_byte_sent = sendmsg(sock_fd, &msg, flags | MSG_DONTWAIT | MSG_NOSIGNAL);
+    if(num_byte_sent == -1 && errno == EINTR)
+      continue;
+    if(num_byte_sent == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+      const int status = WaitSockFd(sock_fd, true, timeout_len_sec, num_timeout_limit, suppress_timeout_error,
+                                    num_timeout, CURRENT_FUNC);
+      if(status != 1)
+        return status;
+      continue;
+    }
+    EXP_CHK_ERRNO(num_byte_sent != -1, return(-1))
+    EXP_CHK_M(num_byte_sent != 0, return(-1), "connection was lost");
+    if(num_call != NULL)
+      ++(*num_call);
+    total_num_byte_sent += num_byte_sent;
+    if(total_num_byte_sent < total_size){
+      if(iov_vec.empty()){
+        iov_vec.assign(cur_iov, cur_iov + cur_iov_cnt);
+        cur_iov = iov_vec.data();
+      }
+      AdvanceIov(cur_iov, cur_iov_cnt, num_byte_sent);
+    }
+  }
+
+  return total_num_byte_sent;
+}
+
+
+// Vectored RecvFrom(), scatters into the iov buffers, eg. a header and a preallocated cv::Mat. A stream socket fills
+// all of them, other sockets return after one datagram. Returns like SendV().
+inline ssize_t RecvV(const int sock_fd, const struct iovec *iov, const size_t iov_cnt, const int flags = 0,
+                     struct sockaddr *src_addr = NULL, socklen_t *src_addr_len = NULL,
+                     const unsigned int timeout_len_sec = 2, const unsigned int num_timeout_limit = 3,
+                     const bool suppress_timeout_error = false){
+  EXP_CHK(sock_fd > 0, return(-1))
+  EXP_CHK(iov != nullptr || iov_cnt == 0, return(-1))
+  const size_t total_size = GetIovSize(iov, iov_cnt);
+  EXP_CHK(total_size > 0, return(0))
+
+  std::vector<struct iovec> iov_vec;
+  struct iovec *cur_iov = const_cast<struct iovec *>(iov);
+  size_t cur_iov_cnt = iov_cnt, total_num_byte_recv = 0;
+  unsigned int num_timeout = 0;
+  int sock_type = 0; // looked up on the first short read
+  while(total_num_byte_recv < total_size){
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name = src_addr;
+    msg.msg_namelen = (src_addr_len != NULL) ? *src_addr_len : 0;
+    msg.msg_iov = cur_iov;
+    msg.msg_iovlen = std::min<size_t>(cur_iov_cnt, IOV_MAX);
+    const ssize_t num_byte_recv = recvmsg(sock_fd, &msg, flags | MSG_DONTWAIT);
+    if(num_byte_recv == -1 && errno == EINTR)
+      continue;
+    if(num_byte_recv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+      const int status = WaitSockFd(sock_fd, false, timeout_len_sec, num_timeout_limit, suppress_timeout_error,
+                                    num_timeout, CURRENT_FUNC);
+      if(status != 1)
+        return status;
+      continue;
+    }
+    EXP_CHK_ERRNO(num_byte_recv != -1, return(-1))
+    if(src_addr_len != NULL)
+      *src_addr_len = msg.msg_namelen;
+    total_num_byte_recv += num_byte_recv;
+    if(total_num_byte_recv < total_size){
+      if(sock_type == 0){
+        socklen_t opt_len = sizeof(sock_type);
+        EXP_CHK_ERRNO(getsockopt(sock_fd, SOL_SOCKET, SO_TYPE, &sock_type, &opt_len) != -1, return(-1))
+      }
+      if(sock_type != SOCK_STREAM)
+        break; // one datagram per call
+      EXP_CHK_M(num_byte_recv != 0, return(-1), "connection was lost");
+      if(iov_vec.empty()){
+        iov_vec.assign(cur_iov, cur_iov + cur_iov_cnt);
+        cur_iov = iov_vec.data();
+      }
+      AdvanceIov(cur_iov, cur_iov_cnt, num_byte_recv);
+    }
+  }
+
+  return total_num_byte_recv;
+}
+
+
+// Sends a frame (see framing.h) with the payload in the iov buffers, header and payload in one sendmsg(). Returns
+// like SendV(), the header counts towards the bytes sent.
+inline ssize_t SendFrameV(const int sock_fd, FrameEncoder &encoder, const uint16_t type, const struct iovec *iov,
+                          const size_t iov_cnt, const int flags = 0, const unsigned int timeout_len_sec = 2,
+                          const unsigned int num_timeout_limit = 3, const bool suppress_timeout_error = false){
+  uint8_t header[kFrameHeaderSize];
+  encoder.EncodeHeader(type, GetIovSize(iov, iov_cnt), header);
+  struct iovec frame_iov_buf[8];
+  std::vector<struct iovec> frame_iov_vec;
+  struct iovec *frame_iov = frame_iov_buf;
+  if(iov_cnt + 1 > sizeof(frame_iov_buf)/sizeof(frame_iov_buf[0])){
+    frame_iov_vec.resize(iov_cnt + 1);
+    frame_iov = frame_iov_vec.data();
+  }
+  frame_iov[0].iov_base = header;
+  frame_iov[0].iov_len = kFrameHeaderSize;
+  std::copy(iov, iov + iov_cnt, frame_iov + 1);
+  return SendV(sock_fd, frame_iov, iov_cnt + 1, flags, NULL, 0, timeout_len_sec, num_timeout_limit,
+               suppress_timeout_error);
+}
+
+
+inline ssize_t SendFrame(const int sock_fd, FrameEncoder &encoder, const uint16_t type, const void *payload,
+                         const size_t payload_size, const int flags = 0, const unsigned int timeout_len_sec = 2,
+                         const unsigned int num_timeout_limit = 3, const bool suppress_timeout_error = false){
+  struct iovec iov;
+  iov.iov_base = const_cast<void *>(payload);
+  iov.iov_len = payload_size;
+  return SendFrameV(sock_fd, encoder, type, &iov, payload_size > 0 ? 1 : 0, flags, timeout_len_sec,
+                    num_timeout_limit, suppress_timeout_error);
+}
+
+
+// Gets the next frame, reading from sock_fd only when the decoder has no complete frame left. frame is valid until
+// the next call. Returns 1 with a frame, 0 when the timeouts are used up and suppressed, -3 on a timeout error and -1
+// on error, a lost connection or a corrupt stream.
+inline int RecvFrame(const int sock_fd, FrameDecoder &decoder, FrameView &frame,
+                     const unsigned int timeout_len_sec = 2, const unsigned int num_timeout_limit = 3,
+                     const bool suppress_timeout_error = false){
+  EXP_CHK(sock_fd > 0, return(-1))
+  unsigned int num_timeout = 0;
+  while(!decoder.Next(frame)){
+    EXP_CHK_M(!decoder.IsCorrupt(), return(-1), "corrupt frame stream")
+    const ssize_t num_byte_recv = decoder.Recv(sock_fd, MSG_DONTWAIT);
+    if(num_byte_recv == -1 && errno == EINTR)
+      continue;
+    if(num_byte_recv == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+      const int status = WaitSockFd(sock_fd, false, timeout_len_sec, num_timeout_limit, suppress_timeout_error,
+                                    num_timeout, CURRENT_FUNC);
+      if(status != 1)
+        return status;
+      continue;
+    }
+    EXP_CHK_ERRNO(num_byte_recv != -1, return(-1))
+    EXP_CHK_M(num_byte_recv != 0, return(-1), "connection was lost");
+  }
+  return 1;
+}
+
+
+// While TCP_CORK is set, TCP only sends full segments, eg. cork, send a header and the pieces of a payload, then
+// uncork to push out the rest. MSG_MORE does the same for a single call.
+inline int SetTcpCork(const int sock_fd, const bool cork){
+  const int value = cork ? 1 : 0;
+  EXP_CHK_ERRNO(setsockopt(sock_fd, IPPROTO_TCP, TCP_CORK, &value, sizeof(value)) != -1, return(-1))
+  return 0;
 }
 
 
+/*
+MSG_ZEROCOPY sends for large frames, eg. a camera image to a TCP client:
+
+  mio::ZeroCopySender zc_sender(sock_fd);
+  const int64_t ticket = zc_sender.Send(iov, 2);
+  ...
+  zc_sender.WaitComplete(ticket); // the iov buffers can be changed or freed again
+
+The kernel transmits straight from the caller's pages, so they have to stay
+untouched until the send completes. Completions come in on the socket's error
+queue, which PollCompletion() and WaitComplete() read. Pinning the pages costs
+more than copying below roughly 10 KB, so only large sends should take this
+path. Without SO_ZEROCOPY (Linux < 4.14) the data is copied as usual and a
+send is complete right away. Loopback, and NICs without scatter-gather, copy
+anyway, which GetNumCopied() shows.
+*/
+class ZeroCopySender{
+  int sock_fd_;
+  bool enabled_;
+  uint64_t num_call_; // the kernel numbers every sendmsg() that sent data
+  uint64_t num_completed_, num_copied_;
+
+  public:
+    ZeroCopySender(const int sock_fd) : sock_fd_(sock_fd), enabled_(false), num_call_(0), num_completed_(0),
+                                        num_copied_(0){
+      const int yes = 1;
+      enabled_ = setsockopt(sock_fd_, SOL_SOCKET, SO_ZEROCOPY, &yes, sizeof(yes)) == 0;
+      if(!enabled_)
+        printf("%s - SO_ZEROCOPY is not supported (%s), sends are copied\n", CURRENT_FUNC, std::strerror(errno));
+    }
+
+    ZeroCopySender(const ZeroCopySender&) = delete;
+    ZeroCopySender &operator=(const ZeroCopySender&) = delete;
+
+    bool IsEnabled() const{
+      return enabled_;
+    }
+
+    // Sends like SendV() and returns a ticket for IsComplete()/WaitComplete(), or a negative SendV() status
+    int64_t Send(const struct iovec *iov, const size_t iov_cnt, const int flags = 0,
+                 const unsigned int timeout_len_sec = 2, const unsigned int num_timeout_limit = 3){
+      if(!enabled_){
+        const ssize_t status = SendV(sock_fd_, iov, iov_cnt, flags, NULL, 0, timeout_len_sec, num_timeout_limit);
+        return status < 0 ? status : static_cast<int64_t>(num_call_);
+      }
+      const ssize_t status = SendV(sock_fd_, iov, iov_cnt, flags | MSG_ZEROCOPY, NULL, 0, timeout_len_sec,
+                                   num_timeout_limit, false, &num_call_);
+      return status < 0 ? status : static_cast<int64_t>(num_call_);
+    }
+
+    // Reads the completions on the error queue, waiting up to timeout_ms for the first one (-1 waits forever).
+    // Returns the number of sends that completed, or -1 on error.
+    int PollCompletion(const int timeout_ms = 0){
+      if(num_completed_ == num_call_)
+        return 0;
+      struct pollfd pfd;
+      pfd.fd = sock_fd_;
+      pfd.events = 0; // POLLERR is always reported
+      pfd.revents = 0;
+      int num_ready;
+      while((num_ready = poll(&pfd, 1, timeout_ms)) == -1 && errno == EINTR);
+      EXP_CHK_ERRNO(num_ready != -1, return(-1))
+      const uint64_t old_num_completed = num_completed_;
+      for(;;){
+        char control[128];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if(recvmsg(sock_fd_, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) == -1){
+          if(errno == EINTR)
+            continue;
+          EXP_CHK_ERRNO(errno == EAGAIN || errno == EWOULDBLOCK, return(-1))
+          break;
+        }
+        for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+          if(!((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+               (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)))
+            continue;
+          struct sock_extended_err serr;
+          memcpy(&serr, CMSG_DATA(cmsg), sizeof(serr));
+          if(serr.ee_errno != 0 || serr.ee_origin != SO_EE_ORIGIN_ZEROCOPY)
+            continue;
+          // [ee_info, ee_data] is a range of 32 bit send numbers, unsigned math handles the wrap
+          const uint64_t num_range = static_cast<uint32_t>(serr.ee_data - serr.ee_info) + 1ull;
+          num_completed_ += num_range;
+          if(serr.ee_code & SO_EE_CODE_ZEROCOPY_COPIED)
+            num_copied_ += num_range;
+        }
+      }
+      return static_cast<int>(num_completed_ - old_num_completed);
+    }
+
+    // TCP completes sends in order, so every send up to the ticket is done
+    bool IsComplete(const int64_t ticket) const{
+      return static_cast<uint64_t>(ticket) <= num_completed_ || !enabled_;
+    }
+
+    // Returns true once the ticket's send completed, false on timeout or error
+    bool WaitComplete(const int64_t ticket, const int timeout_ms = 1000){
+      const auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+      while(!IsComplete(ticket)){
+        const int remaining_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            deadline - std::chrono::steady_clock::now()).count());
+        if(remaining_ms <= 0)
+          return false;
+        EXP_CHK(PollCompletion(remaining_ms) != -1, return false)
+      }
+      return true;
+    }
+
+    // Sends the kernel ended up copying, eg. over loopback, where zerocopy only adds overhead
+    uint64_t GetNumCopied() const{
+      return num_copied_;
+    }
+};
+
+
 // get sockaddr, IPv4 or IPv6:
 inline void *GetAddrIn(struct sockaddr *sa){
 	if(sa->sa_family == AF_INET)
@@ -176,11 +540,14 @@ inline void PrintAddrInfo(struct addrinfo *addr_info){
 }
 
 
+// Serves one client at a time, see TcpServer (tcp_server.h) for many clients
 class CServerTCP{
   struct addrinfo *result_, *p_; //addrinfo contains struct sockaddr *ai_addr and socklen_t ai_addrlen
   int sock_fd_, accept_sock_fd_;
   struct sockaddr_storage client_addr_;
   bool is_init_;
+  FrameEncoder frame_encoder_;
+  FrameDecoder frame_decoder_;
 
   public:
     CServerTCP() : is_init_(false), sock_fd_(0), accept_sock_fd_(0) {}
@@ -228,6 +595,7 @@ class CServerTCP{
       // Accept an incoming connection
       EXP_CHK_ERRNO((accept_sock_fd_ = accept(sock_fd_, (struct sockaddr *)&client_addr_,
                                             &client_addr_len)) != -1, return(-1))
+      frame_decoder_.Clear();
 	    char cstr[INET6_ADDRSTRLEN];
       inet_ntop_sin(&client_addr_, cstr, sizeof cstr);
       printf("%s - got connection from: %s\n", CURRENT_FUNC, cstr);
@@ -273,6 +641,41 @@ class CServerTCP{
       return mio::RecvFrom(accept_sock_fd_, data_buf, data_buf_len, packet_size, flags, NULL, NULL,
                            timeout_len_sec, num_timeout_limit, suppress_timeout_error);
     }
+
+    ssize_t SendVToClient(const struct iovec *iov, const size_t iov_cnt, const int flags = 0,
+                          const unsigned int timeout_len_sec = 2, const unsigned int num_timeout_limit = 3,
+                          const bool suppress_timeout_error = false){
+      return mio::SendV(accept_sock_fd_, iov, iov_cnt, flags, NULL, 0,
+                        timeout_len_sec, num_timeout_limit, suppress_timeout_error);
+    }
+
+    ssize_t RecvVFromClient(const struct iovec *iov, const size_t iov_cnt, const int flags = 0,
+                            const unsigned int timeout_len_sec = 2, const unsigned int num_timeout_limit = 3,
+                            const bool suppress_timeout_error = false){
+      return mio::RecvV(accept_sock_fd_, iov, iov_cnt, flags, NULL, NULL,
+                        timeout_len_sec, num_timeout_limit, suppress_timeout_error);
+    }
+
+    // Frames, see framing.h. The frame from RecvFrameFromClient() is valid until its next call.
+    ssize_t SendFrameToClient(const uint16_t type, const void *payload, const size_t payload_size,
+                              const int flags = 0, const unsigned int timeout_len_sec = 2,
+                              const unsigned int num_timeout_limit = 3, const bool suppress_timeout_error = false){
+      return mio::SendFrame(accept_sock_fd_, frame_encoder_, type, payload, payload_size, flags,
+                            timeout_len_sec, num_timeout_limit, suppress_timeout_error);
+    }
+
+    ssize_t SendFrameVToClient(const uint16_t type, const struct iovec *iov, const size_t iov_cnt,
+                               const int flags = 0, const unsigned int timeout_len_sec = 2,
+                               const unsigned int num_timeout_limit = 3, const bool suppress_timeout_error = false){
+      return mio::SendFrameV(accept_sock_fd_, frame_encoder_, type, iov, iov_cnt, flags,
+                             timeout_len_sec, num_timeout_limit, suppress_timeout_error);
+    }
+
+    int RecvFrameFromClient(FrameView &frame, const unsigned int timeout_len_sec = 2,
+                            const unsigned int num_timeout_limit = 3, const bool suppress_timeout_error = false){
+      return mio::RecvFrame(accept_sock_fd_, frame_decoder_, frame,
+                            timeout_len_sec, num_timeout_limit, suppress_timeout_error);
+    }
 };
 
 
@@ -280,6 +683,8 @@ class CClientTCP{
   int sock_fd_;
   struct addrinfo *result_, *p_; //addrinfo contains struct sockaddr *ai_addr and socklen_t ai_addrlen
   bool is_init_;
+  FrameEncoder frame_encoder_;
+  FrameDecoder frame_decoder_;
 
   public:
     CClientTCP() : is_init_(false), sock_fd_(0) {}
@@ -313,6 +718,7 @@ class CClientTCP{
 	    char cstr[INET6_ADDRSTRLEN];
       inet_ntop_sin(p_, cstr, sizeof cstr);
 	    printf("%s: connected to %s\n", CURRENT_FUNC, cstr);
+      frame_decoder_.Clear();
 
       is_init_ = true;
 	    return 0;
@@ -351,6 +757,41 @@ class CClientTCP{
     int RecvFromServer(const void *data_buf, const size_t data_buf_len, const int flags = 0){
       return recv(sock_fd_, (uint8_t*)data_buf, data_buf_len, flags);
     }
+
+    ssize_t SendVToServer(const struct iovec *iov, const size_t iov_cnt, const int flags = 0,
+                          const unsigned int timeout_len_sec = 2, const unsigned int num_timeout_limit = 3,
+                          const bool suppress_timeout_error = false){
+      return mio::SendV(sock_fd_, iov, iov_cnt, flags, NULL, 0,
+                        timeout_len_sec, num_timeout_limit, suppress_timeout_error);
+    }
+
+    ssize_t RecvVFromServer(const struct iovec *iov, const size_t iov_cnt, const int flags = 0,
+                            const unsigned int timeout_len_sec = 2, const unsigned int num_timeout_limit = 3,
+                            const bool suppress_timeout_error = false){
+      return mio::RecvV(sock_fd_, iov, iov_cnt, flags, NULL, NULL,
+                        timeout_len_sec, num_timeout_limit, suppress_timeout_error);
+    }
+
+    // Frames, see framing.h. The frame from RecvFrameFromServer() is valid until its next call.
+    ssize_t SendFrameToServer(const uint16_t type, const void *payload, const size_t payload_size,
+                              const int flags = 0, const unsigned int timeout_len_sec = 2,
+                              const unsigned int num_timeout_limit = 3, const bool suppress_timeout_error = false){
+      return mio::SendFrame(sock_fd_, frame_encoder_, type, payload, payload_size, flags,
+                            timeout_len_sec, num_timeout_limit, suppress_timeout_error);
+    }
+
+    ssize_t SendFrameVToServer(const uint16_t type, const struct iovec *iov, const size_t iov_cnt,
+                               const int flags = 0, const unsigned int timeout_len_sec = 2,
+                               const unsigned int num_timeout_limit = 3, const bool suppress_timeout_error = false){
+      return mio::SendFrameV(sock_fd_, frame_encoder_, type, iov, iov_cnt, flags,
+                             timeout_len_sec, num_timeout_limit, suppress_timeout_error);
+    }
+
+    int RecvFrameFromServer(FrameView &frame, const unsigned int timeout_len_sec = 2,
+                            const unsigned int num_timeout_limit = 3, const bool suppress_timeout_error = false){
+      return mio::RecvFrame(sock_fd_, frame_decoder_, frame,
+                            timeout_len_sec, num_timeout_limit, suppress_timeout_error);
+    }
 };
 
 
@@ -365,6 +806,7 @@ class CClientTCP{
   system use whatever it wants. The special address for this is 0.0.0.0, defined by the symbolic constant INADDR_ANY.
 */
 
+// See UdpBatchReceiver (udp_batch.h) for many datagrams per system call
 class CServerUDP{ // "listener"
 	int sock_fd_;
 	struct addrinfo *result_, *p_;
@@ -439,6 +881,7 @@ class CServerUDP{ // "listener"
 };
 
 
+// See UdpBatchSender (udp_batch.h) for many datagrams per system call
 class CClientUDP{ // "talker"
 	int sock_fd_;
 	struct addrinfo *result_, *p_;
@@ -522,23 +965,31 @@ class CClientUDP{ // "talker"
 };
 
 
+// Receives frames (see framing.h) from the server on a thread of its own and hands them to frame_handler_, or prints
+// them when it is not set
 class TCPHandlerThread{
   public:
     mio::CClientTCP *tcp_sock_;
-    uint8_t *tcp_data_;
-    size_t tcp_data_len_;
-    bool exit_thread_, started_;
+    std::function<void(const FrameView&)> frame_handler_;
+    std::atomic<bool> exit_thread_;
+    bool started_;
     std::thread thread_;
 
-    TCPHandlerThread() : exit_thread_(false), started_(false){}
+    TCPHandlerThread() : tcp_sock_(NULL), exit_thread_(false), started_(false){}
 
     void Thread(){
-      for(;;){
-        if(exit_thread_)
-          break;
-        uint32_t number;
-        EXP_CHK(tcp_sock_->RecvFromServer(&number, sizeof(uint32_t), 0) == -1, break);
-        printf("received number %d\n", number);
+      FrameView frame;
+      while(!exit_thread_){
+        // One second timeouts without an error, so exit_thread_ is checked
+        const int status = tcp_sock_->RecvFrameFromServer(frame, 1, 1, true);
+        if(status == 0)
+          continue;
+        EXP_CHK(status == 1, break)
+        if(frame_handler_)
+          frame_handler_(frame);
+        else
+          printf("received frame type %d, sequence %u, %u bytes\n", frame.header.type, frame.header.sequence,
+                 frame.header.length);
       }
     }
 
@@ -0,0 +1,405 @@
+#ifndef __MIO_TCP_SERVER_H__
+#define __MIO_TCP_SERVER_H__
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "mio/altro/error.h"
+#include "mio/altro/event_loop.h"
+#include "mio/socket/socket.h"
+
+/*
+Multi-client TCP server on non-blocking, edge-triggered epoll, where
+CServerTCP serves one accepted client, eg. streaming telemetry:
+
+  mio::TcpServerCallbacks callbacks;
+  callbacks.on_connect = [](const mio::TcpConnectionPtr &conn){ printf("%s connected\n", conn->GetPeer().c_str()); };
+  callbacks.on_data = [](const mio::TcpConnectionPtr &conn, const uint8_t *data, const size_t size) -> size_t {
+    ...          // parse requests
+    return size; // bytes consumed, the rest is handed out again with the next data
+  };
+  mio::TcpServer server(callbacks);
+  server.Start("", "3495", 4);  // 4 reactor threads
+  ...
+  server.Broadcast(&sample, sizeof(sample));
+
+Every reactor is a mio::EventLoop thread with a listening socket of its own.
+With more than one reactor the sockets share the port through SO_REUSEPORT,
+so the kernel spreads new connections across the reactors and they never
+contend on one accept queue. A connection stays on the reactor that accepted
+it; its callbacks run on that reactor's thread, one at a time.
+
+Every connection has a read buffer (data not consumed by on_data yet) and a
+write buffer, both limited to the server's max_buffer_size. Send(), SendV(),
+Broadcast() and BroadcastV() can be called from any thread; they write
+straight to the socket and only buffer what the socket does not take, which
+the reactor flushes when the socket becomes writable. A client whose write
+buffer overflows is too slow to keep up and gets disconnected, instead of
+growing the server's memory.
+*/
+
+namespace mio{
+
+class TcpConnection;
+typedef std::shared_ptr<TcpConnection> TcpConnectionPtr;
+
+struct TcpServerCallbacks{
+  std::function<void(const TcpConnectionPtr&)> on_connect;
+  // Returns the number of bytes consumed, the rest stays in the read buffer
+  std::function<size_t(const TcpConnectionPtr&, const uint8_t *data, const size_t size)> on_data;
+  std::function<void(const TcpConnectionPtr&)> on_close;
+};
+
+
+class TcpConnection{
+  friend class TcpServer;
+
+  int fd_;
+  uint64_t id_;
+  std::string peer_;
+  size_t max_write_buffer_;
+  std::vector<uint8_t> read_buf_; // reactor thread only
+  std::mutex write_mtx_; // guards write_buf_, write_offset_ and closed_
+  std::vector<uint8_t> write_buf_;
+  size_t write_offset_;
+  bool closed_; // no more sends, the fd is shut down or closed
+
+  // Caller holds write_mtx_. The reactor sees the shutdown and closes the fd.
+  void Drop(){
+    shutdown(fd_, SHUT_RDWR);
+    closed_ = true;
+  }
+
+  // Caller holds write_mtx_. Returns false if the connection has to go.
+  bool Flush(){
+    while(write_offset_ < write_buf_.size()){
+      const ssize_t num_byte = send(fd_, write_buf_.data() + write_offset_, write_buf_.size() - write_offset_,
+                                    MSG_NOSIGNAL);
+      if(num_byte == -1){
+        if(errno == EAGAIN || errno == EWOULDBLOCK)
+          return true; // the reactor goes on once the socket is writable
+        if(errno == EINTR)
+          continue;
+        return false;
+      }
+      write_offset_ += num_byte;
+    }
+    write_buf_.clear();
+    write_offset_ = 0;
+    return true;
+  }
+
+  public:
+    TcpConnection(const int fd, const uint64_t id, const std::string &peer, const size_t max_write_buffer) :
+        fd_(fd), id_(id), peer_(peer), max_write_buffer_(max_write_buffer), write_offset_(0), closed_(false){}
+
+    TcpConnection(const TcpConnection&) = delete;
+    TcpConnection &operator=(const TcpConnection&) = delete;
+
+    // Writes what the socket takes right away and buffers the rest. Returns
+    // false if the connection is closed or its write buffer overflowed, which
+    // closes it.
+    bool Send(const void *data, const size_t size){
+      struct iovec iov;
+      iov.iov_base = const_cast<void*>(data);
+      iov.iov_len = size;
+      return SendV(&iov, 1);
+    }
+
+    // Send() of several buffers, eg. a header and its payload, written with
+    // one sendmsg() instead of being copied together first
+    bool SendV(const struct iovec *iov, const size_t iov_cnt){
+      std::lock_guard<std::mutex> lock(write_mtx_);
+      if(closed_)
+        return false;
+      const size_t size = GetIovSize(iov, iov_cnt);
+      size_t num_sent = 0;
+      if(write_offset_ == write_buf_.size()){ // nothing is queued, so nothing to keep in order with
+        std::vector<struct iovec> iov_vec;
+        struct iovec *cur_iov = const_cast<struct iovec*>(iov);
+        size_t cur_iov_cnt = iov_cnt;
+        while(num_sent < size){
+          struct msghdr msg;
+          memset(&msg, 0, sizeof(msg));
+          msg.msg_iov = cur_iov;
+          msg.msg_iovlen = std::min<size_t>(cur_iov_cnt, IOV_MAX);
+          const ssize_t num_byte = sendmsg(fd_, &msg, MSG_NOSIGNAL);
+          if(num_byte == -1){
+            if(errno == EINTR)
+              continue;
+            if(errno != EAGAIN && errno != EWOULDBLOCK){
+              Drop();
+              return false;
+            }
+            break;
+          }
+          num_sent += num_byte;
+          if(num_sent < size){
+            if(iov_vec.empty()){
+              iov_vec.assign(cur_iov, cur_iov + cur_iov_cnt);
+              cur_iov = iov_vec.data();
+            }
+            AdvanceIov(cur_iov, cur_iov_cnt, num_byte);
+          }
+        }
+      }
+      if(num_sent < size){
+        if(write_buf_.size() - write_offset_ + size - num_sent > max_write_buffer_){
+          printf("TcpConnection::Send() - %s is too slow, dropping it\n", peer_.c_str());
+          Drop();
+          return false;
+        }
+        // Queue what is left, skipping what went out
+        for(size_t i = 0; i < iov_cnt; ++i){
+          const uint8_t *src = static_cast<const uint8_t*>(iov[i].iov_base);
+          const size_t num_skip = std::min(num_sent, iov[i].iov_len);
+          num_sent -= num_skip;
+          write_buf_.insert(write_buf_.end(), src + num_skip, src + iov[i].iov_len);
+        }
+      }
+      return true;
+    }
+
+    // Closes the connection from any thread, on_close follows on the reactor
+    void Close(){
+      std::lock_guard<std::mutex> lock(write_mtx_);
+      if(!closed_)
+        Drop();
+    }
+
+    uint64_t GetId() const{
+      return id_;
+    }
+
+    const std::string &GetPeer() const{
+      return peer_;
+    }
+
+    // Bytes waiting to be written, eg. to skip a slow client for a frame
+    size_t GetWriteBacklog(){
+      std::lock_guard<std::mutex> lock(write_mtx_);
+      return write_buf_.size() - write_offset_;
+    }
+};
+
+
+class TcpServer{
+  struct Reactor{
+    EventLoop event_loop;
+    int listen_fd;
+    std::mutex mtx; // guards conn_map
+    std::unordered_map<int, TcpConnectionPtr> conn_map;
+
+    Reactor() : listen_fd(-1){}
+  };
+
+  TcpServerCallbacks callbacks_;
+  size_t max_write_buffer_;
+  std::vector< std::unique_ptr<Reactor> > reactor_vec_;
+  std::atomic<uint64_t> next_conn_id_;
+  bool started_;
+
+  static int Listen(struct addrinfo *addr_info, const bool reuse_port, const int backlog){
+    for(struct addrinfo *p = addr_info; p != NULL; p = p->ai_next){
+      int fd;
+      EXP_CHK_ERRNO((fd = socket(p->ai_family, p->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC, p->ai_protocol)) != -1,
+                    continue)
+      int yes = 1;
+      EXP_CHK_ERRNO(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes)) != -1, close(fd); continue)
+      if(reuse_port){
+        EXP_CHK_ERRNO(setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) != -1, close(fd); continue)
+      }
+      EXP_CHK_ERRNO(bind(fd, p->ai_addr, p->ai_addrlen) != -1, close(fd); continue)
+      EXP_CHK_ERRNO(listen(fd, backlog) != -1, close(fd); continue)
+      return fd;
+    }
+    return -1;
+  }
+
+  void Accept(Reactor *reactor){
+    for(;;){ // edge-triggered, take every pending connection
+      struct sockaddr_storage addr;
+      socklen_t addr_len = sizeof(addr);
+      const int fd = accept4(reactor->listen_fd, (struct sockaddr*)&addr, &addr_len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if(fd == -1){
+        if(errno == EINTR || errno == ECONNABORTED)
+          continue;
+        EXP_CHK_ERRNO(errno == EAGAIN || errno == EWOULDBLOCK, return)
+        return;
+      }
+      int yes = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &yes, sizeof(yes));
+      char cstr[INET6_ADDRSTRLEN] = "";
+      inet_ntop_sin(&addr, cstr, sizeof(cstr));
+      const std::string peer = std::string(cstr) + ":" + std::to_string(ntohs_port((struct sockaddr*)&addr));
+      TcpConnectionPtr conn = std::make_shared<TcpConnection>(fd, next_conn_id_++, peer, max_write_buffer_);
+      {
+        std::lock_guard<std::mutex> lock(reactor->mtx);
+        reactor->conn_map[fd] = conn;
+      }
+      if(callbacks_.on_connect)
+        callbacks_.on_connect(conn);
+      const bool added = reactor->event_loop.AddFd(fd, [this, reactor, conn](const uint32_t events){
+        HandleEvents(reactor, conn, events);
+      }, EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET);
+      EXP_CHK(added, CloseConnection(reactor, conn, false))
+    }
+  }
+
+  void HandleEvents(Reactor *reactor, const TcpConnectionPtr &conn, const uint32_t events){
+    if(events & EPOLLOUT){
+      std::lock_guard<std::mutex> lock(conn->write_mtx_);
+      if(!conn->closed_ && !conn->Flush())
+        conn->Drop();
+    }
+    if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+      if(!Read(conn))
+        CloseConnection(reactor, conn, true);
+  }
+
+  // Returns false once the peer closed or the socket failed
+  bool Read(const TcpConnectionPtr &conn){
+    const size_t kReadSize = 64*1024;
+    std::vector<uint8_t> &buf = conn->read_buf_;
+    for(;;){ // edge-triggered, read until the socket is empty
+      const size_t old_size = buf.size();
+      buf.resize(old_size + kReadSize);
+      const ssize_t num_byte = recv(conn->fd_, buf.data() + old_size, kReadSize, 0);
+      buf.resize(old_size + (num_byte > 0 ? num_byte : 0));
+      if(num_byte == 0)
+        return false;
+      if(num_byte == -1){
+        if(errno == EINTR)
+          continue;
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+      }
+      if(callbacks_.on_data){
+        const size_t num_consumed = std::min(buf.size(), callbacks_.on_data(conn, buf.data(), buf.size()));
+        buf.erase(buf.begin(), buf.begin() + num_consumed);
+        EXP_CHK_M(buf.size() <= conn->max_write_buffer_, return false, conn->peer_ + " sent more than it consumes")
+      }
+      else
+        buf.clear();
+    }
+  }
+
+  void CloseConnection(Reactor *reactor, const TcpConnectionPtr &conn, const bool registered){
+    if(registered)
+      reactor->event_loop.RemoveFd(conn->fd_);
+    {
+      std::lock_guard<std::mutex> lock(reactor->mtx);
+      reactor->conn_map.erase(conn->fd_);
+    }
+    {
+      std::lock_guard<std::mutex> lock(conn->write_mtx_);
+      conn->closed_ = true;
+      close(conn->fd_); // the fd number can be reused from here on
+    }
+    if(callbacks_.on_close)
+      callbacks_.on_close(conn);
+  }
+
+  public:
+    TcpServer(const TcpServerCallbacks &callbacks, const size_t max_buffer_size = 16*1024*1024) :
+        callbacks_(callbacks), max_write_buffer_(max_buffer_size), next_conn_id_(0), started_(false){}
+
+    ~TcpServer(){
+      Stop();
+    }
+
+    TcpServer(const TcpServer&) = delete;
+    TcpServer &operator=(const TcpServer&) = delete;
+
+    // interface_ip_addr_str is optional, port_num_str must be provided
+    bool Start(const std::string &interface_ip_addr_str, const std::string &port_num_str,
+               const size_t num_reactor = 1, const int backlog = 128){
+      EXP_CHK(!started_ && num_reactor > 0, return false)
+      struct addrinfo hints, *addr_info;
+      memset(&hints, 0, sizeof hints);
+      hints.ai_family = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      hints.ai_flags = interface_ip_addr_str.empty() ? AI_PASSIVE : 0;
+      int rv;
+      EXP_CHK_M((rv = getaddrinfo(interface_ip_addr_str.empty() ? NULL : interface_ip_addr_str.c_str(),
+                                  port_num_str.c_str(), &hints, &addr_info)) == 0, return false, gai_strerror(rv))
+      for(size_t i = 0; i < num_reactor; ++i){
+        std::unique_ptr<Reactor> reactor(new Reactor);
+        reactor->listen_fd = Listen(addr_info, num_reactor > 1, backlog);
+        EXP_CHK_M(reactor->listen_fd != -1, freeaddrinfo(addr_info); Stop(); return false,
+                  "failed to listen on port " + port_num_str)
+        Reactor *reactor_ptr = reactor.get();
+        const bool added = reactor->event_loop.AddFd(reactor->listen_fd, [this, reactor_ptr](const uint32_t){
+          Accept(reactor_ptr);
+        }, EPOLLIN | EPOLLET);
+        reactor_vec_.push_back(std::move(reactor));
+        EXP_CHK(added, freeaddrinfo(addr_info); Stop(); return false)
+      }
+      freeaddrinfo(addr_info);
+      for(auto &reactor : reactor_vec_)
+        reactor->event_loop.Start();
+      started_ = true;
+      return true;
+    }
+
+    // Stops the reactors and closes every connection, without on_close
+    void Stop(){
+      for(auto &reactor : reactor_vec_){
+        reactor->event_loop.Stop();
+        std::lock_guard<std::mutex> lock(reactor->mtx);
+        for(auto &conn_item : reactor->conn_map){
+          std::lock_guard<std::mutex> conn_lock(conn_item.second->write_mtx_);
+          conn_item.second->closed_ = true;
+          close(conn_item.first);
+        }
+        reactor->conn_map.clear();
+        if(reactor->listen_fd != -1)
+          close(reactor->listen_fd);
+      }
+      reactor_vec_.clear();
+      started_ = false;
+    }
+
+    // Sends to every connection, returns the number of connections that took it
+    size_t Broadcast(const void *data, const size_t size){
+      struct iovec iov;
+      iov.iov_base = const_cast<void*>(data);
+      iov.iov_len = size;
+      return BroadcastV(&iov, 1);
+    }
+
+    size_t BroadcastV(const struct iovec *iov, const size_t iov_cnt){
+      std::vector<TcpConnectionPtr> conn_vec;
+      for(auto &reactor : reactor_vec_){
+        std::lock_guard<std::mutex> lock(reactor->mtx);
+        for(auto &conn_item : reactor->conn_map)
+          conn_vec.push_back(conn_item.second);
+      }
+      size_t num_sent = 0;
+      for(const TcpConnectionPtr &conn : conn_vec)
+        num_sent += conn->SendV(iov, iov_cnt);
+      return num_sent;
+    }
+
+    size_t GetNumConnection(){
+      size_t num_conn = 0;
+      for(auto &reactor : reactor_vec_){
+        std::lock_guard<std::mutex> lock(reactor->mtx);
+        num_conn += reactor->conn_map.size();
+      }
+      return num_conn;
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_TCP_SERVER_H__
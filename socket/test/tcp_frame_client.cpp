@@ -0,0 +1,24 @@
+#include "mio/socket/socket.h"
+#include <cstdlib>
+
+
+// Prints the frames from tcp_telemetry_server. Usage: tcp_frame_client [server ip] [seconds]
+int main(int argc, char *argv[]){
+  mio::CClientTCP client_tcp;
+  EXP_CHK(client_tcp.Init((argc > 1) ? argv[1] : "127.0.0.1", "3495") == 0, return -1)
+
+  mio::TCPHandlerThread handler_thread;
+  handler_thread.tcp_sock_ = &client_tcp;
+  handler_thread.frame_handler_ = [](const mio::FrameView &frame){
+    double sample = 0;
+    if(frame.header.length == sizeof(sample))
+      memcpy(&sample, frame.payload, sizeof(sample));
+    printf("frame %u, type %d, utime %lld: %f\n", frame.header.sequence, frame.header.type,
+           static_cast<long long>(frame.header.utime), sample);
+  };
+  handler_thread.Start();
+  std::this_thread::sleep_for(std::chrono::seconds((argc > 2) ? atoi(argv[2]) : 5));
+  handler_thread.Stop();
+
+  return 0;
+}
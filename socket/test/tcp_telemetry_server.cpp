@@ -0,0 +1,43 @@
+#include "mio/socket/framing.h"
+#include "mio/socket/tcp_server.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <thread>
+
+
+// Streams a sample frame (see framing.h) to every connected client at 100 Hz, eg. watch it with several
+// tcp_frame_client at once. Usage: tcp_telemetry_server [num reactors] [seconds]
+int main(int argc, char *argv[]){
+  const size_t num_reactor = (argc > 1) ? std::max(atoi(argv[1]), 1) : 2;
+  const int num_sec = (argc > 2) ? atoi(argv[2]) : 30;
+
+  mio::TcpServerCallbacks callbacks;
+  callbacks.on_connect = [](const mio::TcpConnectionPtr &conn){
+    printf("client %lu connected from %s\n", static_cast<unsigned long>(conn->GetId()), conn->GetPeer().c_str());
+  };
+  callbacks.on_close = [](const mio::TcpConnectionPtr &conn){
+    printf("client %lu disconnected\n", static_cast<unsigned long>(conn->GetId()));
+  };
+  mio::TcpServer server(callbacks);
+  EXP_CHK(server.Start("", "3495", num_reactor), return -1)
+
+  // The frame header carries the sequence and time stamp, the payload is the sample
+  const uint16_t kSampleType = 1;
+  mio::FrameEncoder encoder;
+  uint8_t header[mio::kFrameHeaderSize];
+  double sample;
+  struct iovec iov[2] = {{header, sizeof(header)}, {&sample, sizeof(sample)}};
+  for(int i = 0; i < 100*num_sec; ++i){
+    sample = std::sin(0.01*i);
+    encoder.EncodeHeader(kSampleType, sizeof(sample), header);
+    server.BroadcastV(iov, 2);
+    if(i % 100 == 0)
+      printf("%zu clients\n", server.GetNumConnection());
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  server.Stop();
+  return 0;
+}
@@ -0,0 +1,296 @@
+#ifndef __MIO_UDP_BATCH_H__
+#define __MIO_UDP_BATCH_H__
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <poll.h>
+#include <time.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#include "mio/altro/error.h"
+#include "mio/socket/socket.h"
+
+// Older libc headers lack the UDP GSO (Linux 4.18) and GRO (Linux 5.0) options
+#ifndef SOL_UDP
+#define SOL_UDP 17
+#endif
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+
+/*
+Batched UDP with recvmmsg()/sendmmsg(), one system call for up to batch_size
+datagrams instead of one each, for high rate sensor streams, eg. on the
+sockets of CServerUDP/CClientUDP:
+
+  mio::UdpBatchReceiver receiver(server_udp.interface_sock_fd(), 64, 1500);
+  for(;;){
+    const int num_datagram = receiver.Recv(100); // waits up to 100 ms for the first one
+    for(int i = 0; i < num_datagram; ++i){
+      const mio::Datagram &datagram = receiver[i];
+      Handle(datagram.data, datagram.size, datagram.recv_ns);
+    }
+  }
+
+  mio::UdpBatchSender sender(client_udp.server_sock_fd(), client_udp.server_ai_addr(), client_udp.server_ai_addrlen());
+  for(auto &packet : packet_vec)
+    sender.Add(packet.data(), packet.size()); // sent once batch_size are queued
+  sender.Flush();
+
+The receiver reads into an arena allocated once, batch_size slots of
+max_datagram_size bytes, and the datagrams it hands out point into it until
+the next Recv(). Each carries the kernel receive time (SO_TIMESTAMPNS).
+
+With gro, the kernel may coalesce consecutive datagrams of one sender into a
+single buffer (UDP_GRO, Linux 5.0), which saves the per packet cost on the
+way up as well. The receiver splits those buffers up again, so Recv() still
+hands out single datagrams, but its slots grow to 64 KB. The sender side is
+SetSegmentSize() (UDP_SEGMENT, Linux 4.18): Add() then takes up to 64
+datagrams of segment_size bytes back to back in one buffer, and the kernel or
+the NIC splits them.
+*/
+
+namespace mio{
+
+struct Datagram{
+  const uint8_t *data;
+  size_t size;
+  const struct sockaddr_storage *src_addr;
+  socklen_t src_addr_len;
+  int64_t recv_ns; // kernel receive time, CLOCK_REALTIME nanoseconds, 0 if not available
+  bool truncated; // longer than max_datagram_size, the rest is lost
+};
+
+
+class UdpBatchReceiver{
+  int sock_fd_;
+  size_t batch_size_, slot_size_;
+  bool gro_;
+  std::vector<uint8_t> arena_;
+  std::vector<uint8_t> control_arena_;
+  std::vector<struct mmsghdr> msg_vec_;
+  std::vector<struct iovec> iov_vec_;
+  std::vector<struct sockaddr_storage> addr_vec_;
+  std::vector<Datagram> datagram_vec_;
+
+  static const size_t kControlSize = 64; // room for the time stamp and the GRO segment size
+
+  public:
+    // timestamp enables SO_TIMESTAMPNS and gro UDP_GRO on sock_fd. An option the kernel does not support is left off.
+    UdpBatchReceiver(const int sock_fd, const size_t batch_size = 64, const size_t max_datagram_size = 2048,
+                     const bool timestamp = true, const bool gro = false) :
+        sock_fd_(sock_fd), batch_size_(std::max<size_t>(batch_size, 1)), slot_size_(max_datagram_size), gro_(false){
+      const int yes = 1;
+      if(timestamp){
+        EXP_CHK_ERRNO(setsockopt(sock_fd_, SOL_SOCKET, SO_TIMESTAMPNS, &yes, sizeof(yes)) != -1, )
+      }
+      if(gro){
+        gro_ = setsockopt(sock_fd_, SOL_UDP, UDP_GRO, &yes, sizeof(yes)) != -1;
+        if(gro_)
+          slot_size_ = std::max<size_t>(slot_size_, 65535); // a coalesced buffer can be up to 64 KB
+        else
+          printf("%s - UDP_GRO is not supported (%s)\n", CURRENT_FUNC, std::strerror(errno));
+      }
+      arena_.resize(batch_size_*slot_size_);
+      control_arena_.resize(batch_size_*kControlSize);
+      msg_vec_.resize(batch_size_);
+      iov_vec_.resize(batch_size_);
+      addr_vec_.resize(batch_size_);
+      datagram_vec_.reserve(batch_size_);
+    }
+
+    UdpBatchReceiver(const UdpBatchReceiver&) = delete;
+    UdpBatchReceiver &operator=(const UdpBatchReceiver&) = delete;
+
+    // Receives up to batch_size datagrams (more with GRO), waiting up to timeout_ms for the first one (-1 waits
+    // forever). Returns the number of datagrams, 0 on timeout or -1 on error.
+    int Recv(const int timeout_ms = -1){
+      datagram_vec_.clear();
+      for(size_t i = 0; i < batch_size_; ++i){
+        iov_vec_[i].iov_base = arena_.data() + i*slot_size_;
+        iov_vec_[i].iov_len = slot_size_;
+        struct msghdr &msg = msg_vec_[i].msg_hdr;
+        msg.msg_name = &addr_vec_[i];
+        msg.msg_namelen = sizeof(addr_vec_[i]);
+        msg.msg_iov = &iov_vec_[i];
+        msg.msg_iovlen = 1;
+        msg.msg_control = control_arena_.data() + i*kControlSize;
+        msg.msg_controllen = kControlSize;
+        msg.msg_flags = 0;
+        msg_vec_[i].msg_len = 0;
+      }
+      int num_msg;
+      for(;;){
+        num_msg = recvmmsg(sock_fd_, msg_vec_.data(), batch_size_, MSG_DONTWAIT, NULL);
+        if(num_msg != -1)
+          break;
+        if(errno == EINTR)
+          continue;
+        EXP_CHK_ERRNO(errno == EAGAIN || errno == EWOULDBLOCK, return(-1))
+        struct pollfd pfd;
+        pfd.fd = sock_fd_;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        const int num_ready = poll(&pfd, 1, timeout_ms);
+        if(num_ready == -1 && errno == EINTR)
+          continue;
+        EXP_CHK_ERRNO(num_ready != -1, return(-1))
+        if(num_ready == 0)
+          return 0;
+      }
+
+      for(int i = 0; i < num_msg; ++i){
+        struct msghdr &msg = msg_vec_[i].msg_hdr;
+        int64_t recv_ns = 0;
+        size_t segment_size = 0;
+        for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg != NULL; cmsg = CMSG_NXTHDR(&msg, cmsg)){
+          if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_TIMESTAMPNS){
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            recv_ns = static_cast<int64_t>(ts.tv_sec)*1000000000ll + ts.tv_nsec;
+          }
+          else if(cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO){
+            int gso_size;
+            memcpy(&gso_size, CMSG_DATA(cmsg), sizeof(gso_size));
+            segment_size = gso_size > 0 ? gso_size : 0;
+          }
+        }
+        const uint8_t *data = static_cast<const uint8_t*>(iov_vec_[i].iov_base);
+        const size_t size = msg_vec_[i].msg_len;
+        Datagram datagram;
+        datagram.src_addr = &addr_vec_[i];
+        datagram.src_addr_len = msg.msg_namelen;
+        datagram.recv_ns = recv_ns;
+        datagram.truncated = (msg.msg_flags & MSG_TRUNC) != 0;
+        if(segment_size == 0 || segment_size >= size){
+          datagram.data = data;
+          datagram.size = size;
+          datagram_vec_.push_back(datagram);
+          continue;
+        }
+        // GRO coalesced datagrams of segment_size, the last one can be shorter
+        for(size_t offset = 0; offset < size; offset += segment_size){
+          datagram.data = data + offset;
+          datagram.size = std::min(segment_size, size - offset);
+          datagram_vec_.push_back(datagram);
+        }
+      }
+      return static_cast<int>(datagram_vec_.size());
+    }
+
+    const Datagram &operator[](const size_t idx) const{
+      return datagram_vec_[idx];
+    }
+
+    size_t GetNumDatagram() const{
+      return datagram_vec_.size();
+    }
+
+    bool IsGroEnabled() const{
+      return gro_;
+    }
+};
+
+
+class UdpBatchSender{
+  int sock_fd_;
+  size_t batch_size_, num_queued_;
+  struct sockaddr_storage default_addr_;
+  socklen_t default_addr_len_;
+  std::vector<struct mmsghdr> msg_vec_;
+  std::vector<struct iovec> iov_vec_;
+  std::vector<struct sockaddr_storage> addr_vec_;
+
+  public:
+    // dest_addr is where Add() sends without an address of its own, it is not needed on a connected socket
+    UdpBatchSender(const int sock_fd, const struct sockaddr *dest_addr = NULL, const socklen_t dest_addr_len = 0,
+                   const size_t batch_size = 64) :
+        sock_fd_(sock_fd), batch_size_(std::max<size_t>(batch_size, 1)), num_queued_(0), default_addr_len_(0){
+      memset(&default_addr_, 0, sizeof(default_addr_));
+      if(dest_addr != NULL && dest_addr_len <= sizeof(default_addr_)){
+        memcpy(&default_addr_, dest_addr, dest_addr_len);
+        default_addr_len_ = dest_addr_len;
+      }
+      msg_vec_.resize(batch_size_);
+      iov_vec_.resize(batch_size_);
+      addr_vec_.resize(batch_size_);
+    }
+
+    ~UdpBatchSender(){
+      if(num_queued_ > 0)
+        Flush();
+    }
+
+    UdpBatchSender(const UdpBatchSender&) = delete;
+    UdpBatchSender &operator=(const UdpBatchSender&) = delete;
+
+    // UDP_SEGMENT, every datagram handed to Add() is sent as datagrams of segment_size (the last one can be
+    // shorter), 0 turns it off. Returns false if the kernel does not support it.
+    bool SetSegmentSize(const uint16_t segment_size){
+      const int value = segment_size;
+      EXP_CHK_ERRNO(setsockopt(sock_fd_, SOL_UDP, UDP_SEGMENT, &value, sizeof(value)) != -1, return false)
+      return true;
+    }
+
+    // Queues a datagram, data has to stay valid until it is sent. Sends the batch once batch_size are queued.
+    // Returns the number of datagrams sent, or -1 on error.
+    int Add(const void *data, const size_t size, const struct sockaddr *dest_addr = NULL,
+            const socklen_t dest_addr_len = 0){
+      EXP_CHK(dest_addr_len <= sizeof(struct sockaddr_storage), return(-1))
+      iov_vec_[num_queued_].iov_base = const_cast<void*>(data);
+      iov_vec_[num_queued_].iov_len = size;
+      struct msghdr &msg = msg_vec_[num_queued_].msg_hdr;
+      memset(&msg, 0, sizeof(msg));
+      msg.msg_iov = &iov_vec_[num_queued_];
+      msg.msg_iovlen = 1;
+      if(dest_addr != NULL){
+        memcpy(&addr_vec_[num_queued_], dest_addr, dest_addr_len);
+        msg.msg_name = &addr_vec_[num_queued_];
+        msg.msg_namelen = dest_addr_len;
+      }
+      else if(default_addr_len_ > 0){
+        msg.msg_name = &default_addr_;
+        msg.msg_namelen = default_addr_len_;
+      }
+      ++num_queued_;
+      return num_queued_ == batch_size_ ? Flush() : 0;
+    }
+
+    // Sends every queued datagram, waiting for the socket when its buffer is full. Returns the number sent, or -1
+    // on error, which drops the rest of the batch.
+    int Flush(const int timeout_ms = 2000){
+      size_t num_sent = 0;
+      while(num_sent < num_queued_){
+        const int num_msg = sendmmsg(sock_fd_, msg_vec_.data() + num_sent, num_queued_ - num_sent, MSG_DONTWAIT);
+        if(num_msg == -1 && errno == EINTR)
+          continue;
+        if(num_msg == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)){
+          struct pollfd pfd;
+          pfd.fd = sock_fd_;
+          pfd.events = POLLOUT;
+          pfd.revents = 0;
+          const int num_ready = poll(&pfd, 1, timeout_ms);
+          EXP_CHK_ERRNO(num_ready != -1 || errno == EINTR, num_queued_ = 0; return(-1))
+          EXP_CHK_M(num_ready != 0, num_queued_ = 0; return(-1), "timed out waiting for the socket")
+          continue;
+        }
+        EXP_CHK_ERRNO(num_msg > 0, num_queued_ = 0; return(-1))
+        num_sent += num_msg;
+      }
+      num_queued_ = 0;
+      return static_cast<int>(num_sent);
+    }
+
+    size_t GetNumQueued() const{
+      return num_queued_;
+    }
+};
+
+} //namespace mio
+
+#endif //__MIO_UDP_BATCH_H__